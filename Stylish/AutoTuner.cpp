@@ -0,0 +1,293 @@
+#include "AutoTuner.h"
+
+#include "Inference.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+
+AutoTuner::AutoTuner(Inference* inf) : m_Inf{ inf } {
+}
+
+
+
+AutoTuner::~AutoTuner() {
+  cancel();
+
+  if (m_Worker.joinable()) {
+    m_Worker.join();
+  }
+}
+
+
+
+void AutoTuner::start(int width, int height, int qualityFloor) {
+  if (isRunning() || width < 4 || height < 4) {
+    return;
+  }
+
+  // a cancelled run may still be finishing its last run
+  if (m_Worker.joinable()) {
+    m_Worker.join();
+  }
+
+  auto qualityRange = m_Inf->getQualityPerfRange();
+  m_QualityFloor = std::clamp(qualityFloor, qualityRange.first, qualityRange.second);
+
+  m_Original.provider = m_Inf->getProvider();
+  m_Original.intraOpThreads = m_Inf->getIntraOpThreads();
+  m_Original.interOpThreads = m_Inf->getInterOpThreads();
+  m_Original.quality = m_Inf->getQualityPerfFactor();
+  m_Original.modelTier = m_Inf->getModelTier();
+
+  // Synthetic frames: content is irrelevant for timing, only the size matters
+  m_Frame = cv::Mat(height, width, CV_8UC3);
+  cv::randu(m_Frame, cv::Scalar::all(0), cv::Scalar::all(255));
+
+  m_StyleBlob.resize(m_StyleSize.first * m_StyleSize.second * 3);
+  cv::Mat styleMat(m_StyleSize.second, m_StyleSize.first, CV_32FC3, m_StyleBlob.data());
+  cv::randu(styleMat, cv::Scalar::all(0.0f), cv::Scalar::all(1.0f));
+
+  buildGrid();
+
+  m_Measured = 0;
+  m_Applied = false;
+  m_TimedOut = false;
+
+  {
+    std::lock_guard<std::mutex> lock(m_ResultsMutex);
+    m_Results.clear();
+    m_Best = -1;
+  }
+
+  m_Deadline = std::chrono::steady_clock::now() + m_TimeBudget;
+  m_Cancel = false;
+  m_State = State::Running;
+
+  // live frames would compete with the trials for the cores (or the GPU), skewing the timings
+  m_Inf->pause();
+
+  m_Worker = std::thread(&AutoTuner::run, this);
+}
+
+
+
+void AutoTuner::cancel() {
+  if (!isRunning()) {
+    return;
+  }
+
+  // nothing was applied yet, the worker stops before its next run
+  m_Cancel = true;
+  m_State = State::Cancelled;
+
+  m_Inf->resume();
+}
+
+
+
+void AutoTuner::run() {
+  auto stop = [this] { return m_Cancel || std::chrono::steady_clock::now() >= m_Deadline; };
+
+  bool cut = false;
+
+  for (size_t t = 0; t < m_Grid.size() && !cut && !stop(); t++) {
+    const auto& trial = m_Grid[t];
+
+    std::vector<float> medians;
+    bool failed = false;
+
+    try {
+      medians = m_Inf->benchmark(static_cast<Inference::Provider>(trial.config.provider), trial.config.intraOpThreads,
+        trial.config.interOpThreads, trial.config.modelTier, trial.qualities, m_Frame, m_StyleBlob, m_StyleSize, m_TimedRuns, stop);
+    } catch (std::exception& e) {
+      std::cout << "Autotune: " << describe(trial.config) << " failed: " << e.what() << std::endl;
+      medians.assign(trial.qualities.size(), -1.0f);
+      failed = true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_ResultsMutex);
+
+    for (size_t q = 0; q < trial.qualities.size(); q++) {
+      // cut short, not a measurement
+      if (!failed && medians[q] < 0.0f) {
+        cut = true;
+        break;
+      }
+
+      Result result;
+      result.config = trial.config;
+      result.config.quality = trial.qualities[q];
+      result.ms = medians[q];
+      result.baseline = t == 0 && result.config.quality == m_Original.quality;
+
+      m_Results.push_back(result);
+      m_Measured++;
+    }
+  }
+
+  if (!m_Cancel) {
+    m_TimedOut = m_Measured < m_GridConfigs;
+    finish();
+  }
+
+  m_Inf->resume();
+}
+
+
+
+float AutoTuner::getProgress() const {
+  if (m_Grid.empty()) {
+    return 0.0f;
+  }
+
+  return static_cast<float>(m_Measured) / m_GridConfigs;
+}
+
+
+
+std::vector<AutoTuner::Result> AutoTuner::getResults() const {
+  std::lock_guard<std::mutex> lock(m_ResultsMutex);
+  return m_Results;
+}
+
+
+
+int AutoTuner::getBest() const {
+  std::lock_guard<std::mutex> lock(m_ResultsMutex);
+  return m_Best;
+}
+
+
+
+std::string AutoTuner::describe(const Config& config) const {
+  std::string str = config.provider == Inference::Provider::GPU ? "GPU" : "CPU";
+  str += " " + std::to_string(config.intraOpThreads) + "/" + std::to_string(config.interOpThreads);
+  str += " " + m_Inf->getModelTierName(config.modelTier);
+  str += " Q" + std::to_string(config.quality);
+  return str;
+}
+
+
+
+void AutoTuner::buildGrid() {
+  m_Grid.clear();
+
+  int hw = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+  // current threading first, it doesn't require recreating the sessions
+  std::vector<std::pair<int, int>> threads = { { m_Original.intraOpThreads, m_Original.interOpThreads } };
+
+  for (auto intra : { 2, 4, hw / 2, hw }) {
+    std::pair<int, int> t = { std::clamp(intra, 1, hw), 1 };
+
+    if (std::find(threads.begin(), threads.end(), t) == threads.end()) {
+      threads.push_back(t);
+    }
+  }
+
+  auto qualityRange = m_Inf->getQualityPerfRange();
+
+  std::vector<int> qualities;
+  for (int q = m_QualityFloor; q <= qualityRange.second; q++) {
+    qualities.push_back(q);
+  }
+
+  auto sameSessions = [](const Config& a, const Config& b) {
+    return a.provider == b.provider && a.intraOpThreads == b.intraOpThreads && a.interOpThreads == b.interOpThreads && a.modelTier == b.modelTier;
+  };
+
+  // The baseline first: the current configuration, with its sessions also timed at the qualities meeting the floor
+  Trial baseline = { m_Original, qualities };
+  if (m_Original.quality < m_QualityFloor) {
+    baseline.qualities.insert(baseline.qualities.begin(), m_Original.quality);
+  }
+
+  m_Grid.push_back(baseline);
+
+  // Then every model, lightest (likely fastest) first, on the CPU and the GPU with the current threading,
+  // then on the CPU with the other threading options (threading barely matters for the GPU)
+  for (size_t i = 0; i < threads.size(); i++) {
+    for (int tier = 0; tier < m_Inf->getModelTierCount(); tier++) {
+      Config cpu = { Inference::Provider::CPU, threads[i].first, threads[i].second, 0, tier };
+      Config gpu = { Inference::Provider::GPU, threads[i].first, threads[i].second, 0, tier };
+
+      if (!sameSessions(cpu, m_Original)) {
+        m_Grid.push_back({ cpu, qualities });
+      }
+
+      if (i == 0 && m_Inf->isGPUReady() && !sameSessions(gpu, m_Original)) {
+        m_Grid.push_back({ gpu, qualities });
+      }
+    }
+  }
+
+  m_GridConfigs = 0;
+  for (const auto& trial : m_Grid) {
+    m_GridConfigs += trial.qualities.size();
+  }
+}
+
+
+
+void AutoTuner::apply(const Config& config) {
+  if (!m_Inf->setThreadCount(config.intraOpThreads, config.interOpThreads)) {
+    throw std::runtime_error("Sessions with " + std::to_string(config.intraOpThreads) + "/" + std::to_string(config.interOpThreads) + " threads unavailable");
+  }
+
+  if (!m_Inf->setModelTier(config.modelTier, true)) {
+    throw std::runtime_error("Model " + m_Inf->getModelTierName(config.modelTier) + " unavailable");
+  }
+
+  m_Inf->setProvider(static_cast<Inference::Provider>(config.provider));
+  m_Inf->setQualityPerfFactor(config.quality);
+}
+
+
+
+void AutoTuner::finish() {
+  std::unique_lock<std::mutex> lock(m_ResultsMutex);
+
+  int baseline = -1;
+  m_Best = -1;
+
+  // the fastest configuration meeting the quality floor
+  for (int i = 0; i < static_cast<int>(m_Results.size()); i++) {
+    const auto& r = m_Results[i];
+
+    if (r.ms < 0.0f) {
+      continue;
+    }
+
+    if (r.baseline) {
+      baseline = i;
+    }
+
+    if (r.config.quality >= m_QualityFloor && (m_Best < 0 || r.ms < m_Results[m_Best].ms)) {
+      m_Best = i;
+    }
+  }
+
+  // A partial grid leaves whole models/providers unmeasured, so only trust it over what already runs when it measurably beats it
+  bool worthIt = m_Best >= 0 && !m_Results[m_Best].baseline &&
+    (!m_TimedOut || (baseline >= 0 && m_Results[m_Best].ms < m_Results[baseline].ms));
+
+  // the only change to the live configuration
+  if (worthIt && !m_Cancel) {
+    auto config = m_Results[m_Best].config;
+    lock.unlock();
+
+    try {
+      apply(config);
+      m_Applied = true;
+    } catch (std::exception& e) {
+      std::cout << "Autotune: failed to apply configuration: " << e.what() << std::endl;
+    }
+  }
+
+  // unless cancelled meanwhile
+  auto running = State::Running;
+  m_State.compare_exchange_strong(running, State::Done);
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+
+class Inference;
+
+//
+// Benchmarks a short grid of provider/threading/model/quality configurations on synthetic frames
+// and applies the best one. The grid runs on a worker thread, each trial on sessions of its own
+// (Inference::benchmark, built once per provider/threading/model and timed at every quality), so
+// the live configuration stays untouched until the final choice is applied. Live stylization is
+// paused meanwhile, it would skew the timings. The time budget and cancellation are checked
+// before every run.
+//
+// The current configuration is timed first, as the baseline. The fastest configuration with a
+// quality (resolution) >= floor wins. It is applied if the whole grid was timed, or, when the time
+// budget ran out first, only if it beats the baseline.
+//
+class AutoTuner {
+public:
+
+  struct Config {
+    int provider = 0;
+    int intraOpThreads = 4;
+    int interOpThreads = 4;
+    int quality = 2;
+    int modelTier = 0;
+  };
+
+  struct Result {
+    Config config;
+    float ms = -1.0f;       // median run time, negative if the configuration failed
+    bool baseline = false;  // the configuration active before tuning
+  };
+
+  enum class State {
+    Idle = 0,
+    Running,
+    Done,
+    Cancelled
+  };
+
+  AutoTuner(Inference* inf);
+
+  virtual ~AutoTuner();
+
+  AutoTuner(const AutoTuner&) = delete;
+  AutoTuner(AutoTuner&&) = delete;
+
+  AutoTuner& operator=(const AutoTuner&) = delete;
+  AutoTuner& operator=(AutoTuner&&) = delete;
+
+  void start(int width, int height, int qualityFloor);
+  void cancel();
+
+  State getState() const { return m_State; }
+  bool isRunning() const { return m_State == State::Running; }
+
+  // [0, 1]
+  float getProgress() const;
+
+  // A copy, the worker adds to them while running
+  std::vector<Result> getResults() const;
+
+  // Index of the fastest result meeting the quality floor, -1 until done (or if none did)
+  int getBest() const;
+
+  // Whether the best result was applied, see above
+  bool isApplied() const { return m_Applied; }
+
+  // The time budget ran out before the whole grid was timed
+  bool isTimedOut() const { return m_TimedOut; }
+
+  std::string describe(const Config& config) const;
+
+  void setTimeBudget(std::chrono::seconds budget) { m_TimeBudget = budget; }
+
+private:
+
+  Inference* m_Inf;
+
+  std::atomic<State> m_State = State::Idle;
+  std::atomic<bool> m_Cancel = false;
+
+  std::thread m_Worker;
+
+  std::chrono::seconds m_TimeBudget{ 20 };
+  std::chrono::steady_clock::time_point m_Deadline;
+
+  int m_QualityFloor = 0;
+
+  const int m_TimedRuns = 3;
+
+  // Configuration active before tuning, the grid is built around it
+  Config m_Original;
+
+  // One set of sessions (config without its quality), timed at several quality factors
+  struct Trial {
+    Config config;
+    std::vector<int> qualities;
+  };
+
+  std::vector<Trial> m_Grid;
+  size_t m_GridConfigs = 0;
+  std::atomic<size_t> m_Measured = 0;  // configurations timed (or failed) so far
+
+  mutable std::mutex m_ResultsMutex;
+  std::vector<Result> m_Results;
+  int m_Best = -1;
+
+  std::atomic<bool> m_Applied = false;
+  std::atomic<bool> m_TimedOut = false;
+
+  // Synthetic workload
+  cv::Mat m_Frame;
+  std::vector<float> m_StyleBlob;
+  std::pair<int, int> m_StyleSize = { 256, 256 };
+
+
+  void buildGrid();
+
+  // Worker thread
+  void run();
+  void apply(const Config& config);
+  void finish();
+};
\ No newline at end of file
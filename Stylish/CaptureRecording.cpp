@@ -0,0 +1,306 @@
+#include "CaptureRecording.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+
+using namespace CaptureRecording;
+
+
+namespace {
+  const char Magic[8] = { 'S', 'T', 'Y', 'R', 'E', 'C', '1', '\0' };
+
+  const int KeyframeInterval = 60;
+
+  // frames waiting for the encoder, at most
+  const size_t MaxQueued = 8;
+
+  // PNG level 1: most of the gain on screen content at a fraction of the default's cost
+  const int PngCompression = 1;
+
+  // sanity limits for reading, anything beyond is a corrupt record
+  const uint32_t MaxDimension = 16384;
+  const uint32_t MaxDirtyRects = 1 << 16;
+  const uint32_t MaxPayload = 1u << 30;
+
+
+  template <typename T>
+  void WriteValue(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+
+
+  template <typename T>
+  bool ReadValue(std::ifstream& file, T& value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+  }
+}
+
+
+
+CaptureRecorder::~CaptureRecorder() {
+  stop();
+}
+
+
+
+bool CaptureRecorder::start(const std::string& path) {
+  stop();
+
+  m_File.open(path, std::ios::binary | std::ios::trunc);
+  if (!m_File) {
+    std::cout << "Failed to open " << path << " for recording" << std::endl;
+    return false;
+  }
+
+  m_File.write(Magic, sizeof(Magic));
+
+  m_Path = path;
+  m_Previous.release();
+  m_SinceKeyframe = 0;
+
+  m_Recorded = 0;
+  m_Dropped = 0;
+  m_Bytes = sizeof(Magic);
+
+  m_Stop = false;
+  m_Start = std::chrono::steady_clock::now();
+
+  m_Encoder = std::thread(&CaptureRecorder::encoderLoop, this);
+  m_Recording = true;
+
+  return true;
+}
+
+
+
+void CaptureRecorder::stop() {
+  if (!m_Encoder.joinable()) {
+    return;
+  }
+
+  m_Recording = false;
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stop = true;
+  }
+
+  m_Work.notify_all();
+  m_Encoder.join();
+
+  m_File.close();
+  m_Previous.release();
+}
+
+
+
+void CaptureRecorder::add(const void* data, int width, int height, size_t stride, std::vector<Rect> dirty) {
+  if (!m_Recording || !data || width <= 0 || height <= 0) {
+    return;
+  }
+
+  auto time = std::chrono::steady_clock::now() - m_Start;
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Queue.size() >= MaxQueued) {
+      m_Dropped++;
+      return;
+    }
+  }
+
+  // the capture buffer is reused for the next frame, so copy (and drop the unused alpha) now
+  Frame frame;
+  frame.timeUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(time).count());
+  frame.dirty = std::move(dirty);
+
+  cv::Mat bgra(height, width, CV_8UC4, const_cast<void*>(data), stride);
+  cv::cvtColor(bgra, frame.image, cv::COLOR_BGRA2BGR);
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Queue.push_back(std::move(frame));
+  }
+
+  m_Work.notify_one();
+}
+
+
+
+void CaptureRecorder::encoderLoop() {
+  std::unique_lock<std::mutex> lock(m_Mutex);
+
+  while (true) {
+    m_Work.wait(lock, [this] { return m_Stop || !m_Queue.empty(); });
+
+    // finish what was captured before stopping
+    if (m_Queue.empty()) {
+      break;
+    }
+
+    auto frame = std::move(m_Queue.front());
+    m_Queue.pop_front();
+
+    lock.unlock();
+
+    bool written = write(frame);
+
+    lock.lock();
+
+    if (!written) {
+      std::cout << "Failed to write recording " << m_Path << ", stopped" << std::endl;
+      m_Recording = false;
+      m_Queue.clear();
+    }
+  }
+}
+
+
+
+bool CaptureRecorder::write(Frame& frame) {
+  frame.keyframe = m_Previous.empty() || m_Previous.size() != frame.image.size() || m_SinceKeyframe >= KeyframeInterval;
+
+  std::vector<uchar> payload;
+  const std::vector<int> params = { cv::IMWRITE_PNG_COMPRESSION, PngCompression };
+
+  if (frame.keyframe) {
+    cv::imencode(".png", frame.image, payload, params);
+    m_SinceKeyframe = 0;
+  }
+  else {
+    cv::Mat delta;
+    cv::bitwise_xor(frame.image, m_Previous, delta);
+    cv::imencode(".png", delta, payload, params);
+    m_SinceKeyframe++;
+  }
+
+  m_Previous = std::move(frame.image);
+
+  WriteValue(m_File, frame.timeUs);
+  WriteValue(m_File, static_cast<uint32_t>(m_Previous.cols));
+  WriteValue(m_File, static_cast<uint32_t>(m_Previous.rows));
+  WriteValue(m_File, static_cast<uint8_t>(frame.keyframe ? 0 : 1));
+  WriteValue(m_File, static_cast<uint32_t>(frame.dirty.size()));
+
+  for (const auto& rect : frame.dirty) {
+    WriteValue(m_File, rect);
+  }
+
+  WriteValue(m_File, static_cast<uint32_t>(payload.size()));
+  m_File.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+
+  if (!m_File) {
+    return false;
+  }
+
+  m_Recorded++;
+  m_Bytes += sizeof(uint64_t) + 4 * sizeof(uint32_t) + sizeof(uint8_t) + frame.dirty.size() * sizeof(Rect) + payload.size();
+
+  return true;
+}
+
+
+
+bool CaptureReader::open(const std::string& path) {
+  m_File.close();
+  m_File.clear();
+  m_Previous.release();
+
+  m_File.open(path, std::ios::binary);
+  if (!m_File) {
+    std::cout << "Failed to open recording " << path << std::endl;
+    return false;
+  }
+
+  char magic[sizeof(Magic)] = {};
+  if (!m_File.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), Magic)) {
+    std::cout << path << " is not a capture recording" << std::endl;
+    m_File.close();
+    return false;
+  }
+
+  m_First = m_File.tellg();
+
+  return true;
+}
+
+
+
+bool CaptureReader::next(Frame& frame) {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint8_t type = 0;
+  uint32_t dirtyCount = 0;
+  uint32_t size = 0;
+
+  if (!ReadValue(m_File, frame.timeUs) || !ReadValue(m_File, width) || !ReadValue(m_File, height) ||
+    !ReadValue(m_File, type) || !ReadValue(m_File, dirtyCount)) {
+    return false;
+  }
+
+  if (width == 0 || height == 0 || width > MaxDimension || height > MaxDimension || type > 1 || dirtyCount > MaxDirtyRects) {
+    std::cout << "Corrupt record in capture recording" << std::endl;
+    return false;
+  }
+
+  frame.dirty.resize(dirtyCount);
+  for (auto& rect : frame.dirty) {
+    if (!ReadValue(m_File, rect)) {
+      return false;
+    }
+  }
+
+  if (!ReadValue(m_File, size) || size > MaxPayload) {
+    return false;
+  }
+
+  m_Payload.resize(size);
+  if (!m_File.read(reinterpret_cast<char*>(m_Payload.data()), size)) {
+    return false;
+  }
+
+  auto decoded = cv::imdecode(m_Payload, cv::IMREAD_COLOR);
+  if (decoded.cols != static_cast<int>(width) || decoded.rows != static_cast<int>(height)) {
+    std::cout << "Corrupt record in capture recording" << std::endl;
+    return false;
+  }
+
+  frame.keyframe = type == 0;
+
+  if (frame.keyframe) {
+    frame.image = decoded;
+  }
+  else {
+    if (m_Previous.size() != decoded.size()) {
+      std::cout << "Delta record without a matching previous frame" << std::endl;
+      return false;
+    }
+
+    // a new Mat, the caller may still hold the previous one
+    frame.image = cv::Mat();
+    cv::bitwise_xor(decoded, m_Previous, frame.image);
+  }
+
+  m_Previous = frame.image;
+
+  return true;
+}
+
+
+
+bool CaptureReader::rewind() {
+  if (!m_File.is_open()) {
+    return false;
+  }
+
+  m_File.clear();
+  m_File.seekg(m_First);
+  m_Previous.release();
+
+  return static_cast<bool>(m_File);
+}
\ No newline at end of file
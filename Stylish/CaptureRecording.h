@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+
+//
+// Capture recordings (.strec): the frames the magnifier handed us, with their timestamps and
+// dirty regions, so a session can be replayed through the pipeline away from the desktop.
+//
+// After an 8-byte magic, one record per frame (little-endian):
+//
+//   u64 time     us since the recording started
+//   u32 width, height
+//   u8  type     0 - keyframe, 1 - delta
+//   u32 dirty    rect count, followed by as many i32 left, top, right, bottom
+//   u32 size     payload bytes, followed by the payload
+//
+// Payloads are PNG (fast compression level) of the BGR frame for keyframes, and of the frame XOR'ed
+// with the previous record for deltas: unchanged pixels become zeros, which deflate to next to
+// nothing. A keyframe every KeyframeInterval records (and on size changes) bounds seeking and
+// the damage of a corrupt record.
+//
+namespace CaptureRecording {
+  struct Rect {
+    int32_t left = 0;
+    int32_t top = 0;
+    int32_t right = 0;
+    int32_t bottom = 0;
+  };
+
+  struct Frame {
+    uint64_t timeUs = 0;
+    cv::Mat image;              // 8-bit BGR
+    std::vector<Rect> dirty;
+    bool keyframe = false;
+  };
+}
+
+
+//
+// Writes a recording. Frames are copied on the capture thread and encoded on a worker, the queue
+// between them is bounded and frames arriving while it is full are dropped (and counted), so
+// recording never stalls capture. Dropped frames simply aren't in the file, deltas are always
+// against the previous record.
+//
+class CaptureRecorder {
+public:
+  CaptureRecorder() = default;
+
+  CaptureRecorder(const CaptureRecorder&) = delete;
+  CaptureRecorder(CaptureRecorder&&) = delete;
+
+  CaptureRecorder& operator=(const CaptureRecorder&) = delete;
+  CaptureRecorder& operator=(CaptureRecorder&&) = delete;
+
+  virtual ~CaptureRecorder();
+
+  bool start(const std::string& path);
+  void stop();
+
+  bool isRecording() const { return m_Recording; }
+  const std::string& getPath() const { return m_Path; }
+
+  // 32-bit BGRA, top-down rows of stride bytes
+  void add(const void* data, int width, int height, size_t stride, std::vector<CaptureRecording::Rect> dirty);
+
+  uint64_t getRecorded() const { return m_Recorded; }
+  uint64_t getDropped() const { return m_Dropped; }
+  uint64_t getBytes() const { return m_Bytes; }
+
+private:
+  std::atomic<bool> m_Recording = false;
+  std::string m_Path;
+  std::chrono::steady_clock::time_point m_Start;
+
+  std::thread m_Encoder;
+  std::mutex m_Mutex;
+  std::condition_variable m_Work;
+  std::deque<CaptureRecording::Frame> m_Queue;
+  bool m_Stop = false;
+
+  // encoder thread only
+  std::ofstream m_File;
+  cv::Mat m_Previous;
+  int m_SinceKeyframe = 0;
+
+  std::atomic<uint64_t> m_Recorded = 0;
+  std::atomic<uint64_t> m_Dropped = 0;
+  std::atomic<uint64_t> m_Bytes = 0;
+
+
+  void encoderLoop();
+  bool write(CaptureRecording::Frame& frame);
+};
+
+
+
+//
+// Reads a recording back, one frame at a time in order.
+//
+class CaptureReader {
+public:
+  bool open(const std::string& path);
+
+  // False at the end of the file, or on a corrupt record.
+  // The image stays shared with the reader (the next delta applies to it), treat it as read-only.
+  bool next(CaptureRecording::Frame& frame);
+
+  // Back to the first frame
+  bool rewind();
+
+private:
+  std::ifstream m_File;
+  std::streampos m_First;
+  cv::Mat m_Previous;
+  std::vector<uchar> m_Payload;
+};
\ No newline at end of file
@@ -1,6 +1,10 @@
 ﻿#include "CaptureWindow.h"
 
+#include "CaptureRecording.h"
 #include "Inference.h"
+#include "MemoryAccounting.h"
+#include "PerformanceMetrics.h"
+#include "SpanRecorder.h"
 #include "StyleImageCache.h"
 
 #include <wincodec.h>
@@ -49,6 +53,31 @@ namespace {
 
 
 
+  std::vector<CaptureRecording::Rect> DirtyRects(HRGN dirty) {
+    std::vector<CaptureRecording::Rect> rects;
+
+    DWORD size = dirty ? GetRegionData(dirty, 0, nullptr) : 0;
+    if (size == 0) {
+      return rects;
+    }
+
+    std::vector<char> buffer(size);
+    auto* data = reinterpret_cast<RGNDATA*>(buffer.data());
+
+    if (GetRegionData(dirty, size, data) == 0) {
+      return rects;
+    }
+
+    const auto* rect = reinterpret_cast<const RECT*>(data->Buffer);
+    for (DWORD i = 0; i < data->rdh.nCount; i++) {
+      rects.push_back({ rect[i].left, rect[i].top, rect[i].right, rect[i].bottom });
+    }
+
+    return rects;
+  }
+
+
+
   LRESULT CALLBACK HostWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
     CaptureWindow* captureWindow = (CaptureWindow*)GetWindowLongPtr(hWnd, GWLP_USERDATA);
 
@@ -148,9 +177,11 @@ namespace {
 
 
 
-CaptureWindow::CaptureWindow(HMODULE hInstance, int nCmdShow, Inference* inf, StyleImageCache* styleImgCache)
+CaptureWindow::CaptureWindow(HMODULE hInstance, int nCmdShow, Inference* inf, StyleImageCache* styleImgCache, PerfMetrics* metrics, CaptureRecorder* recorder)
   : m_Inf{ inf }
-  , m_StyleImageCache{ styleImgCache } {
+  , m_StyleImageCache{ styleImgCache }
+  , m_Metrics{ metrics }
+  , m_Recorder{ recorder } {
 
   if (FALSE == MagInitialize()) {
     throw std::runtime_error("Failed to initialize Magnification API!");
@@ -302,6 +333,8 @@ void CaptureWindow::updateFullScreenState(bool bFullScreen) {
 
 
 void CaptureWindow::render() {
+  SpanRecorder::Scope span("CaptureWindow::render");
+
   PAINTSTRUCT ps;
   HDC hdc = BeginPaint(m_HwndHost, &ps);
 
@@ -345,21 +378,51 @@ void CaptureWindow::render() {
     DeleteDC(memDC);
   }
   else {
-    if (m_Capture) {
-      if (m_bCanRunInference) {
-        if (auto* styleImg = const_cast<StyleImageCache::StyleImage*>(m_StyleImageCache->getActiveImage())) {
-          m_Inf->run(m_Capture, styleImg->m_Blob, m_StyleImageCache->getImageSize());
+    if (!m_CaptureData.empty()) {
+      // a repaint without a new capture, the frame is already stylized
+      bool reused = m_CaptureId == m_PresentedId;
+      bool stylized = false;
+
+      if (m_bCanRunInference && !reused) {
+        if (auto* styleBlob = m_StyleImageCache->getStyleBlob()) {
+          FrameView frame{ m_CaptureData.data(), m_CaptureWidth, m_CaptureHeight, m_CaptureStride, PixelFormat::BGRA8 };
+          stylized = m_Inf->run(frame, frame, *styleBlob, m_StyleImageCache->getImageSize());
+        }
+
+      }
+
+      {
+        SpanRecorder::Scope blitSpan("blit");
+
+        // rows are stride apart, so the DIB is as wide as the stride and only the frame is blitted
+        BITMAPINFO bmi = { 0 };
+        bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        bmi.bmiHeader.biWidth = static_cast<LONG>(m_CaptureStride / 4);
+        bmi.bmiHeader.biHeight = -m_CaptureHeight;  // Negative to indicate top-down bitmap
+        bmi.bmiHeader.biPlanes = 1;
+        bmi.bmiHeader.biBitCount = 32;
+        bmi.bmiHeader.biCompression = BI_RGB;
+
+        SetDIBitsToDevice(hdc, 0, 0, m_CaptureWidth, m_CaptureHeight, 0, 0, 0, m_CaptureHeight,
+          m_CaptureData.data(), &bmi, DIB_RGB_COLORS);
+      }
+
+      if (m_Metrics && Instrumentation::isEnabled()) {
+        if (reused) {
+          m_Metrics->collectFrameReused();
         }
+        else {
+          LARGE_INTEGER presentTime;
+          QueryPerformanceCounter(&presentTime);
 
+          float latencyMs = 1000.0f * float(presentTime.QuadPart - m_CaptureTime.QuadPart) / m_Frequency.QuadPart;
+          uint64_t dropped = m_PresentedId ? m_CaptureId - m_PresentedId - 1 : 0;
+
+          m_Metrics->collectFramePresented(latencyMs, dropped, stylized);
+        }
       }
 
-      HDC hdcMemLocal = CreateCompatibleDC(hdc);
-      HGDIOBJ hbmOld = SelectObject(hdcMemLocal, m_Capture);
-      BITMAP bm;
-      GetObject(m_Capture, sizeof(bm), &bm);
-      BitBlt(hdc, 0, 0, bm.bmWidth, bm.bmHeight, hdcMemLocal, 0, 0, SRCCOPY);
-      SelectObject(hdcMemLocal, hbmOld);
-      DeleteDC(hdcMemLocal);
+      m_PresentedId = m_CaptureId;
 
 
       // Calculate FPS
@@ -393,33 +456,29 @@ void CaptureWindow::onCapture(
   RECT unclipped, RECT clipped,
   HRGN dirty) {
 
+  // a new frame enters the pipeline, the spans until the next capture belong to it
+  m_CaptureId++;
+  QueryPerformanceCounter(&m_CaptureTime);
+
+  SpanRecorder::setFrame(m_CaptureId);
+  SpanRecorder::Scope span("CaptureWindow::onCapture");
+
+  Instrumentation::ScopedTimer timer(m_Metrics ? &m_Metrics->captureTime() : nullptr);
+
+  // the magnifier reuses its buffer, so the frame is copied once; from here on it is only viewed
   auto sz = destheader.height * destheader.stride;
   m_CaptureData.resize(sz);
   memcpy(m_CaptureData.data(), destdata, sz);
 
+  m_CaptureWidth = destheader.width;
+  m_CaptureHeight = destheader.height;
+  m_CaptureStride = destheader.stride;
 
-  BITMAPINFO bmi = { 0 };
-  bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-  bmi.bmiHeader.biWidth = destheader.width;
-  bmi.bmiHeader.biHeight = -(LONG)destheader.height;  // Negative to indicate top-down bitmap
-  bmi.bmiHeader.biPlanes = 1;
-  bmi.bmiHeader.biBitCount = 32;
-  bmi.bmiHeader.biCompression = BI_RGB;
-
-  HDC hdc = GetDC(NULL);
-  HDC hdcMem = CreateCompatibleDC(hdc);
-
-  if (m_Capture) {
-    DeleteObject(m_Capture);
+  if (m_Recorder && m_Recorder->isRecording()) {
+    m_Recorder->add(m_CaptureData.data(), destheader.width, destheader.height, destheader.stride, DirtyRects(dirty));
   }
 
-  m_Capture = CreateCompatibleBitmap(hdc, destheader.width, destheader.height);
-  SelectObject(hdcMem, m_Capture);
-
-  SetDIBits(hdcMem, m_Capture, 0, destheader.height, m_CaptureData.data(), &bmi, DIB_RGB_COLORS);
-
-  DeleteDC(hdcMem);
-  ReleaseDC(NULL, hdc);
+  MemoryAccounting::instance().get(MemoryAccounting::Subsystem::Capture).set(m_CaptureData.capacity());
 
   InvalidateRect(m_HwndHost, NULL, FALSE);
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 
@@ -12,13 +13,15 @@
 
 #include <magnification.h>
 
+class CaptureRecorder;
 class Inference;
+class PerfMetrics;
 class StyleImageCache;
 
 
 class CaptureWindow {
 public:
-  CaptureWindow(HMODULE hInstance, int nCmdShow, Inference* inf, StyleImageCache* styleImgCache);
+  CaptureWindow(HMODULE hInstance, int nCmdShow, Inference* inf, StyleImageCache* styleImgCache, PerfMetrics* metrics, CaptureRecorder* recorder);
 
   virtual ~CaptureWindow();
 
@@ -97,10 +100,18 @@ private:
   int m_Frames = 0;
   float m_FPS = 0.0f;
 
-  // Captured image
+  // Captured image (BGRA, top-down), stylized in place and blitted straight from here
   
-  HBITMAP m_Capture = NULL;
   std::vector<unsigned char> m_CaptureData;
+  int m_CaptureWidth = 0;
+  int m_CaptureHeight = 0;
+  size_t m_CaptureStride = 0;
+
+  // Frame identity: the frame is stylized in place, so its id and capture time stay valid through inference
+
+  uint64_t m_CaptureId = 0;             // monotonic, 0 - nothing captured yet
+  LARGE_INTEGER m_CaptureTime = {};
+  uint64_t m_PresentedId = 0;           // last frame blitted
 
   // Invisible mode
   bool m_bInvisibleMode = false;
@@ -111,6 +122,8 @@ private:
 
   Inference* m_Inf;
   StyleImageCache* m_StyleImageCache;
+  PerfMetrics* m_Metrics;
+  CaptureRecorder* m_Recorder;
 
 
   BOOL SetupMagnifier(HINSTANCE hInst);
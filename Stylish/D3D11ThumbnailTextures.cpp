@@ -0,0 +1,96 @@
+#include "D3D11ThumbnailTextures.h"
+
+#include <algorithm>
+#include <iostream>
+
+
+
+D3D11ThumbnailTextures::D3D11ThumbnailTextures(ID3D11Device* device, ID3D11DeviceContext* context)
+  : m_Device(device), m_Context(context) {
+}
+
+
+
+D3D11ThumbnailTextures::~D3D11ThumbnailTextures() {
+  while (!m_Pages.empty()) {
+    releasePage(m_Pages.back().view);
+  }
+}
+
+
+
+void* D3D11ThumbnailTextures::createPage(int size) {
+  D3D11_TEXTURE2D_DESC desc;
+  ZeroMemory(&desc, sizeof(desc));
+  desc.Width = size;
+  desc.Height = size;
+  desc.MipLevels = 1;
+  desc.ArraySize = 1;
+  desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+  desc.SampleDesc.Count = 1;
+  desc.Usage = D3D11_USAGE_DEFAULT;
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  desc.CPUAccessFlags = 0;
+
+  // cleared, the padding between thumbnails gets sampled at their edges
+  std::vector<unsigned char> blank(static_cast<size_t>(size) * size * 4);
+
+  D3D11_SUBRESOURCE_DATA subResource;
+  subResource.pSysMem = blank.data();
+  subResource.SysMemPitch = size * 4;
+  subResource.SysMemSlicePitch = 0;
+
+  Page page;
+
+  HRESULT hr = m_Device->CreateTexture2D(&desc, &subResource, &page.texture);
+  if (SUCCEEDED(hr)) {
+    hr = m_Device->CreateShaderResourceView(page.texture, nullptr, &page.view);
+  }
+
+  if (FAILED(hr)) {
+    std::cout << "Failed to create thumbnail atlas page" << std::endl;
+
+    if (page.texture) {
+      page.texture->Release();
+    }
+
+    return nullptr;
+  }
+
+  m_Pages.push_back(page);
+
+  return page.view;
+}
+
+
+
+void D3D11ThumbnailTextures::update(void* page, int x, int y, const cv::Mat& pixels) {
+  auto it = std::find_if(m_Pages.begin(), m_Pages.end(), [page](const Page& p) { return p.view == page; });
+  if (it == m_Pages.end()) {
+    return;
+  }
+
+  D3D11_BOX box;
+  box.left = x;
+  box.top = y;
+  box.front = 0;
+  box.right = x + pixels.cols;
+  box.bottom = y + pixels.rows;
+  box.back = 1;
+
+  m_Context->UpdateSubresource(it->texture, 0, &box, pixels.data, static_cast<UINT>(pixels.step), 0);
+}
+
+
+
+void D3D11ThumbnailTextures::releasePage(void* page) {
+  auto it = std::find_if(m_Pages.begin(), m_Pages.end(), [page](const Page& p) { return p.view == page; });
+  if (it == m_Pages.end()) {
+    return;
+  }
+
+  it->view->Release();
+  it->texture->Release();
+
+  m_Pages.erase(it);
+}
\ No newline at end of file
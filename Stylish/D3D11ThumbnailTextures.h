@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ThumbnailTextures.h"
+
+#include <vector>
+
+#include <d3d11.h>
+
+
+// Atlas pages as D3D11 textures, identified by their shader resource views
+class D3D11ThumbnailTextures : public ThumbnailTextures {
+public:
+  D3D11ThumbnailTextures(ID3D11Device* device, ID3D11DeviceContext* context);
+
+  D3D11ThumbnailTextures(const D3D11ThumbnailTextures&) = delete;
+  D3D11ThumbnailTextures(D3D11ThumbnailTextures&&) = delete;
+
+  D3D11ThumbnailTextures& operator=(const D3D11ThumbnailTextures&) = delete;
+  D3D11ThumbnailTextures& operator=(D3D11ThumbnailTextures&&) = delete;
+
+  virtual ~D3D11ThumbnailTextures();
+
+  void* createPage(int size) override;
+  void update(void* page, int x, int y, const cv::Mat& pixels) override;
+  void releasePage(void* page) override;
+
+private:
+  ID3D11Device* m_Device;
+  ID3D11DeviceContext* m_Context;
+
+  struct Page {
+    ID3D11Texture2D* texture = nullptr;
+    ID3D11ShaderResourceView* view = nullptr;
+  };
+
+  std::vector<Page> m_Pages;
+};
\ No newline at end of file
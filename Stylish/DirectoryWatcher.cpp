@@ -0,0 +1,290 @@
+#include "DirectoryWatcher.h"
+
+#include <iostream>
+#include <set>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+  // How long the folder must be quiet before changes are reported
+  const int SettleMs = 250;
+
+  const int PollIntervalMs = 2000;
+
+
+  // Changes whenever a file is added, removed, resized or rewritten
+  size_t FolderSignature(const fs::path& folder) {
+    size_t signature = 0;
+    std::error_code ec;
+
+    for (const auto& entry : fs::directory_iterator(folder, ec)) {
+      auto name = std::hash<std::string>{}(entry.path().filename().u8string());
+      auto mtime = static_cast<size_t>(entry.last_write_time(ec).time_since_epoch().count());
+      auto size = static_cast<size_t>(entry.is_regular_file(ec) ? entry.file_size(ec) : 0);
+
+      // order independent
+      signature += name ^ (mtime * 31) ^ (size * 131);
+    }
+
+    return signature;
+  }
+
+
+
+  // Names of the files changed in a burst of events, all of the folder if unknown
+  struct Changes {
+    std::set<std::string> names;
+    bool everything = false;
+
+    bool empty() const {
+      return names.empty() && !everything;
+    }
+
+    std::vector<std::string> take() {
+      std::vector<std::string> changed;
+      if (!everything) {
+        changed.assign(names.begin(), names.end());
+      }
+
+      names.clear();
+      everything = false;
+      return changed;
+    }
+  };
+}
+
+
+
+DirectoryWatcher::DirectoryWatcher(const fs::path& folder, ChangeHandler onChange) : m_Folder{ folder }, m_OnChange{ std::move(onChange) } {
+  // without a way to stop it, the thread could never be joined
+#ifdef _WIN32
+  m_StopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+  bool stoppable = m_StopEvent != nullptr;
+#else
+  bool stoppable = pipe(m_StopPipe) == 0;
+  if (!stoppable) {
+    m_StopPipe[0] = m_StopPipe[1] = -1;
+  }
+#endif
+
+  if (!stoppable) {
+    std::cout << "Not watching " << m_Folder.string() << " for changes" << std::endl;
+    return;
+  }
+
+  m_Thread = std::thread(&DirectoryWatcher::watch, this);
+}
+
+
+
+DirectoryWatcher::~DirectoryWatcher() {
+  if (m_Thread.joinable()) {
+#ifdef _WIN32
+    SetEvent(m_StopEvent);
+#else
+    char c = 0;
+    (void)!write(m_StopPipe[1], &c, 1);
+#endif
+
+    m_Thread.join();
+  }
+
+#ifdef _WIN32
+  if (m_StopEvent) {
+    CloseHandle(m_StopEvent);
+  }
+#else
+  for (int fd : m_StopPipe) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+#endif
+}
+
+
+
+void DirectoryWatcher::watch() {
+#ifdef _WIN32
+  HANDLE dir = CreateFileW(m_Folder.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+    nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+
+  if (dir == INVALID_HANDLE_VALUE) {
+    poll();
+    return;
+  }
+
+  OVERLAPPED overlapped = {};
+  overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+  alignas(DWORD) char buffer[16 * 1024];
+
+  const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+
+  bool reading = false;
+  bool failed = false;
+  Changes changes;
+
+  while (true) {
+    if (!reading) {
+      ResetEvent(overlapped.hEvent);
+
+      if (!ReadDirectoryChangesW(dir, buffer, sizeof(buffer), FALSE, filter, nullptr, &overlapped, nullptr)) {
+        failed = true;
+        break;
+      }
+
+      reading = true;
+    }
+
+    HANDLE handles[] = { m_StopEvent, overlapped.hEvent };
+    DWORD wait = WaitForMultipleObjects(2, handles, FALSE, changes.empty() ? INFINITE : SettleMs);
+
+    if (wait == WAIT_OBJECT_0) {
+      break;
+    }
+
+    if (wait == WAIT_TIMEOUT) {
+      m_OnChange(changes.take());
+      continue;
+    }
+
+    if (wait != WAIT_OBJECT_0 + 1) {
+      failed = true;
+      break;
+    }
+
+    // zero bytes means the buffer overflowed, the names are lost
+    DWORD bytes = 0;
+    GetOverlappedResult(dir, &overlapped, &bytes, FALSE);
+
+    reading = false;
+
+    if (bytes == 0) {
+      changes.everything = true;
+      continue;
+    }
+
+    for (DWORD offset = 0;;) {
+      auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer + offset);
+      changes.names.insert(fs::path(std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR))).u8string());
+
+      if (info->NextEntryOffset == 0) {
+        break;
+      }
+
+      offset += info->NextEntryOffset;
+    }
+  }
+
+  if (reading) {
+    DWORD bytes = 0;
+    CancelIoEx(dir, &overlapped);
+    GetOverlappedResult(dir, &overlapped, &bytes, TRUE);
+  }
+
+  CloseHandle(overlapped.hEvent);
+  CloseHandle(dir);
+
+  if (failed) {
+    poll();
+  }
+#else
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB;
+
+  if (fd < 0 || inotify_add_watch(fd, m_Folder.c_str(), mask) < 0) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+
+    poll();
+    return;
+  }
+
+  Changes changes;
+
+  while (true) {
+    pollfd fds[2] = { { m_StopPipe[0], POLLIN, 0 }, { fd, POLLIN, 0 } };
+    int ready = ::poll(fds, 2, changes.empty() ? -1 : SettleMs);
+
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+
+    if (ready < 0 || (fds[0].revents & POLLIN)) {
+      break;
+    }
+
+    if (ready == 0) {
+      m_OnChange(changes.take());
+      continue;
+    }
+
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length = 0;
+
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+      for (ssize_t offset = 0; offset < length;) {
+        const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+
+        // the queue overflowed, the names are lost
+        if (event->mask & IN_Q_OVERFLOW) {
+          changes.everything = true;
+        }
+        else if (event->len > 0) {
+          changes.names.insert(event->name);
+        }
+
+        offset += sizeof(inotify_event) + event->len;
+      }
+    }
+  }
+
+  ::close(fd);
+#endif
+}
+
+
+
+void DirectoryWatcher::poll() {
+  std::cout << "Watching " << m_Folder.string() << " by polling" << std::endl;
+
+  m_Polling = true;
+
+  auto signature = FolderSignature(m_Folder);
+
+  while (!waitForStop(PollIntervalMs)) {
+    auto current = FolderSignature(m_Folder);
+
+    if (current != signature) {
+      signature = current;
+      m_OnChange({});
+    }
+  }
+}
+
+
+
+bool DirectoryWatcher::waitForStop(int ms) {
+#ifdef _WIN32
+  return WaitForSingleObject(m_StopEvent, ms) == WAIT_OBJECT_0;
+#else
+  pollfd fds = { m_StopPipe[0], POLLIN, 0 };
+  return ::poll(&fds, 1, ms) > 0;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//
+// Calls onChange (from its own thread) whenever files in a folder are created, modified, renamed
+// or deleted, with the names (UTF-8) of those files. Bursts of events (e.g. a file being copied
+// in) are coalesced until the folder has been quiet for a moment.
+//
+// Uses ReadDirectoryChangesW on Windows and inotify on Linux, and falls back to polling the
+// folder listing if those are unavailable (e.g. some network shares). When the names are not
+// known (polling, or the event queue overflowed) onChange gets none: rescan the whole folder.
+//
+// If the watcher can't be set up at all nothing is reported.
+//
+class DirectoryWatcher {
+public:
+  using ChangeHandler = std::function<void(const std::vector<std::string>& changed)>;
+
+  DirectoryWatcher(const std::filesystem::path& folder, ChangeHandler onChange);
+
+  DirectoryWatcher(const DirectoryWatcher&) = delete;
+  DirectoryWatcher(DirectoryWatcher&&) = delete;
+
+  DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+  DirectoryWatcher& operator=(DirectoryWatcher&&) = delete;
+
+  virtual ~DirectoryWatcher();
+
+  bool isPolling() const { return m_Polling; }
+
+private:
+  std::filesystem::path m_Folder;
+  ChangeHandler m_OnChange;
+
+  std::atomic<bool> m_Polling = false;
+
+#ifdef _WIN32
+  void* m_StopEvent = nullptr; // HANDLE
+#else
+  int m_StopPipe[2] = { -1, -1 };
+#endif
+
+  std::thread m_Thread;
+
+
+  void watch();
+  void poll();
+
+  // Returns true if the watcher is being stopped
+  bool waitForStop(int ms);
+};
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+enum class PixelFormat {
+  BGR8 = 0,
+  BGRA8
+};
+
+
+
+inline int BytesPerPixel(PixelFormat format) {
+  return format == PixelFormat::BGRA8 ? 4 : 3;
+}
+
+
+
+//
+// Non-owning view of an 8-bit frame: rows are stride bytes apart (stride >= width * bytes per
+// pixel), so a view can cover a capture buffer, a mapped texture or a sub-rect of either.
+// The pipeline reads and writes through views, whoever owns the pixels keeps them alive.
+//
+struct FrameView {
+  uint8_t* data = nullptr;
+  int width = 0;
+  int height = 0;
+  size_t stride = 0;
+  PixelFormat format = PixelFormat::BGRA8;
+
+  bool isValid() const {
+    return data && width > 0 && height > 0 && stride >= static_cast<size_t>(width) * BytesPerPixel(format);
+  }
+};
+
+
+
+struct ConstFrameView {
+  const uint8_t* data = nullptr;
+  int width = 0;
+  int height = 0;
+  size_t stride = 0;
+  PixelFormat format = PixelFormat::BGRA8;
+
+  ConstFrameView() = default;
+
+  ConstFrameView(const uint8_t* data, int width, int height, size_t stride, PixelFormat format)
+    : data(data), width(width), height(height), stride(stride), format(format) {}
+
+  ConstFrameView(const FrameView& view)
+    : data(view.data), width(view.width), height(view.height), stride(view.stride), format(view.format) {}
+
+  bool isValid() const {
+    return data && width > 0 && height > 0 && stride >= static_cast<size_t>(width) * BytesPerPixel(format);
+  }
+};
\ No newline at end of file
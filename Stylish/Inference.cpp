@@ -1,9 +1,18 @@
 #include "Inference.h"
 
+#include "MemoryAccounting.h"
+#include "ModelInitializers.h"
+#include "Pipeline.h"
+#include "SpanRecorder.h"
+
 #include <algorithm>
 #include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <thread>
 
 #include <opencv2/core/hal/interface.h>
 #include <opencv2/imgproc.hpp>
@@ -11,100 +20,65 @@
 
 
 namespace {
-  cv::Mat HBITMAPToMat(HBITMAP hBitmap) {
-    BITMAP bmp;
-    GetObject(hBitmap, sizeof(BITMAP), &bmp);
-
-    int nChannels = bmp.bmBitsPixel / 8;
-    int depth = (nChannels == 3) ? CV_8UC3 : CV_8UC4;
-
-    cv::Mat mat(bmp.bmHeight, bmp.bmWidth, depth);
-
-    BITMAPINFOHEADER bi;
-    bi.biSize = sizeof(BITMAPINFOHEADER);
-    bi.biWidth = bmp.bmWidth;
-    bi.biHeight = -bmp.bmHeight; // top-down
-    bi.biPlanes = 1;
-    bi.biBitCount = bmp.bmBitsPixel;
-    bi.biCompression = BI_RGB;
-    bi.biSizeImage = 0;
-    bi.biXPelsPerMeter = 0;
-    bi.biYPelsPerMeter = 0;
-    bi.biClrUsed = 0;
-    bi.biClrImportant = 0;
-
-    HDC hdc = GetDC(NULL);
-    HDC hMemDC = CreateCompatibleDC(hdc);
-    HGDIOBJ oldObj = SelectObject(hMemDC, hBitmap);
-
-    GetDIBits(hMemDC, hBitmap, 0, bmp.bmHeight, mat.data, (BITMAPINFO*)&bi, DIB_RGB_COLORS);
-
-    if (depth == CV_8UC4) {
-      cv::Mat matRGB;
-      cv::cvtColor(mat, matRGB, cv::COLOR_RGBA2RGB);
-      mat = matRGB;
-    }
+  const std::filesystem::path ModelPath = std::filesystem::path("models") / "arbitrary-image-stylization.onnx";
+  const std::filesystem::path ManifestPath = std::filesystem::path("models") / "ladder.txt";
+
+  // Warm-up input, the first run of a session pays for allocations and kernel selection
+  const int WarmUpSize = 256;
 
-    SelectObject(hMemDC, oldObj);
-    DeleteDC(hMemDC);
-    ReleaseDC(NULL, hdc);
 
-    //cv::imwrite("test.jpg", mat);
+  bool IsEnvFlagSet(const char* name) {
+#ifdef _WIN32
+    char* value = nullptr;
+    size_t len = 0;
+
+    if (_dupenv_s(&value, &len, name) != 0 || !value) {
+      return false;
+    }
+
+    bool set = value[0] != '\0' && value[0] != '0';
+    free(value);
 
-    return mat;
+    return set;
+#else
+    const char* value = std::getenv(name);
+    return value && value[0] != '\0' && value[0] != '0';
+#endif
   }
 
 
-  void MatToHBITMAP(const cv::Mat& mat, HBITMAP& hBitmap) {
-    if (mat.empty()) {
-      std::cout << "Input image is empty" << std::endl;
-      return;
-    }
+  // Header over the view's pixels, no copy
+  cv::Mat ViewToMat(const FrameView& view) {
+    return cv::Mat(view.height, view.width, view.format == PixelFormat::BGRA8 ? CV_8UC4 : CV_8UC3, view.data, view.stride);
+  }
 
-    int nChannels = mat.channels();
-    int depth = (nChannels == 3) ? CV_8UC3 : CV_8UC4;
-    if (depth != CV_8UC3 && depth != CV_8UC4) {
-      std::cout << "Unsupported image format. Only 3-channel (RGB) and 4-channel (RGBA) images are supported." << std::endl;
-      return;
-    }
 
-    cv::Mat matRGBA;
-    if (depth == CV_8UC3) {
-      cv::cvtColor(mat, matRGBA, cv::COLOR_RGB2RGBA);
-    }
-    else {
-      matRGBA = mat;
-    }
 
-    BITMAPINFOHEADER bi;
-    bi.biSize = sizeof(BITMAPINFOHEADER);
-    bi.biWidth = matRGBA.size().width;
-    bi.biHeight = -matRGBA.size().height; // Negative to indicate a top-down DIB
-    bi.biPlanes = 1;
-    bi.biBitCount = 32;
-    bi.biCompression = BI_RGB;
-    bi.biSizeImage = 0;
-    bi.biXPelsPerMeter = 0;
-    bi.biYPelsPerMeter = 0;
-    bi.biClrUsed = 0;
-    bi.biClrImportant = 0;
-
-    HDC hdc = GetDC(NULL);
-
-    if (hBitmap) {
-      DeleteObject(hBitmap);
-    }
+  cv::Mat ViewToMat(const ConstFrameView& view) {
+    return cv::Mat(view.height, view.width, view.format == PixelFormat::BGRA8 ? CV_8UC4 : CV_8UC3, const_cast<uint8_t*>(view.data), view.stride);
+  }
+
 
-    hBitmap = CreateCompatibleBitmap(hdc, matRGBA.size().width, matRGBA.size().height);
-    HDC hMemDC = CreateCompatibleDC(hdc);
-    HGDIOBJ oldObj = SelectObject(hMemDC, hBitmap);
+#if ORT_API_VERSION >= 23
+  // Adds an allocator's bytes in use and peak, if the session has one for the device and it keeps stats (arenas do)
+  void ReadAllocatorStats(Ort::Session& session, const Ort::MemoryInfo& info, size_t& inUse, size_t& peak) {
+    try {
+      Ort::Allocator allocator(session, info);
+      auto stats = allocator.GetStats();
 
-    SetDIBits(hMemDC, hBitmap, 0, matRGBA.size().height, matRGBA.data, (BITMAPINFO*)&bi, DIB_RGB_COLORS);
+      if (const char* value = stats.GetValue("InUse")) {
+        inUse += std::strtoull(value, nullptr, 10);
+      }
 
-    SelectObject(hMemDC, oldObj);
-    DeleteDC(hMemDC);
-    ReleaseDC(NULL, hdc);
+      if (const char* value = stats.GetValue("MaxInUse")) {
+        peak += std::strtoull(value, nullptr, 10);
+      }
+    }
+    catch (const Ort::Exception&) {
+      // no such allocator, or no stats
+    }
   }
+#endif
 }
 
 
@@ -116,73 +90,46 @@ Inference::Inference(PerfMetrics* metrics) : m_Metrics{ metrics } {
     auto providers = Ort::GetAvailableProviders();
     std::cout << "--- Available ONNX Providers:" << std::endl;
 
-    bool cudaReady = false;
-    bool tensorrtReady = false;
-
     for (auto provider : providers) {
       std::cout << provider << std::endl;
       std::transform(provider.begin(), provider.end(), provider.begin(), [](unsigned char c) { return std::tolower(c); });
 
       if (provider.find("cuda") != std::string::npos) {
-        cudaReady = true;
+        m_CudaReady = true;
       }
       else if (provider.find("tensorrt") != std::string::npos) {
-        tensorrtReady = true;
+        m_TensorRTReady = true;
       }
     }
 
     std::cout << "------------------------------" << std::endl;
 
+    m_TensorRTReady = false; // todo figure out options before enabling
 
-    m_Env = std::make_unique<Ort::Env>(OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR, "Default");
-
-    const wchar_t* modelPath = L"models\\arbitrary-image-stylization.onnx";
-
-    // TODO eager or lazy?
 
-    // CPU
-
-    m_SessionOptionsCPU.SetInterOpNumThreads(4);
-    m_SessionOptionsCPU.SetIntraOpNumThreads(4);
-    // Optimization will take time and memory during startup
-    //m_SessionOptionsCPU.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
-    m_SessionOptionsCPU.EnableCpuMemArena();
-    m_SessionOptionsCPU.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
-
-    m_SessionCPU = std::make_unique<Ort::Session>(*m_Env, modelPath, m_SessionOptionsCPU);
-
-    tensorrtReady = false; // todo figure out options before enabling
+    m_Env = std::make_unique<Ort::Env>(OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR, "Default");
 
-    // GPU
-    try {
-      if (tensorrtReady || cudaReady) {
-        m_SessionOptionsGPU.SetInterOpNumThreads(4);
-        m_SessionOptionsGPU.SetIntraOpNumThreads(4);
-        m_SessionOptionsGPU.EnableCpuMemArena();
-        m_SessionOptionsGPU.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
-
-        if (tensorrtReady) {
-          OrtTensorRTProviderOptions opt{ 0 }; // crashes if not zeroing out
-          opt.device_id = 0;
-          m_SessionOptionsGPU.AppendExecutionProvider_TensorRT(opt);
-        }
-        else if (cudaReady)
-        {
-          OrtCUDAProviderOptions m_CudaOptions;
-          m_CudaOptions.device_id = 0;
-          m_CudaOptions.cudnn_conv_algo_search = OrtCudnnConvAlgoSearchExhaustive;
-          m_CudaOptions.arena_extend_strategy = 0;
-          m_CudaOptions.do_copy_in_default_stream = 0;
-          m_SessionOptionsGPU.AppendExecutionProvider_CUDA(m_CudaOptions);
-        }
+    // All sessions allocate from one CPU arena registered with the environment
+    auto envMemoryInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+    Ort::ArenaCfg arenaCfg(0, -1, -1, -1);
+    m_Env->CreateAndRegisterAllocator(envMemoryInfo, arenaCfg);
 
-        m_SessionGPU = std::make_unique<Ort::Session>(*m_Env, modelPath, m_SessionOptionsGPU);
+    // Model ladder, or just the one model without a manifest
+    ModelManifest manifest;
+    if (manifest.load(ManifestPath)) {
+      for (const auto& entry : manifest.getEntries()) {
+        m_Tiers.push_back(std::make_unique<ModelTier>(ModelTier{ entry.name, entry.path, nullptr }));
       }
-    } catch (Ort::Exception& oe) {
-      std::cout << "ONNX exception caught: " << oe.what() << ". Code: " << oe.GetOrtErrorCode() << ".\n\n";
-      std::cout << "Failed to configure GPU Providers: GPU options will be disabled.\n";
+    }
+    else {
+      m_Tiers.push_back(std::make_unique<ModelTier>(ModelTier{ "full", ModelPath, nullptr }));
     }
 
+    // start with the heaviest model, autotune steps down if it is too slow
+    m_ModelTier = static_cast<int>(m_Tiers.size()) - 1;
+    m_RequestedModelTier = m_ModelTier.load();
+
+    createSessions(m_IntraOpThreads, m_InterOpThreads, m_SessionPoolSize);
 
     m_MemoryInfo = std::move(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault));
 
@@ -192,21 +139,21 @@ Inference::Inference(PerfMetrics* metrics) : m_Metrics{ metrics } {
 
     Ort::AllocatorWithDefaultOptions allocator;
 
-    auto numInputNodes = m_SessionCPU->GetInputCount();
+    auto numInputNodes = activeSessions().sessionsCPU->front().GetInputCount();
 
     for (int i = 0; i < numInputNodes; i++) {
-      auto name = m_SessionCPU->GetInputNameAllocated(i, allocator);
+      auto name = activeSessions().sessionsCPU->front().GetInputNameAllocated(i, allocator);
       auto* namePtr = name.get();
       auto sz = strlen(namePtr) + 1;
 
       char* tempstr = new char[sz];
-      strcpy_s(tempstr, sz, namePtr);
+      memcpy(tempstr, namePtr, sz);
 
       m_InputNodeNames.push_back(tempstr);
 
       printf("Input %d : name=%s\n", i, m_InputNodeNames.back());
 
-      auto typeInfo = m_SessionCPU->GetInputTypeInfo(i);
+      auto typeInfo = activeSessions().sessionsCPU->front().GetInputTypeInfo(i);
       auto tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
       m_InputNodeDims.push_back(tensorInfo.GetShape());
 
@@ -226,15 +173,15 @@ Inference::Inference(PerfMetrics* metrics) : m_Metrics{ metrics } {
 
     std::cout << "--- Output shape: " << std::endl;
 
-    auto numOutputNodes = m_SessionCPU->GetOutputCount();
+    auto numOutputNodes = activeSessions().sessionsCPU->front().GetOutputCount();
 
     for (int i = 0; i < numOutputNodes; i++) {
-      auto name = m_SessionCPU->GetOutputNameAllocated(i, allocator);
+      auto name = activeSessions().sessionsCPU->front().GetOutputNameAllocated(i, allocator);
       auto* namePtr = name.get();
       auto sz = strlen(namePtr) + 1;
 
       char* tempstr = new char[sz];
-      strcpy_s(tempstr, sz, namePtr);
+      memcpy(tempstr, namePtr, sz);
 
       m_OutputNodeNames.push_back(tempstr);
 
@@ -243,6 +190,9 @@ Inference::Inference(PerfMetrics* metrics) : m_Metrics{ metrics } {
 
     std::cout << "------------------------------" << std::endl;
 
+    // warm the neighbouring tiers in the background
+    m_Warmer = std::thread(&Inference::warmTiers, this);
+
 
     auto endTime = std::chrono::high_resolution_clock::now();
     if (m_Metrics) {
@@ -256,55 +206,536 @@ Inference::Inference(PerfMetrics* metrics) : m_Metrics{ metrics } {
 }
 
 
-void Inference::run(HBITMAP& inputImage, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize) {
-  if (!m_Enabled) {
+
+Inference::~Inference() {
+  {
+    std::lock_guard<std::mutex> lock(m_WarmMutex);
+    m_WarmStop = true;
+  }
+
+  m_WarmWork.notify_all();
+
+  if (m_Warmer.joinable()) {
+    m_Warmer.join();
+  }
+}
+
+
+
+void Inference::createSessions(int intraOpThreads, int interOpThreads, int poolSize) {
+  // Only the active tier is built right away, the warmer rebuilds its neighbours
+  int tier = m_ModelTier;
+  auto sessions = createTierSessions(*m_Tiers[tier], intraOpThreads, interOpThreads, poolSize);
+
+  installSessions(tier, sessions, intraOpThreads, interOpThreads, poolSize);
+}
+
+
+
+bool Inference::rebuildSessions(int intraOpThreads, int interOpThreads, int poolSize) {
+  int tier = 0;
+
+  {
+    std::shared_lock<std::shared_mutex> lock(m_SessionsMutex);
+
+    if (intraOpThreads == m_IntraOpThreads && interOpThreads == m_InterOpThreads && poolSize == m_SessionPoolSize) {
+      return true;
+    }
+
+    tier = m_ModelTier;
+  }
+
+  Provider provider = m_Provider;
+  std::shared_ptr<TierSessions> sessions;
+
+  try {
+    sessions = createTierSessions(*m_Tiers[tier], intraOpThreads, interOpThreads, poolSize);
+  } catch (std::exception& e) {
+    std::cout << "Failed to recreate sessions with " << intraOpThreads << "/" << interOpThreads << " threads and a pool of "
+      << poolSize << ", keeping the current ones: " << e.what() << std::endl;
+    return false;
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> lock(m_SessionsMutex);
+    installSessions(tier, sessions, intraOpThreads, interOpThreads, poolSize);
+  }
+
+  setProvider(provider);
+
+  return true;
+}
+
+
+
+void Inference::installSessions(int tier, std::shared_ptr<TierSessions> sessions, int intraOpThreads, int interOpThreads, int poolSize) {
+  m_IntraOpThreads = intraOpThreads;
+  m_InterOpThreads = interOpThreads;
+  m_SessionPoolSize = poolSize;
+
+  m_SessionsGeneration++;
+
+  for (auto& t : m_Tiers) {
+    t->sessions.reset();
+  }
+
+  // a tier switch meanwhile is dropped, these are the sessions there are
+  m_ModelTier = tier;
+  m_RequestedModelTier = tier;
+
+  m_Tiers[tier]->sessions = sessions;
+
+  m_GPUReady = sessions->sessionsGPU != nullptr;
+
+  if (!m_GPUReady) {
+    m_Provider = Provider::CPU;
+  }
+
+  collectSessionMemory();
+
+  requestWarming();
+}
+
+
+
+std::shared_ptr<Inference::TierSessions> Inference::createTierSessions(const ModelTier& tier, int intraOpThreads, int interOpThreads, int poolSize,
+  std::optional<Provider> only) const {
+  auto sessions = std::make_shared<TierSessions>();
+
+  // All sessions of a model read the same copy of the weights, straight from the mapped model where possible
+  // STYLISH_LARGE_PAGES=1 backs the model with large pages (needs the "Lock pages in memory" privilege)
+  if (!sessions->model.open(tier.path, IsEnvFlagSet("STYLISH_LARGE_PAGES"))) {
+    throw std::runtime_error("Failed to map model " + tier.path.string() + "!");
+  }
+
+  sessions->initializers = std::make_unique<ModelInitializers>(sessions->model.data(), sessions->model.size(), true);
+
+  // their size (and how much of it was copied) shows in the metrics panel, see collectSessionMemory()
+  const auto& initializers = *sessions->initializers;
+
+  // CPU
+
+  auto& optionsCPU = sessions->optionsCPU;
+  optionsCPU.SetInterOpNumThreads(interOpThreads);
+  optionsCPU.SetIntraOpNumThreads(intraOpThreads);
+  // Optimization will take time and memory during startup
+  //optionsCPU.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+  optionsCPU.EnableCpuMemArena();
+  optionsCPU.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+  optionsCPU.AddConfigEntry("session.use_env_allocators", "1");
+  initializers.addTo(optionsCPU);
+
+  if (!only || *only == Provider::CPU) {
+    sessions->sessionsCPU = std::make_unique<SessionPool>(*m_Env, sessions->model.data(), sessions->model.size(), optionsCPU, poolSize, sessions->prepackedWeights);
+  }
+
+  // GPU
+  try {
+    if ((m_TensorRTReady || m_CudaReady) && (!only || *only == Provider::GPU)) {
+      auto& optionsGPU = sessions->optionsGPU;
+      optionsGPU.SetInterOpNumThreads(interOpThreads);
+      optionsGPU.SetIntraOpNumThreads(intraOpThreads);
+      optionsGPU.EnableCpuMemArena();
+      optionsGPU.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+      optionsGPU.AddConfigEntry("session.use_env_allocators", "1");
+      initializers.addTo(optionsGPU);
+
+      if (m_TensorRTReady) {
+        OrtTensorRTProviderOptions opt{ 0 }; // crashes if not zeroing out
+        opt.device_id = 0;
+        optionsGPU.AppendExecutionProvider_TensorRT(opt);
+      }
+      else if (m_CudaReady)
+      {
+        OrtCUDAProviderOptions m_CudaOptions;
+        m_CudaOptions.device_id = 0;
+        m_CudaOptions.cudnn_conv_algo_search = OrtCudnnConvAlgoSearchExhaustive;
+        m_CudaOptions.arena_extend_strategy = 0;
+        m_CudaOptions.do_copy_in_default_stream = 0;
+        optionsGPU.AppendExecutionProvider_CUDA(m_CudaOptions);
+      }
+
+      sessions->sessionsGPU = std::make_unique<SessionPool>(*m_Env, sessions->model.data(), sessions->model.size(), optionsGPU, poolSize, sessions->prepackedWeights);
+    }
+  } catch (Ort::Exception& oe) {
+    std::cout << "ONNX exception caught: " << oe.what() << ". Code: " << oe.GetOrtErrorCode() << ".\n\n";
+    std::cout << "Failed to configure GPU Providers: GPU options will be disabled.\n";
+  }
+
+  return sessions;
+}
+
+
+
+void Inference::collectSessionMemory() {
+  if (!m_Metrics) {
     return;
   }
 
+  // Memory: what the sessions cost vs. what they would without sharing (every session paying like the first one)
+
+  PerfMetrics::SessionMemory mem;
+
+  for (const auto& tier : m_Tiers) {
+    if (!tier->sessions) {
+      continue;
+    }
+
+    auto shared = tier->sessions->initializers->getBytes();
+    mem.sharedInitializers += shared;
+    mem.copiedInitializers += tier->sessions->initializers->getCopiedBytes();
+
+    for (auto* pool : { tier->sessions->sessionsCPU.get(), tier->sessions->sessionsGPU.get() }) {
+      if (!pool) {
+        continue;
+      }
+
+      const auto& bytes = pool->getSessionBytes();
+
+      mem.sessions += pool->size();
+      for (auto b : bytes) {
+        mem.bytes += b;
+      }
+
+      if (!bytes.empty()) {
+        mem.unsharedEstimate += (bytes.front() + shared) * bytes.size();
+      }
+    }
+  }
+
+  m_Metrics->collectSessionMemory(mem);
+}
+
+
+
+void Inference::collectAllocatorStats() {
+#if ORT_API_VERSION >= 23
+  auto now = std::chrono::steady_clock::now();
+  if (now - m_AllocatorStatsTime < std::chrono::seconds(1)) {
+    return;
+  }
+
+  m_AllocatorStatsTime = now;
+
+  size_t cpuInUse = 0, cpuPeak = 0;
+  size_t gpuInUse = 0, gpuPeak = 0;
+
+  {
+    std::shared_lock<std::shared_mutex> lock(m_SessionsMutex);
+
+    auto cudaMemoryInfo = Ort::MemoryInfo("Cuda", OrtArenaAllocator, 0, OrtMemTypeDefault);
+    bool cpuRead = false;
+
+    for (const auto& tier : m_Tiers) {
+      if (!tier->sessions) {
+        continue;
+      }
+
+      // every session allocates on the CPU from the one arena registered with the environment
+      if (!cpuRead && tier->sessions->sessionsCPU) {
+        ReadAllocatorStats(tier->sessions->sessionsCPU->front(), m_MemoryInfo, cpuInUse, cpuPeak);
+        cpuRead = true;
+      }
+
+      // while each GPU session has an arena of its own
+      if (auto* pool = tier->sessions->sessionsGPU.get()) {
+        for (int i = 0; i < pool->size(); i++) {
+          ReadAllocatorStats(pool->at(i), cudaMemoryInfo, gpuInUse, gpuPeak);
+        }
+      }
+    }
+  }
+
+  auto& accounting = MemoryAccounting::instance();
+
+  accounting.get(MemoryAccounting::Subsystem::OrtCpuArena).set(cpuInUse);
+  accounting.get(MemoryAccounting::Subsystem::OrtCpuArena).raisePeak(cpuPeak);
+  accounting.get(MemoryAccounting::Subsystem::OrtGpuArena).set(gpuInUse);
+  accounting.get(MemoryAccounting::Subsystem::OrtGpuArena).raisePeak(gpuPeak);
+#endif
+}
+
+
+
+bool Inference::setModelTier(int tier, bool wait) {
+  tier = std::clamp(tier, 0, getModelTierCount() - 1);
 
+  {
+    // shared is enough, tiers are only released under an exclusive lock
+    std::shared_lock<std::shared_mutex> lock(m_SessionsMutex);
 
+    m_RequestedModelTier = tier;
+
+    // already warm: runs in flight finish on the old tier, the next one uses the new
+    if (m_Tiers[tier]->sessions) {
+      m_ModelTier = tier;
+    }
+  }
+
+  requestWarming();
+
+  if (wait) {
+    std::unique_lock<std::mutex> lock(m_WarmMutex);
+    m_WarmDone.wait(lock, [&] { return m_ModelTier == tier || m_RequestedModelTier != tier; });
+  }
+
+  return m_ModelTier == tier;
+}
+
+
+
+void Inference::requestWarming() {
+  {
+    std::lock_guard<std::mutex> lock(m_WarmMutex);
+    m_WarmPending = true;
+  }
+
+  m_WarmWork.notify_one();
+}
+
+
+
+void Inference::warmTiers() {
+  std::unique_lock<std::mutex> lock(m_WarmMutex);
+
+  while (true) {
+    m_WarmWork.wait(lock, [this] { return m_WarmStop || m_WarmPending; });
+
+    if (m_WarmStop) {
+      break;
+    }
+
+    m_WarmPending = false;
+
+    auto threads = m_RequestedThreads;
+    m_RequestedThreads.reset();
+
+    lock.unlock();
+
+    // asks for another pass (requestWarming) once the new sessions are in
+    if (threads) {
+      setThreadCount(threads->first, threads->second);
+    }
+
+    updateTiers();
+    lock.lock();
+
+    m_WarmDone.notify_all();
+  }
+}
+
+
+
+void Inference::updateTiers() {
+  int requested = 0;
+  int generation = 0;
+  int intraOpThreads = 0;
+  int interOpThreads = 0;
+  int poolSize = 0;
+
+  {
+    std::shared_lock<std::shared_mutex> lock(m_SessionsMutex);
+    requested = m_RequestedModelTier;
+    generation = m_SessionsGeneration;
+    intraOpThreads = m_IntraOpThreads;
+    interOpThreads = m_InterOpThreads;
+    poolSize = m_SessionPoolSize;
+  }
+
+  // The requested tier first, then its neighbours. Sessions are built and warmed up
+  // without holding any lock, so runs carry on meanwhile.
+  for (int i : { requested, requested - 1, requested + 1 }) {
+    if (i < 0 || i >= getModelTierCount()) {
+      continue;
+    }
+
+    bool warm = false;
+    {
+      std::shared_lock<std::shared_mutex> lock(m_SessionsMutex);
+      warm = m_Tiers[i]->sessions != nullptr;
+    }
+
+    if (!warm) {
+      std::shared_ptr<TierSessions> sessions;
+
+      try {
+        sessions = createTierSessions(*m_Tiers[i], intraOpThreads, interOpThreads, poolSize);
+        warmUp(*sessions);
+      } catch (Ort::Exception& oe) {
+        std::cout << "ONNX exception caught: " << oe.what() << ". Code: " << oe.GetOrtErrorCode() << ".\n";
+        sessions.reset();
+      } catch (std::exception& e) {
+        std::cout << "Failed to load model " << m_Tiers[i]->name << ": " << e.what() << std::endl;
+        sessions.reset();
+      }
+
+      std::unique_lock<std::shared_mutex> lock(m_SessionsMutex);
+
+      if (generation != m_SessionsGeneration) {
+        return; // settings changed meanwhile, createSessions() already asked for another pass
+      }
+
+      if (sessions) {
+        m_Tiers[i]->sessions = sessions;
+      }
+      else if (i == requested && m_RequestedModelTier == i) {
+        m_RequestedModelTier = m_ModelTier.load(); // give up on it
+      }
+    }
+
+    if (i == requested) {
+      {
+        std::shared_lock<std::shared_mutex> lock(m_SessionsMutex);
+
+        if (m_RequestedModelTier == i && m_Tiers[i]->sessions) {
+          m_ModelTier = i;
+        }
+      }
+
+      // don't keep waiters waiting on the neighbours
+      std::lock_guard<std::mutex> lock(m_WarmMutex);
+      m_WarmDone.notify_all();
+    }
+  }
+
+  // Release the tiers that are no longer adjacent (outside the lock, it takes a while)
+  std::vector<std::shared_ptr<TierSessions>> released;
+
+  std::unique_lock<std::shared_mutex> lock(m_SessionsMutex);
+
+  for (int i = 0; i < getModelTierCount(); i++) {
+    if (std::abs(i - m_ModelTier) > 1 && i != m_RequestedModelTier && m_Tiers[i]->sessions) {
+      released.push_back(std::move(m_Tiers[i]->sessions));
+    }
+  }
+
+  collectSessionMemory();
+}
+
+
+
+void Inference::warmUp(TierSessions& sessions) {
+  const int64_t dims[] = { 1, WarmUpSize, WarmUpSize, 3 };
+  std::vector<float> image(WarmUpSize * WarmUpSize * 3, 0.5f);
+
+  for (auto* pool : { sessions.sessionsCPU.get(), sessions.sessionsGPU.get() }) {
+    if (!pool) {
+      continue;
+    }
+
+    // hold on to every session so each one gets a run
+    std::vector<SessionPool::Lease> leases;
+
+    for (int i = 0; i < pool->size(); i++) {
+      leases.push_back(pool->acquire());
+
+      std::vector<Ort::Value> inputTensor;
+      inputTensor.emplace_back(Ort::Value::CreateTensor<float>(m_MemoryInfo, image.data(), image.size(), dims, 4)); // content
+      inputTensor.emplace_back(Ort::Value::CreateTensor<float>(m_MemoryInfo, image.data(), image.size(), dims, 4)); // style
+
+      leases.back()->Run(Ort::RunOptions{ nullptr }, m_InputNodeNames.data(), inputTensor.data(), inputTensor.size(), m_OutputNodeNames.data(), 1);
+    }
+  }
+}
+
+
+
+bool Inference::run(const ConstFrameView& input, const FrameView& output, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize,
+  Timings* timings) {
+  if (!m_Enabled || m_Paused) {
+    return false;
+  }
+
+  if (!input.isValid() || !output.isValid() || input.width != output.width || input.height != output.height) {
+    std::cout << "Inference::run: invalid or mismatched frame views" << std::endl;
+    return false;
+  }
+
+  SpanRecorder::Scope span("Inference::run");
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  auto in = ViewToMat(input);
+  auto out = ViewToMat(output);
+
+  // With matching formats, stylize reads the input and resizes the result straight into the output.
+  // Otherwise the result is converted on the way out, the only full-size copy.
+  cv::Mat result = input.format == output.format ? out : cv::Mat();
+
+  auto stylized = stylize(in, result, styleImgBlob, styleImgSize);
+
+  auto postStylizeTime = std::chrono::high_resolution_clock::now();
+
+  if (input.format != output.format) {
+    SpanRecorder::Scope packSpan("pack");
+    cv::cvtColor(result, out, output.format == PixelFormat::BGRA8 ? cv::COLOR_BGR2BGRA : cv::COLOR_BGRA2BGR);
+  }
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+
+  std::chrono::duration<float, std::milli> packMs = endTime - postStylizeTime;
+
+  if (timings) {
+    *timings = { stylized.pre, stylized.model, stylized.post + packMs.count() };
+  }
+
+  if (m_Metrics && Instrumentation::isEnabled()) {
+    std::chrono::duration<float, std::milli> totalMs = endTime - startTime;
+    m_Metrics->collectInfRun({ totalMs.count(), stylized.pre, stylized.model, stylized.post + packMs.count() });
+  }
+
+  return true;
+}
+
+
+
+Inference::Timings Inference::stylize(const cv::Mat& input, cv::Mat& output, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize) {
+  return stylizeOn(input, output, styleImgBlob, styleImgSize, m_QualityPerfFactor, nullptr);
+}
+
+
+
+Inference::Timings Inference::stylizeOn(const cv::Mat& input, cv::Mat& output, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize, int quality, SessionPool* pool) {
   // input0: content image
   // input1: style image
   // (-1, -1, -1, 3)
   
   // prepare input
 
-  auto startTime = std::chrono::high_resolution_clock::now();
-  
-  auto input = HBITMAPToMat(inputImage);
-  
-  cv::Mat nnInput;
-  double downscalingFactor = 1.0 / pow(2, m_QualityPerfRange.second - m_QualityPerfFactor);
-
-  cv::Size scaledSz = input.size();
-  scaledSz.width = static_cast<int>(round(scaledSz.width * downscalingFactor));
-  scaledSz.height = static_cast<int>(round(scaledSz.height * downscalingFactor));
- 
-  // round to multiple of 4
-  scaledSz.width &= ~3;
-  scaledSz.height &= ~3;
+  auto startTime = std::chrono::steady_clock::now();
 
-  cv::resize(input, nnInput, scaledSz, cv::INTER_AREA);
+  cv::Mat nnInput;
+  PrepareModelInput(input, ModelInputSize(input.size(), quality, m_QualityPerfRange.second), nnInput);
 
   int height = nnInput.size().height;
   int width = nnInput.size().width;
   int channels = 3;
 
-  m_InputNodeDims[0][0] = 1;
-  m_InputNodeDims[0][1] = height;
-  m_InputNodeDims[0][2] = width;
+  // per-call copy, keeps concurrent runs independent
+  auto inputNodeDims = m_InputNodeDims;
+
+  inputNodeDims[0][0] = 1;
+  inputNodeDims[0][1] = height;
+  inputNodeDims[0][2] = width;
 
-  m_InputNodeDims[1][0] = 1;
-  m_InputNodeDims[1][1] = styleImgSize.second;
-  m_InputNodeDims[1][2] = styleImgSize.first;
+  inputNodeDims[1][0] = 1;
+  inputNodeDims[1][1] = styleImgSize.second;
+  inputNodeDims[1][2] = styleImgSize.first;
 
-  nnInput.convertTo(nnInput, CV_32FC3, 1.0 / 255.0);
+  // below full weight, the content snapshot is mixed into the style image, kept alive for this run
+  float* styleData = styleImgBlob.data();
+  std::shared_ptr<StyleMix> mix;
+
+  if (m_StyleImageWeight < 1.0f) {
+    mix = styleMix(input, styleImgBlob, styleImgSize);
+    styleData = mix->mixed.data();
+  }
 
   std::vector<Ort::Value> inputTensor;
 
   try {
-    inputTensor.emplace_back(Ort::Value::CreateTensor<float>(m_MemoryInfo, (float*)nnInput.data, width * height * channels, m_InputNodeDims[0].data(), m_InputNodeDims[0].size()));
-    inputTensor.emplace_back(Ort::Value::CreateTensor<float>(m_MemoryInfo, styleImgBlob.data(), styleImgBlob.size(), m_InputNodeDims[1].data(), m_InputNodeDims[1].size()));
+    inputTensor.emplace_back(Ort::Value::CreateTensor<float>(m_MemoryInfo, (float*)nnInput.data, width * height * channels, inputNodeDims[0].data(), inputNodeDims[0].size()));
+    inputTensor.emplace_back(Ort::Value::CreateTensor<float>(m_MemoryInfo, styleData, styleImgBlob.size(), inputNodeDims[1].data(), inputNodeDims[1].size()));
   }
   catch (Ort::Exception oe) {
     std::cout << "ONNX exception caught: " << oe.what() << ". Code: " << oe.GetOrtErrorCode() << ".\n";
@@ -313,18 +744,30 @@ void Inference::run(HBITMAP& inputImage, std::vector<float>& styleImgBlob, const
 
   // run inference
 
-  auto runModelTime = std::chrono::high_resolution_clock::now();
+  auto runModelTime = std::chrono::steady_clock::now();
 
   std::vector<Ort::Value> outputTensor;
 
   try {
-    Ort::Session* ses = m_SessionCPU.get();
-    if (m_Provider == Provider::GPU && m_SessionGPU) {
-      ses = m_SessionGPU.get();
+    if (pool) {
+      auto ses = pool->acquire();
+      outputTensor = ses->Run(Ort::RunOptions{ nullptr }, m_InputNodeNames.data(), inputTensor.data(), inputTensor.size(), m_OutputNodeNames.data(), 1);
     }
+    else if (m_ProfilingFramesLeft == 0 || !runProfiled(inputTensor, outputTensor)) {
+      std::shared_lock<std::shared_mutex> lock(m_SessionsMutex);
+
+      auto& sessions = activeSessions();
 
-    outputTensor = ses->Run(Ort::RunOptions{ nullptr }, m_InputNodeNames.data(), inputTensor.data(), inputTensor.size(), m_OutputNodeNames.data(), 1);
-    // TODO ses->RunAsync
+      SessionPool* pool = sessions.sessionsCPU.get();
+      if (m_Provider == Provider::GPU && sessions.sessionsGPU) {
+        pool = sessions.sessionsGPU.get();
+      }
+
+      auto ses = pool->acquire();
+
+      outputTensor = ses->Run(Ort::RunOptions{ nullptr }, m_InputNodeNames.data(), inputTensor.data(), inputTensor.size(), m_OutputNodeNames.data(), 1);
+      // TODO ses->RunAsync
+    }
   }
   catch (Ort::Exception oe) {
     std::cout << "ONNX exception caught: " << oe.what() << ". Code: " << oe.GetOrtErrorCode() << ".\n";
@@ -334,26 +777,133 @@ void Inference::run(HBITMAP& inputImage, std::vector<float>& styleImgBlob, const
 
   // process output
 
-  auto postModelTime = std::chrono::high_resolution_clock::now();
+  auto postModelTime = std::chrono::steady_clock::now();
 
   float* output_data = outputTensor.front().GetTensorMutableData<float>();
   cv::Mat outputNN(cv::Size(width, height), nnInput.type(), output_data);
-  outputNN.convertTo(outputNN, CV_8UC3, 255.0);
-  
-  cv::Mat output;
-  cv::resize(outputNN, output, input.size(), cv::INTER_CUBIC); // TODO INTER_LINEAR as user-configurable option
-  
-  MatToHBITMAP(output, inputImage);
 
-  auto endTime = std::chrono::high_resolution_clock::now();
+  FinishModelOutput(outputNN, input.channels(), input.size(), output);
 
-  if (m_Metrics) {
-    std::chrono::duration<float, std::milli> preMs = runModelTime - startTime;
-    std::chrono::duration<float, std::milli> modelMs = postModelTime - runModelTime;
-    std::chrono::duration<float, std::milli> postMs = endTime - postModelTime;
-    std::chrono::duration<float, std::milli> totalMs = endTime - startTime;
-    m_Metrics->collectInfRun({ totalMs.count(), preMs.count(), modelMs.count(), postMs.count() });
+  auto endTime = std::chrono::steady_clock::now();
+
+  // spans from the timings' clock reads, none of their own (the style mix nests in the downscale)
+  if (Instrumentation::isEnabled()) {
+    auto& spans = SpanRecorder::instance();
+    spans.record("downscale", spans.toNs(startTime), spans.toNs(runModelTime));
+    spans.record("model", spans.toNs(runModelTime), spans.toNs(postModelTime));
+    spans.record("upscale", spans.toNs(postModelTime), spans.toNs(endTime));
+  }
+
+  std::chrono::duration<float, std::milli> preMs = runModelTime - startTime;
+  std::chrono::duration<float, std::milli> modelMs = postModelTime - runModelTime;
+  std::chrono::duration<float, std::milli> postMs = endTime - postModelTime;
+
+  return { preMs.count(), modelMs.count(), postMs.count() };
+}
+
+
+
+std::shared_ptr<Inference::StyleMix> Inference::styleMix(const cv::Mat& input, const std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize) {
+  std::lock_guard<std::mutex> lock(m_StyleMixMutex);
+
+  float weight = m_StyleImageWeight;
+  cv::Size styleSz(styleImgSize.first, styleImgSize.second);
+
+  // a new content snapshot only when the weight changed, otherwise just the style changed
+  if (m_StyleMixContent.empty() || weight != m_StyleMixContentWeight) {
+    SpanRecorder::Scope snapshotSpan("style mix snapshot");
+
+    MakeStyleContent(input, styleSz, m_StyleMixContent);
+
+    m_StyleMixContentWeight = weight;
+    m_StyleMix.reset();
+  }
+  else if (m_StyleMixContent.size() != styleSz) {
+    cv::resize(m_StyleMixContent, m_StyleMixContent, styleSz, 0, 0, cv::INTER_AREA);
+    m_StyleMix.reset();
+  }
+
+  // the style blob is small next to a frame, comparing it is far cheaper than mixing again
+  if (m_StyleMix && m_StyleMix->source.size() == styleImgBlob.size() &&
+    std::memcmp(m_StyleMix->source.data(), styleImgBlob.data(), styleImgBlob.size() * sizeof(float)) == 0) {
+    return m_StyleMix;
+  }
+
+  SpanRecorder::Scope mixSpan("style mix");
+
+  auto mix = std::make_shared<StyleMix>();
+  mix->source = styleImgBlob;
+  mix->mixed.resize(styleImgBlob.size());
+
+  cv::Mat style(styleSz, CV_32FC3, mix->source.data());
+  cv::Mat mixed(styleSz, CV_32FC3, mix->mixed.data());
+  MixStyle(style, m_StyleMixContent, weight, mixed);
+
+  m_StyleMix = mix;
+  return mix;
+}
+
+
+
+void Inference::startProfiling(int frames) {
+  std::shared_lock<std::shared_mutex> sessionsLock(m_SessionsMutex);
+  std::lock_guard<std::mutex> lock(m_ProfilingMutex);
+
+  if (m_ProfilingSession) {
+    return;
   }
+
+  // Profiling is a session option, so profiled runs go through a dedicated session
+  auto tier = m_Tiers[m_ModelTier]->sessions;
+  bool gpu = m_Provider == Provider::GPU && tier->sessionsGPU;
+
+  auto options = gpu ? tier->optionsGPU.Clone() : tier->optionsCPU.Clone();
+  options.EnableProfiling(ORT_TSTR("stylish_profile"));
+
+  try {
+    m_ProfilingSession = std::make_unique<Ort::Session>(*m_Env, tier->model.data(), tier->model.size(), options, tier->prepackedWeights);
+    m_ProfilingTier = tier;
+  } catch (Ort::Exception& oe) {
+    std::cout << "ONNX exception caught: " << oe.what() << ". Code: " << oe.GetOrtErrorCode() << ".\n";
+    return;
+  }
+
+  m_ProfilingFrames = std::max(1, frames);
+  m_ProfilingFramesLeft = m_ProfilingFrames;
+}
+
+
+
+std::shared_ptr<const OpProfile> Inference::getOpProfile() const {
+  std::lock_guard<std::mutex> lock(m_ProfilingMutex);
+  return m_OpProfile;
+}
+
+
+
+bool Inference::runProfiled(std::vector<Ort::Value>& inputTensor, std::vector<Ort::Value>& outputTensor) {
+  std::lock_guard<std::mutex> lock(m_ProfilingMutex);
+
+  if (!m_ProfilingSession) {
+    return false;
+  }
+
+  outputTensor = m_ProfilingSession->Run(Ort::RunOptions{ nullptr }, m_InputNodeNames.data(), inputTensor.data(), inputTensor.size(), m_OutputNodeNames.data(), 1);
+
+  if (--m_ProfilingFramesLeft == 0) {
+    Ort::AllocatorWithDefaultOptions allocator;
+    auto path = m_ProfilingSession->EndProfilingAllocated(allocator);
+
+    m_ProfilingSession.reset();
+    m_ProfilingTier.reset();
+
+    auto profile = std::make_shared<OpProfile>();
+    if (profile->load(path.get(), m_ProfilingFrames)) {
+      m_OpProfile = profile;
+    }
+  }
+
+  return true;
 }
 
 
@@ -369,4 +919,108 @@ void Inference::setProvider(Provider prv) {
 
 void Inference::setQualityPerfFactor(int val) {
   m_QualityPerfFactor = std::clamp(val, m_QualityPerfRange.first, m_QualityPerfRange.second);
+}
+
+
+
+void Inference::setStyleImageWeight(float weight) {
+  m_StyleImageWeight = std::clamp(weight, 0.0f, 1.0f);
+}
+
+
+
+void Inference::stylizeConcurrent(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize) {
+  outputs.resize(inputs.size());
+
+  if (inputs.empty()) {
+    return;
+  }
+
+  size_t poolSize = 1;
+  {
+    std::shared_lock<std::shared_mutex> lock(m_SessionsMutex);
+    poolSize = static_cast<size_t>(m_SessionPoolSize);
+  }
+
+  // one worker per session, each pulling the next image as soon as it is done
+  std::atomic<size_t> next = 0;
+
+  m_ConcurrentWorkers.parallelFor(std::min(inputs.size(), poolSize), [&](size_t) {
+    for (size_t i = next++; i < inputs.size(); i = next++) {
+      stylize(inputs[i], outputs[i], styleImgBlob, styleImgSize);
+    }
+  });
+}
+
+
+
+bool Inference::setThreadCount(int intraOp, int interOp) {
+  return rebuildSessions(std::max(1, intraOp), std::max(1, interOp), m_SessionPoolSize);
+}
+
+
+
+void Inference::requestThreadCount(int intraOp, int interOp) {
+  {
+    std::lock_guard<std::mutex> lock(m_WarmMutex);
+    m_RequestedThreads = std::make_pair(intraOp, interOp);
+    m_WarmPending = true;
+  }
+
+  m_WarmWork.notify_one();
+}
+
+
+
+bool Inference::setSessionPoolSize(int size) {
+  return rebuildSessions(m_IntraOpThreads, m_InterOpThreads, std::clamp(size, m_SessionPoolRange.first, m_SessionPoolRange.second));
+}
+
+
+
+std::vector<float> Inference::benchmark(Provider provider, int intraOp, int interOp, int tier, const std::vector<int>& qualities, const cv::Mat& frame,
+  std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize, int runs, const std::function<bool()>& stop) {
+  if (tier < 0 || tier >= getModelTierCount()) {
+    throw std::runtime_error("No model tier " + std::to_string(tier));
+  }
+
+  std::vector<float> medians(qualities.size(), -1.0f);
+
+  if (stop && stop()) {
+    return medians;
+  }
+
+  // pool of one of the provider under test, only the run time matters
+  auto sessions = createTierSessions(*m_Tiers[tier], std::max(1, intraOp), std::max(1, interOp), 1, provider);
+
+  SessionPool* pool = provider == Provider::GPU ? sessions->sessionsGPU.get() : sessions->sessionsCPU.get();
+  if (!pool) {
+    throw std::runtime_error("GPU provider unavailable");
+  }
+
+  cv::Mat output;
+
+  for (size_t q = 0; q < qualities.size(); q++) {
+    int quality = std::clamp(qualities[q], m_QualityPerfRange.first, m_QualityPerfRange.second);
+
+    std::vector<float> samples;
+
+    // the first run is a warm-up, it pays for allocations (and kernel selection) at this input size
+    for (int i = 0; i <= std::max(1, runs); i++) {
+      if (stop && stop()) {
+        return medians;
+      }
+
+      auto timings = stylizeOn(frame, output, styleImgBlob, styleImgSize, quality, pool);
+
+      if (i > 0) {
+        samples.push_back(timings.pre + timings.model + timings.post);
+      }
+    }
+
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    medians[q] = samples[samples.size() / 2];
+  }
+
+  return medians;
 }
\ No newline at end of file
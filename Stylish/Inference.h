@@ -1,12 +1,29 @@
 #pragma once
 
+#include "FrameView.h"
+#include "MappedFile.h"
+#include "ModelInitializers.h"
+#include "ModelManifest.h"
+#include "OpProfile.h"
 #include "PerformanceMetrics.h"
+#include "SessionPool.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
 
 #include <onnxruntime_cxx_api.h>
 #include <opencv2/opencv.hpp>
 
-#include <windows.h>
-
 
 class Inference {
 public:
@@ -16,13 +33,49 @@ public:
     GPU
   };
 
+  // Time spent in each stage of a single stylization (ms)
+  struct Timings {
+    float pre = 0.0f;
+    float model = 0.0f;
+    float post = 0.0f;
+  };
+
   Inference(PerfMetrics* metrics);
 
-  void run(HBITMAP& inputImg, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize);
+  virtual ~Inference();
+
+  Inference(const Inference&) = delete;
+  Inference(Inference&&) = delete;
+
+  Inference& operator=(const Inference&) = delete;
+  Inference& operator=(Inference&&) = delete;
+
+  // Stylizes the input frame into the output frame (same size, may be the same pixels), collecting
+  // metrics, and the run's timings if asked for (packing counts as post-processing). Returns false if
+  // inference is disabled or the views don't fit.
+  bool run(const ConstFrameView& input, const FrameView& output, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize,
+    Timings* timings = nullptr);
+
+  // Stylize an 8-bit BGR or BGRA image with the current provider/quality settings, the output has the
+  // input's channels (written in place if already allocated so). Does not collect metrics.
+  // Thread-safe: concurrent calls run on separate pooled sessions.
+  Timings stylize(const cv::Mat& input, cv::Mat& output, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize);
+
+  // Times a provider/threading/model configuration at each of the quality factors, on sessions of its
+  // own (the provider's only, built once for all of them) next to the live ones, so the live configuration
+  // and its output are left alone (AutoTuner). Returns the median of the timed runs after a warm-up run
+  // per quality factor, negative for those not reached before stop() turned true. Throws if the
+  // configuration can't be built.
+  std::vector<float> benchmark(Provider provider, int intraOp, int interOp, int tier, const std::vector<int>& qualities, const cv::Mat& frame,
+    std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize, int runs, const std::function<bool()>& stop);
+
+  // Stylize several images (frames, tiles, regions) concurrently, one worker per pooled session
+  // (on the calling thread and a few of m_ConcurrentWorkers)
+  void stylizeConcurrent(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize);
 
   // Providers (limited config atm.) // TODO allow finer control (TensorRT, Cuda, etc.)
 
-  bool isGPUReady() const { return m_SessionGPU != nullptr; }
+  bool isGPUReady() const { return m_GPUReady; }
 
   Provider getProvider() const { return m_Provider; }
   void setProvider(Provider prv);
@@ -33,36 +86,210 @@ public:
   void disable() { m_Enabled = false; }
   bool isEnabled() const { return m_Enabled; }
 
+  // Paused, run() skips frames as if disabled, without touching the user's setting (AutoTuner, so
+  // live frames don't compete with its trials)
+  void pause() { m_Paused = true; }
+  void resume() { m_Paused = false; }
+
 
   // Quality/Performance
   
   std::pair<int, int> getQualityPerfRange() const { return m_QualityPerfRange; }
   int getQualityPerfFactor() const { return m_QualityPerfFactor; }
   void setQualityPerfFactor(int val);
+
+
+  // Weight of the style image in the model's style input, in [0, 1]. Below 1 the content image's pixels
+  // are mixed into the style image (the model has no style embedding to scale), which only roughly
+  // tones the style down. The content is a snapshot of the frame taken when the weight changes, so
+  // the style input stays put between changes (no flicker) and the mix is reused frame to frame.
+  float getStyleImageWeight() const { return m_StyleImageWeight; }
+  void setStyleImageWeight(float weight);
+
+
+  // Model ladder (models/ladder.txt): tiers ordered lightest to heaviest.
+  // The active tier's neighbours are kept warm in the background, so stepping one tier up or down
+  // swaps between two runs without a stall. Further jumps switch once the tier has warmed up.
+
+  int getModelTierCount() const { return static_cast<int>(m_Tiers.size()); }
+  const std::string& getModelTierName(int tier) const { return m_Tiers[tier]->name; }
+
+  int getModelTier() const { return m_ModelTier; }
+  int getRequestedModelTier() const { return m_RequestedModelTier; }
+
+  // With wait, blocks until the switch happened (or failed). Returns true if the tier is active.
+  bool setModelTier(int tier, bool wait = false);
+
+
+  // Threading (changing these recreates the sessions). Returns false if the new sessions couldn't
+  // be built, the current ones (and settings) are kept then.
+
+  int getIntraOpThreads() const { return m_IntraOpThreads; }
+  int getInterOpThreads() const { return m_InterOpThreads; }
+  bool setThreadCount(int intraOp, int interOp);
+
+  // setThreadCount() on the warmer thread, returns right away (UI)
+  void requestThreadCount(int intraOp, int interOp);
+
+  // Number of sessions per provider, i.e. how many runs can be in flight at once (recreates the sessions, as above).
+  // Only stylizeConcurrent() has runs in flight together; the app stylizes a frame at a time and keeps one.
+
+  std::pair<int, int> getSessionPoolRange() const { return m_SessionPoolRange; }
+  int getSessionPoolSize() const { return m_SessionPoolSize; }
+  bool setSessionPoolSize(int size);
+
+
+  // Per-operator profiling of the next N runs (with the current provider)
+
+  void startProfiling(int frames);
+  bool isProfiling() const { return m_ProfilingFramesLeft > 0; }
+
+  // Latest completed capture, null until one finishes
+  std::shared_ptr<const OpProfile> getOpProfile() const;
+
+
+  // Reads the ORT arenas' bytes in use into MemoryAccounting, at most once a second.
+  // Needs allocator stats from the runtime (API 23+), a no-op before.
+  void collectAllocatorStats();
   
 
 private:
-  bool m_Enabled = true;
+  std::atomic<bool> m_Enabled = true;
+  std::atomic<bool> m_Paused = false;
   
-  Provider m_Provider = Provider::GPU; // 0 - CPU, 1 - GPU
+  std::atomic<Provider> m_Provider = Provider::GPU; // 0 - CPU, 1 - GPU
 
   const std::pair<int, int> m_QualityPerfRange = { 0, 3 }; // 0 - max performance, 3 - max quality
-  int m_QualityPerfFactor = 2;
+  std::atomic<int> m_QualityPerfFactor = 2;
+
+  std::atomic<float> m_StyleImageWeight = 1.0f;
+
+  // Style input mixed with the content snapshot (see setStyleImageWeight), replaced, never modified,
+  // as runs may still be reading the previous one
+  struct StyleMix {
+    std::vector<float> source;  // the style blob it was mixed from
+    std::vector<float> mixed;
+  };
+
+  std::mutex m_StyleMixMutex;
+  cv::Mat m_StyleMixContent;         // at style size, CV_32FC3
+  float m_StyleMixContentWeight = -1.0f; // the weight it was taken for
+  std::shared_ptr<StyleMix> m_StyleMix;
+
+  int m_IntraOpThreads = 4;
+  int m_InterOpThreads = 4;
+
+  const std::pair<int, int> m_SessionPoolRange = { 1, 8 };
+  int m_SessionPoolSize = 1;
+
+  // stylizeConcurrent's helpers, enough to use the largest pool
+  ThreadPool m_ConcurrentWorkers{ m_SessionPoolRange.second - 1 };
+
+  bool m_CudaReady = false;
+  bool m_TensorRTReady = false;
   
   std::unique_ptr<Ort::Env> m_Env;
 
-  Ort::SessionOptions m_SessionOptionsCPU;
-  Ort::SessionOptions m_SessionOptionsGPU;
+  // Everything needed to run one model, only present while its tier is warm
+  struct TierSessions {
+    // Shared by every session of the model: weights are loaded and pre-packed once per process.
+    // The mapped model pages are shared with other processes, and so are the weights read in place
+    // from them (all of an ORT format model's, few of an ONNX model's, see ModelInitializers).
+    MappedFile model;
+    std::unique_ptr<ModelInitializers> initializers;
+    Ort::PrepackedWeightsContainer prepackedWeights;
+
+    Ort::SessionOptions optionsCPU;
+    Ort::SessionOptions optionsGPU;
+
+    std::unique_ptr<SessionPool> sessionsCPU;
+    std::unique_ptr<SessionPool> sessionsGPU;
+  };
+
+  struct ModelTier {
+    std::string name;
+    std::filesystem::path path;
+
+    std::shared_ptr<TierSessions> sessions;
+  };
+
+  std::vector<std::unique_ptr<ModelTier>> m_Tiers;
+
+  std::atomic<int> m_ModelTier = 0;
+  std::atomic<int> m_RequestedModelTier = 0;
+
+  // Runs hold a shared lock, (re)creating or swapping sessions an exclusive one
+  std::shared_mutex m_SessionsMutex;
 
-  std::unique_ptr<Ort::Session> m_SessionCPU;
-  std::unique_ptr<Ort::Session> m_SessionGPU;
+  // Bumped whenever the session configuration changes, sessions built for an older one are dropped
+  int m_SessionsGeneration = 0;
+
+  std::atomic<bool> m_GPUReady = false;
+
+  // Background warming of the tiers around the requested one
+  std::thread m_Warmer;
+  std::mutex m_WarmMutex;
+  std::condition_variable m_WarmWork;
+  std::condition_variable m_WarmDone;
+  bool m_WarmPending = false;
+  bool m_WarmStop = false;
+  std::optional<std::pair<int, int>> m_RequestedThreads;  // intra-op, inter-op
+
+  // Profiling
+  mutable std::mutex m_ProfilingMutex;
+  std::unique_ptr<Ort::Session> m_ProfilingSession;
+  std::shared_ptr<TierSessions> m_ProfilingTier; // model and weights the profiling session reads
+  std::atomic<int> m_ProfilingFramesLeft = 0;
+  int m_ProfilingFrames = 0;
+  std::shared_ptr<const OpProfile> m_OpProfile;
+
+  std::chrono::steady_clock::time_point m_AllocatorStatsTime;
 
   Ort::MemoryInfo m_MemoryInfo{ nullptr };
 
   std::vector<const char*> m_InputNodeNames;
   std::vector<const char*> m_OutputNodeNames;
 
-  std::vector<std::vector<int64_t>> m_InputNodeDims;    // Input node dimension.
+  std::vector<std::vector<int64_t>> m_InputNodeDims;    // Input node dimension (as declared by the model, -1 for dynamic).
 
   PerfMetrics* m_Metrics;
+
+
+  // Builds the active tier's sessions with the given settings and only then swaps them in (dropping
+  // the other tiers' for the warmer to rebuild). Throws if building fails, nothing changes then.
+  // Caller must hold m_SessionsMutex exclusively (or be the constructor).
+  void createSessions(int intraOpThreads, int interOpThreads, int poolSize);
+
+  // createSessions() for the setters: the sessions are built without holding the lock, so runs
+  // carry on meanwhile, and swapped in under it. False if building failed, nothing changes then.
+  bool rebuildSessions(int intraOpThreads, int interOpThreads, int poolSize);
+
+  // The swap, caller must hold m_SessionsMutex exclusively
+  void installSessions(int tier, std::shared_ptr<TierSessions> sessions, int intraOpThreads, int interOpThreads, int poolSize);
+
+  // Builds the sessions of a tier with the given threading/pool settings, no locking involved.
+  // Only the given provider's if any (a GPU provider that fails to build leaves no GPU sessions).
+  std::shared_ptr<TierSessions> createTierSessions(const ModelTier& tier, int intraOpThreads, int interOpThreads, int poolSize,
+    std::optional<Provider> only = std::nullopt) const;
+
+  // Caller must hold m_SessionsMutex
+  TierSessions& activeSessions() { return *m_Tiers[m_ModelTier]->sessions; }
+
+  // Warmer thread
+  void requestWarming();
+  void warmTiers();
+  void updateTiers();
+  void warmUp(TierSessions& sessions);
+
+  // Caller must hold m_SessionsMutex
+  void collectSessionMemory();
+
+  // stylize() at the given quality, on the pool if not null (the live sessions otherwise)
+  Timings stylizeOn(const cv::Mat& input, cv::Mat& output, std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize, int quality, SessionPool* pool);
+
+  // The style blob mixed with the content snapshot at the current weight, cached until either changes
+  std::shared_ptr<StyleMix> styleMix(const cv::Mat& input, const std::vector<float>& styleImgBlob, const std::pair<int, int>& styleImgSize);
+
+  // Runs on the profiling session if a capture is in progress, returns false otherwise
+  bool runProfiled(std::vector<Ort::Value>& inputTensor, std::vector<Ort::Value>& outputTensor);
 };
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include "Instrumentation.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+bool Instrumentation::initFromEnvironment() {
+#ifdef _WIN32
+  char* value = nullptr;
+  size_t length = 0;
+
+  if (_dupenv_s(&value, &length, "STYLISH_METRICS") != 0 || !value) {
+    return false;
+  }
+
+  std::string str(value);
+  free(value);
+#else
+  const char* value = std::getenv("STYLISH_METRICS");
+  if (!value) {
+    return false;
+  }
+
+  std::string str(value);
+#endif
+
+  s_SetByEnvironment = true;
+  setEnabled(!str.empty() && str != "0");
+
+  std::cout << "Metrics " << (isEnabled() ? "enabled" : "disabled") << " by STYLISH_METRICS" << std::endl;
+
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+//
+// Always-compiled probes feeding PerfMetrics and the span recorder, switched on and off at runtime
+// (UI, ini or the STYLISH_METRICS environment variable, which wins over the ini).
+//
+// Disabled, a probe is a single relaxed load and a branch; enabled, counters add one atomic
+// increment and timers two clock reads and a histogram record.
+//
+class Instrumentation {
+public:
+
+  static bool isEnabled() { return s_Enabled.load(std::memory_order_relaxed); }
+  static void setEnabled(bool enabled) { s_Enabled.store(enabled, std::memory_order_relaxed); }
+
+  // Applies STYLISH_METRICS=0/1 if set, returns whether it was
+  static bool initFromEnvironment();
+  static bool isSetByEnvironment() { return s_SetByEnvironment; }
+
+  class Counter {
+  public:
+    void add(uint64_t n = 1) {
+      if (isEnabled()) {
+        m_Count.fetch_add(n, std::memory_order_relaxed);
+      }
+    }
+
+    uint64_t get() const { return m_Count.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> m_Count = 0;
+  };
+
+  // Records the enclosing block's duration, if enabled when the block was entered (and given a histogram)
+  class ScopedTimer {
+  public:
+    explicit ScopedTimer(LatencyHistogram* histogram) : m_Histogram{ isEnabled() ? histogram : nullptr } {
+      if (m_Histogram) {
+        m_Begin = std::chrono::steady_clock::now();
+      }
+    }
+
+    ~ScopedTimer() {
+      if (m_Histogram) {
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - m_Begin;
+        m_Histogram->record(elapsed.count());
+      }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+  private:
+    LatencyHistogram* m_Histogram;
+    std::chrono::steady_clock::time_point m_Begin;
+  };
+
+private:
+  static inline std::atomic<bool> s_Enabled = false;
+  static inline bool s_SetByEnvironment = false;
+};
\ No newline at end of file
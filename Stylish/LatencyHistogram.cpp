@@ -0,0 +1,245 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+  void AtomicMax(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+  }
+
+
+
+  // index of the highest set bit, v > 0
+  int HighestBit(uint64_t v) {
+    int bit = 0;
+    for (int shift = 32; shift > 0; shift /= 2) {
+      if (v >> shift) {
+        v >>= shift;
+        bit += shift;
+      }
+    }
+    return bit;
+  }
+}
+
+
+
+LatencyHistogram::LatencyHistogram() : m_Start{ std::chrono::steady_clock::now() } {
+  for (auto& count : m_Lifetime) {
+    count = 0;
+  }
+
+  m_LifetimeSumUs = 0;
+  m_LifetimeMaxUs = 0;
+
+  for (auto& slice : m_Slices) {
+    for (auto& count : slice.buckets) {
+      count = 0;
+    }
+
+    slice.sumUs = 0;
+    slice.maxUs = 0;
+    slice.second = -1;
+  }
+}
+
+
+
+int64_t LatencyHistogram::now() const {
+  return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - m_Start).count();
+}
+
+
+
+int LatencyHistogram::bucketOf(uint64_t us) {
+  if (us < SubBuckets) {
+    return static_cast<int>(us);
+  }
+
+  int shift = HighestBit(us) - SubBucketBits;
+  int bucket = (shift + 1) * SubBuckets + static_cast<int>((us >> shift) - SubBuckets);
+
+  return std::min(bucket, BucketCount - 1);
+}
+
+
+
+float LatencyHistogram::bucketLow(int bucket) {
+  if (bucket < SubBuckets) {
+    return bucket / 1000.0f;
+  }
+
+  int shift = bucket / SubBuckets - 1;
+  uint64_t low = static_cast<uint64_t>(SubBuckets + bucket % SubBuckets) << shift;
+
+  return low / 1000.0f;
+}
+
+
+
+float LatencyHistogram::bucketHigh(int bucket) {
+  if (bucket < SubBuckets) {
+    return (bucket + 1) / 1000.0f;
+  }
+
+  int shift = bucket / SubBuckets - 1;
+  return bucketLow(bucket) + (static_cast<uint64_t>(1) << shift) / 1000.0f;
+}
+
+
+
+void LatencyHistogram::record(float ms) {
+  uint64_t us = static_cast<uint64_t>(std::max(0.0f, ms) * 1000.0f);
+  int bucket = bucketOf(us);
+
+  m_Lifetime[bucket].fetch_add(1, std::memory_order_relaxed);
+  m_LifetimeSumUs.fetch_add(us, std::memory_order_relaxed);
+  AtomicMax(m_LifetimeMaxUs, us);
+
+  int64_t second = now();
+  auto& slice = m_Slices[second % WindowSeconds];
+
+  // first sample of a new second in this slice: whoever swaps the second in clears the old counts
+  int64_t held = slice.second.load(std::memory_order_acquire);
+  if (held != second && slice.second.compare_exchange_strong(held, second, std::memory_order_acq_rel)) {
+    for (auto& count : slice.buckets) {
+      count.store(0, std::memory_order_relaxed);
+    }
+
+    slice.sumUs.store(0, std::memory_order_relaxed);
+    slice.maxUs.store(0, std::memory_order_relaxed);
+  }
+
+  slice.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  slice.sumUs.fetch_add(us, std::memory_order_relaxed);
+  AtomicMax(slice.maxUs, us);
+}
+
+
+
+float LatencyHistogram::Summary::quantile(float q) const {
+  if (count == 0) {
+    return 0.0f;
+  }
+
+  uint64_t rank = static_cast<uint64_t>(std::ceil(q * count));
+  rank = std::clamp<uint64_t>(rank, 1, count);
+
+  uint64_t seen = 0;
+
+  for (int i = firstBucket; i <= lastBucket; i++) {
+    seen += buckets[i];
+
+    if (seen >= rank) {
+      // the bucket's middle, but never above the largest sample
+      return std::min(max, 0.5f * (bucketLow(i) + bucketHigh(i)));
+    }
+  }
+
+  return max;
+}
+
+
+
+void LatencyHistogram::summarize(Summary& summary, uint64_t sumUs, uint64_t maxUs) {
+  summary.count = 0;
+  summary.firstBucket = BucketCount;
+  summary.lastBucket = -1;
+
+  for (int i = 0; i < BucketCount; i++) {
+    if (summary.buckets[i]) {
+      summary.count += summary.buckets[i];
+      summary.firstBucket = std::min(summary.firstBucket, i);
+      summary.lastBucket = i;
+    }
+  }
+
+  if (summary.count == 0) {
+    summary.firstBucket = 0;
+    return;
+  }
+
+  summary.mean = sumUs / 1000.0f / summary.count;
+  summary.max = maxUs / 1000.0f;
+  summary.p50 = summary.quantile(0.5f);
+  summary.p90 = summary.quantile(0.9f);
+  summary.p99 = summary.quantile(0.99f);
+}
+
+
+
+LatencyHistogram::Summary LatencyHistogram::lifetime() const {
+  Summary summary;
+  summary.buckets.resize(BucketCount);
+
+  for (int i = 0; i < BucketCount; i++) {
+    summary.buckets[i] = m_Lifetime[i].load(std::memory_order_relaxed);
+  }
+
+  summarize(summary, m_LifetimeSumUs.load(std::memory_order_relaxed), m_LifetimeMaxUs.load(std::memory_order_relaxed));
+  return summary;
+}
+
+
+
+LatencyHistogram::Summary LatencyHistogram::window() const {
+  Summary summary;
+  summary.buckets.resize(BucketCount);
+
+  int64_t second = now();
+  uint64_t sumUs = 0;
+  uint64_t maxUs = 0;
+
+  for (const auto& slice : m_Slices) {
+    int64_t held = slice.second.load(std::memory_order_acquire);
+    if (held < 0 || held <= second - WindowSeconds) {
+      continue;
+    }
+
+    for (int i = 0; i < BucketCount; i++) {
+      summary.buckets[i] += slice.buckets[i].load(std::memory_order_relaxed);
+    }
+
+    sumUs += slice.sumUs.load(std::memory_order_relaxed);
+    maxUs = std::max(maxUs, slice.maxUs.load(std::memory_order_relaxed));
+  }
+
+  summarize(summary, sumUs, maxUs);
+  return summary;
+}
+
+
+
+std::vector<float> LatencyHistogram::windowP99() const {
+  std::vector<float> p99(WindowSeconds, 0.0f);
+
+  int64_t second = now();
+
+  for (int i = 0; i < WindowSeconds; i++) {
+    int64_t wanted = second - (WindowSeconds - 1) + i;
+    if (wanted < 0) {
+      continue;
+    }
+
+    const auto& slice = m_Slices[wanted % WindowSeconds];
+    if (slice.second.load(std::memory_order_acquire) != wanted) {
+      continue;
+    }
+
+    Summary summary;
+    summary.buckets.resize(BucketCount);
+
+    for (int b = 0; b < BucketCount; b++) {
+      summary.buckets[b] = slice.buckets[b].load(std::memory_order_relaxed);
+    }
+
+    summarize(summary, slice.sumUs.load(std::memory_order_relaxed), slice.maxUs.load(std::memory_order_relaxed));
+    p99[i] = summary.p99;
+  }
+
+  return p99;
+}
\ No newline at end of file
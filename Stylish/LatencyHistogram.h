@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+
+//
+// Log-bucketed (HDR-style) latency histogram. Each power of two is split into 16 linear
+// sub-buckets, so any recorded value is off by at most ~6%, from 1 us up to about a minute.
+//
+// Recording is lock-free (a few relaxed atomic increments) and safe from any thread. Besides the
+// lifetime counts, samples go into one of several one-second slices, which make up the window.
+// A slice is cleared when it is reused; samples racing with that may be lost, which is fine
+// for monitoring.
+//
+class LatencyHistogram {
+public:
+
+  static constexpr int SubBucketBits = 4;
+  static constexpr int SubBuckets = 1 << SubBucketBits;
+  static constexpr int BucketCount = (26 - SubBucketBits + 2) * SubBuckets;  // up to 2^26 us
+
+  static constexpr int WindowSeconds = 10;
+
+  struct Summary {
+    uint64_t count = 0;
+    float mean = 0.0f;  // ms
+    float p50 = 0.0f;
+    float p90 = 0.0f;
+    float p99 = 0.0f;
+    float max = 0.0f;
+
+    std::vector<uint64_t> buckets;
+    int firstBucket = 0;    // of the buckets above, the non-empty range
+    int lastBucket = -1;
+
+    // ms at a quantile in [0, 1]
+    float quantile(float q) const;
+  };
+
+  LatencyHistogram();
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram(LatencyHistogram&&) = delete;
+
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(LatencyHistogram&&) = delete;
+
+  virtual ~LatencyHistogram() = default;
+
+  void record(float ms);
+
+  Summary lifetime() const;
+  Summary window() const;
+
+  // p99 of each second in the window, oldest first (0 if it had no samples)
+  std::vector<float> windowP99() const;
+
+  // Bounds of a bucket in ms
+  static float bucketLow(int bucket);
+  static float bucketHigh(int bucket);
+
+private:
+
+  struct Counts {
+    std::array<std::atomic<uint32_t>, BucketCount> buckets;
+    std::atomic<uint64_t> sumUs;
+    std::atomic<uint64_t> maxUs;
+    std::atomic<int64_t> second;  // which second this slice holds
+  };
+
+  std::array<std::atomic<uint64_t>, BucketCount> m_Lifetime;
+  std::atomic<uint64_t> m_LifetimeSumUs;
+  std::atomic<uint64_t> m_LifetimeMaxUs;
+
+  std::array<Counts, WindowSeconds> m_Slices;
+
+  std::chrono::steady_clock::time_point m_Start;
+
+
+  int64_t now() const;
+
+  static int bucketOf(uint64_t us);
+  static void summarize(Summary& summary, uint64_t sumUs, uint64_t maxUs);
+};
\ No newline at end of file
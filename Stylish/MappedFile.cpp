@@ -0,0 +1,259 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace fs = std::filesystem;
+
+
+#ifdef _WIN32
+namespace {
+  bool EnableLockMemoryPrivilege() {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+      return false;
+    }
+
+    TOKEN_PRIVILEGES tp = {};
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+    bool ok = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) &&
+      AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr) &&
+      GetLastError() == ERROR_SUCCESS; // ERROR_NOT_ALL_ASSIGNED if we don't hold the privilege
+
+    CloseHandle(token);
+    return ok;
+  }
+
+
+
+  // Same name for the same file contents (as far as we can tell without reading it)
+  std::wstring SectionName(const fs::path& path, size_t size) {
+    auto stamp = fs::last_write_time(path).time_since_epoch().count();
+    auto key = fs::absolute(path).wstring() + L"|" + std::to_wstring(size) + L"|" + std::to_wstring(stamp);
+    return L"Local\\Stylish.Mapped." + std::to_wstring(std::hash<std::wstring>{}(key));
+  }
+}
+
+
+
+bool MappedFile::openLargePages(const fs::path& path, void* file) {
+  SIZE_T pageSize = GetLargePageMinimum();
+
+  if (pageSize == 0 || !EnableLockMemoryPrivilege()) {
+    return false;
+  }
+
+  auto name = SectionName(path, m_Size);
+  auto sectionSize = ((m_Size + pageSize - 1) / pageSize) * pageSize;
+
+  // serialize creation, so nobody maps the section before it is filled
+  HANDLE lock = CreateMutexW(nullptr, FALSE, (name + L".lock").c_str());
+  if (!lock) {
+    return false;
+  }
+
+  WaitForSingleObject(lock, INFINITE);
+
+  HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name.c_str());
+  void* view = nullptr;
+
+  if (mapping) {
+    view = MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_LARGE_PAGES, 0, 0, 0);
+  }
+  else {
+    mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE | SEC_COMMIT | SEC_LARGE_PAGES,
+      static_cast<DWORD>(static_cast<uint64_t>(sectionSize) >> 32), static_cast<DWORD>(sectionSize & 0xFFFFFFFF), name.c_str());
+
+    if (mapping) {
+      view = MapViewOfFile(mapping, FILE_MAP_WRITE | FILE_MAP_LARGE_PAGES, 0, 0, 0);
+    }
+
+    // fill it from the file
+    size_t done = 0;
+    while (view && done < m_Size) {
+      DWORD chunk = static_cast<DWORD>(std::min<size_t>(m_Size - done, 1 << 30));
+      DWORD read = 0;
+
+      if (!ReadFile(file, static_cast<char*>(view) + done, chunk, &read, nullptr) || read == 0) {
+        UnmapViewOfFile(view);
+        view = nullptr;
+        break;
+      }
+
+      done += read;
+    }
+  }
+
+  ReleaseMutex(lock);
+  CloseHandle(lock);
+
+  if (!view) {
+    if (mapping) {
+      CloseHandle(mapping);
+    }
+    return false;
+  }
+
+  m_Mapping = mapping;
+  m_Data = view;
+  m_LargePages = true;
+
+  return true;
+}
+#endif
+
+
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+
+
+bool MappedFile::open(const fs::path& path, bool largePages) {
+  close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    std::cout << "Failed to open " << path.string() << std::endl;
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+
+  m_Size = static_cast<size_t>(size.QuadPart);
+
+  if (largePages && openLargePages(path, file)) {
+    CloseHandle(file);
+    return true;
+  }
+
+  if (largePages) {
+    std::cout << "Large pages unavailable for " << path.string() << ", using a regular mapping." << std::endl;
+  }
+
+  HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file); // the mapping keeps the file open
+
+  if (!mapping) {
+    m_Size = 0;
+    return false;
+  }
+
+  m_Data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!m_Data) {
+    CloseHandle(mapping);
+    m_Size = 0;
+    return false;
+  }
+
+  m_Mapping = mapping;
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Failed to open " << path.string() << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  m_Size = static_cast<size_t>(st.st_size);
+
+  void* data = mmap(nullptr, m_Size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd); // the mapping keeps the file open
+
+  if (data == MAP_FAILED) {
+    m_Size = 0;
+    return false;
+  }
+
+  madvise(data, m_Size, MADV_WILLNEED);
+
+#ifdef MADV_HUGEPAGE
+  if (largePages) {
+    // only honoured where the kernel supports huge pages for the page cache
+    m_LargePages = madvise(data, m_Size, MADV_HUGEPAGE) == 0;
+  }
+#endif
+
+  m_Data = data;
+  m_MappedSize = m_Size;
+#endif
+
+  return true;
+}
+
+
+
+void MappedFile::discard(const void* data, size_t size) const {
+  if (!m_Data || m_LargePages || size == 0) {
+    return;
+  }
+
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  uintptr_t pageSize = info.dwPageSize;
+#else
+  uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+#endif
+
+  // only whole pages within the range, the rest may be shared with neighbouring data
+  auto begin = (reinterpret_cast<uintptr_t>(data) + pageSize - 1) & ~(pageSize - 1);
+  auto end = (reinterpret_cast<uintptr_t>(data) + size) & ~(pageSize - 1);
+
+  if (end <= begin) {
+    return;
+  }
+
+#ifdef _WIN32
+  // unlocking pages that aren't locked removes them from the working set
+  VirtualUnlock(reinterpret_cast<void*>(begin), end - begin);
+#else
+  madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+
+
+void MappedFile::close() {
+  if (!m_Data) {
+    return;
+  }
+
+#ifdef _WIN32
+  UnmapViewOfFile(m_Data);
+  CloseHandle(m_Mapping);
+  m_Mapping = nullptr;
+#else
+  munmap(const_cast<void*>(m_Data), m_MappedSize);
+  m_MappedSize = 0;
+#endif
+
+  m_Data = nullptr;
+  m_Size = 0;
+  m_LargePages = false;
+}
\ No newline at end of file
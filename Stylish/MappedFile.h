@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+
+//
+// Read-only view of a whole file. Pages come from the OS page cache and are shared with
+// every other process mapping the same file.
+//
+// With large pages, the file is instead copied once into a named large-page section which
+// other processes (same file, size and timestamp) open rather than create. This needs the
+// "Lock pages in memory" privilege on Windows; we fall back to a regular mapping without it.
+//
+class MappedFile {
+public:
+  MappedFile() = default;
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile(MappedFile&&) = delete;
+
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile& operator=(MappedFile&&) = delete;
+
+  virtual ~MappedFile();
+
+  bool open(const std::filesystem::path& path, bool largePages = false);
+  void close();
+
+  bool isOpen() const { return m_Data != nullptr; }
+  bool isLargePages() const { return m_LargePages; }
+
+  const void* data() const { return m_Data; }
+  size_t size() const { return m_Size; }
+
+  // Drops the resident pages within a range of the view, they are read back in on next access.
+  // No-op with large pages, those stay resident.
+  void discard(const void* data, size_t size) const;
+
+private:
+  const void* m_Data = nullptr;
+  size_t m_Size = 0;
+  bool m_LargePages = false;
+
+#ifdef _WIN32
+  void* m_Mapping = nullptr; // HANDLE
+
+  bool openLargePages(const std::filesystem::path& path, void* file);
+#else
+  size_t m_MappedSize = 0;
+#endif
+};
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "MemoryAccounting.h"
+
+#include <opencv2/opencv.hpp>
+
+
+namespace {
+  void AtomicMax(std::atomic<size_t>& target, size_t value) {
+    size_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+  }
+
+
+
+  //
+  // OpenCV's default (std) allocator, counting the bytes it hands out.
+  // Mats wrapping user memory aren't counted, they own nothing.
+  //
+  class CountingMatAllocator : public cv::MatAllocator {
+  public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data0, size_t* step, cv::AccessFlag, cv::UMatUsageFlags) const override {
+      size_t total = CV_ELEM_SIZE(type);
+
+      for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+          if (data0 && step[i] != CV_AUTOSTEP) {
+            CV_Assert(total <= step[i]);
+            total = step[i];
+          }
+          else {
+            step[i] = total;
+          }
+        }
+
+        total *= sizes[i];
+      }
+
+      auto* data = data0 ? static_cast<uchar*>(data0) : static_cast<uchar*>(cv::fastMalloc(total));
+
+      auto* u = new cv::UMatData(this);
+      u->data = u->origdata = data;
+      u->size = total;
+
+      if (data0) {
+        u->flags |= cv::UMatData::USER_ALLOCATED;
+      }
+      else {
+        MemoryAccounting::instance().get(MemoryAccounting::Subsystem::Mats).add(total);
+      }
+
+      return u;
+    }
+
+    bool allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const override {
+      return u != nullptr;
+    }
+
+    void deallocate(cv::UMatData* u) const override {
+      if (!u) {
+        return;
+      }
+
+      CV_Assert(u->urefcount == 0);
+      CV_Assert(u->refcount == 0);
+
+      if (!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+        MemoryAccounting::instance().get(MemoryAccounting::Subsystem::Mats).sub(u->size);
+
+        cv::fastFree(u->origdata);
+        u->origdata = nullptr;
+      }
+
+      delete u;
+    }
+  };
+}
+
+
+
+void MemoryAccounting::Account::add(size_t bytes) {
+  auto now = m_Bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  AtomicMax(m_Peak, now);
+}
+
+
+
+void MemoryAccounting::Account::sub(size_t bytes) {
+  m_Bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+
+
+void MemoryAccounting::Account::set(size_t bytes) {
+  m_Bytes.store(bytes, std::memory_order_relaxed);
+  AtomicMax(m_Peak, bytes);
+}
+
+
+
+void MemoryAccounting::Account::raisePeak(size_t bytes) {
+  AtomicMax(m_Peak, bytes);
+}
+
+
+
+MemoryAccounting& MemoryAccounting::instance() {
+  static MemoryAccounting accounting;
+  return accounting;
+}
+
+
+
+const char* MemoryAccounting::getName(Subsystem subsystem) {
+  switch (subsystem) {
+    case Subsystem::OrtCpuArena: return "ORT CPU arena";
+    case Subsystem::OrtGpuArena: return "ORT GPU arena";
+    case Subsystem::Mats: return "cv::Mat heap";
+    case Subsystem::Capture: return "capture";
+    case Subsystem::StyleImages: return "style images";
+    case Subsystem::StyleBlobs: return "style tensors";
+    case Subsystem::Textures: return "thumbnail textures";
+    default: return "?";
+  }
+}
+
+
+
+const char* MemoryAccounting::getKey(Subsystem subsystem) {
+  switch (subsystem) {
+    case Subsystem::OrtCpuArena: return "ort_cpu_arena";
+    case Subsystem::OrtGpuArena: return "ort_gpu_arena";
+    case Subsystem::Mats: return "mats";
+    case Subsystem::Capture: return "capture";
+    case Subsystem::StyleImages: return "style_images";
+    case Subsystem::StyleBlobs: return "style_tensors";
+    case Subsystem::Textures: return "textures";
+    default: return "unknown";
+  }
+}
+
+
+
+void MemoryAccounting::installMatAllocator() {
+  // never destroyed, Mats may be released during static destruction
+  static auto* allocator = new CountingMatAllocator();
+  cv::Mat::setDefaultAllocator(allocator);
+}
\ No newline at end of file
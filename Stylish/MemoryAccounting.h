@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+
+//
+// Bytes and peaks per subsystem, to attribute the process' memory growth. Always on: accounts are
+// updated where memory is allocated or released, a relaxed atomic or two each.
+//
+// Accounts overlap: every cv::Mat allocation counts towards Mats, including the Mats behind the
+// capture and the style images.
+//
+class MemoryAccounting {
+public:
+
+  enum class Subsystem {
+    OrtCpuArena,    // ORT allocator stats, when the runtime provides them
+    OrtGpuArena,
+    Mats,           // cv::Mat heap, through the counting allocator
+    Capture,        // the captured frame, stylized in place
+    StyleImages,    // style images not backed by the mapped library
+    StyleBlobs,     // materialized style tensors and the blend mix
+    Textures,       // thumbnail atlas pages
+    Count
+  };
+
+  class Account {
+  public:
+    void add(size_t bytes);
+    void sub(size_t bytes);
+    void set(size_t bytes);
+
+    // for sources that track their own peak
+    void raisePeak(size_t bytes);
+
+    size_t bytes() const { return m_Bytes.load(std::memory_order_relaxed); }
+    size_t peak() const { return m_Peak.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<size_t> m_Bytes = 0;
+    std::atomic<size_t> m_Peak = 0;
+  };
+
+  static MemoryAccounting& instance();
+
+  MemoryAccounting(const MemoryAccounting&) = delete;
+  MemoryAccounting(MemoryAccounting&&) = delete;
+
+  MemoryAccounting& operator=(const MemoryAccounting&) = delete;
+  MemoryAccounting& operator=(MemoryAccounting&&) = delete;
+
+  virtual ~MemoryAccounting() = default;
+
+  Account& get(Subsystem subsystem) { return m_Accounts[static_cast<int>(subsystem)]; }
+  const Account& get(Subsystem subsystem) const { return m_Accounts[static_cast<int>(subsystem)]; }
+
+  static const char* getName(Subsystem subsystem);
+  static const char* getKey(Subsystem subsystem);  // for exported metrics, e.g. ort_cpu_arena
+
+  // Makes every cv::Mat allocated from now on count towards Mats. Call once, before the first Mats.
+  static void installMatAllocator();
+
+private:
+
+  MemoryAccounting() = default;
+
+  std::array<Account, static_cast<int>(Subsystem::Count)> m_Accounts;
+};
\ No newline at end of file
@@ -0,0 +1,347 @@
+#include "MetricsExporter.h"
+
+// before anything pulls in windows.h (and with it the old winsock.h)
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+#include "Inference.h"
+#include "MemoryAccounting.h"
+#include "PerformanceMetrics.h"
+#include "ProcessMemory.h"
+#include "StyleImageCache.h"
+
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+#ifdef _WIN32
+  using Socket = SOCKET;
+#else
+  using Socket = int;
+#endif
+
+  const auto SamplePeriod = std::chrono::seconds(1);
+
+  // samples waiting for the writer, at most
+  const size_t MaxQueued = 16;
+
+  const char* JsonlPath = "metrics.jsonl";
+  const char* JsonlRotatedPath = "metrics.1.jsonl";
+  const size_t JsonlMaxBytes = 8 * 1024 * 1024;
+
+  const char* PrometheusPath = "metrics.prom";
+
+  const char* StatsdHost = "127.0.0.1";
+  const unsigned short StatsdPort = 8125;
+  const size_t MaxDatagram = 1400;  // fits an Ethernet MTU
+
+  const uintptr_t InvalidSocket = ~uintptr_t(0);
+
+
+  // The writer's part of the snapshot
+  void Summarize(const PerfMetrics& metrics, MetricsSnapshot& snapshot) {
+    for (int i = 0; i < static_cast<int>(PerfMetrics::Stage::Count); i++) {
+      snapshot.stages[i] = metrics.infRun(static_cast<PerfMetrics::Stage>(i)).window();
+    }
+
+    snapshot.frameLatency = metrics.frameLatency().window();
+    snapshot.capture = metrics.captureTime().window();
+    snapshot.frames = metrics.frameCounts();
+    snapshot.process = QueryProcessMemory();
+
+    const auto& accounting = MemoryAccounting::instance();
+    snapshot.accounts.clear();
+
+    for (int i = 0; i < static_cast<int>(MemoryAccounting::Subsystem::Count); i++) {
+      auto subsystem = static_cast<MemoryAccounting::Subsystem>(i);
+      snapshot.accounts.push_back({ MemoryAccounting::getKey(subsystem), accounting.get(subsystem).bytes(), accounting.get(subsystem).peak() });
+    }
+  }
+}
+
+
+
+MetricsExporter::MetricsExporter(PerfMetrics* metrics) : m_Metrics{ metrics } {
+#ifdef _WIN32
+  WSADATA wsa;
+  WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+
+  m_Writer = std::thread(&MetricsExporter::writerLoop, this);
+}
+
+
+
+MetricsExporter::~MetricsExporter() {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stop = true;
+  }
+
+  m_Work.notify_all();
+  m_Writer.join();
+
+  closeOutputs();
+
+#ifdef _WIN32
+  WSACleanup();
+#endif
+}
+
+
+
+const char* MetricsExporter::getModeName(Mode mode) {
+  switch (mode) {
+    case Mode::Off: return "Off";
+    case Mode::Jsonl: return "JSONL file";
+    case Mode::Statsd: return "statsd (UDP)";
+    case Mode::Prometheus: return "Prometheus file";
+    default: return "?";
+  }
+}
+
+
+
+void MetricsExporter::setMode(Mode mode) {
+  m_Mode = mode;
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_WriterMode = mode;
+    m_Queue.clear();
+  }
+
+  m_Work.notify_one();
+}
+
+
+
+void MetricsExporter::update(float fps, const Inference& inf, const StyleImageCache& styles) {
+  if (m_Mode == Mode::Off || !m_Metrics) {
+    return;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if (now - m_LastSample < SamplePeriod) {
+    return;
+  }
+
+  m_LastSample = now;
+
+  MetricsSnapshot snapshot;
+  snapshot.time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  snapshot.fps = fps;
+  snapshot.provider = inf.getProvider() == Inference::Provider::GPU ? "GPU" : "CPU";
+  snapshot.quality = inf.getQualityPerfFactor();
+  snapshot.modelTier = inf.getModelTierCount() > 0 ? inf.getModelTierName(inf.getModelTier()) : "";
+
+  const auto& residency = styles.getResidency();
+  snapshot.styleHits = residency.hits;
+  snapshot.styleMisses = residency.misses;
+  snapshot.stylePrefetched = residency.prefetched;
+  snapshot.stylesResident = residency.resident;
+  snapshot.styleBytes = residency.bytes;
+
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    if (m_Queue.size() >= MaxQueued) {
+      m_Queue.pop_front();
+      m_Dropped++;
+    }
+
+    m_Queue.push_back(std::move(snapshot));
+  }
+
+  m_Work.notify_one();
+}
+
+
+
+void MetricsExporter::writerLoop() {
+  Mode openMode = Mode::Off;
+
+  while (true) {
+    MetricsSnapshot snapshot;
+    Mode mode;
+
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Work.wait(lock, [this, openMode] { return m_Stop || !m_Queue.empty() || m_WriterMode != openMode; });
+
+      if (m_Stop) {
+        return;
+      }
+
+      mode = m_WriterMode;
+
+      if (mode != openMode) {
+        closeOutputs();
+        openMode = mode;
+      }
+
+      if (m_Queue.empty()) {
+        continue;
+      }
+
+      snapshot = std::move(m_Queue.front());
+      m_Queue.pop_front();
+    }
+
+    write(mode, snapshot);
+  }
+}
+
+
+
+void MetricsExporter::write(Mode mode, MetricsSnapshot& snapshot) {
+  if (mode == Mode::Off) {
+    return;
+  }
+
+  Summarize(*m_Metrics, snapshot);
+
+  switch (mode) {
+    case Mode::Jsonl: writeJsonl(snapshot); break;
+    case Mode::Statsd: writeStatsd(snapshot); break;
+    case Mode::Prometheus: writePrometheus(snapshot); break;
+    default: return;
+  }
+
+  m_Exported++;
+}
+
+
+
+void MetricsExporter::writeJsonl(const MetricsSnapshot& snapshot) {
+  if (m_File.is_open() && m_FileSize >= JsonlMaxBytes) {
+    m_File.close();
+
+    std::error_code ec;
+    fs::rename(JsonlPath, JsonlRotatedPath, ec);
+  }
+
+  if (!m_File.is_open()) {
+    m_File.open(JsonlPath, std::ios::app);
+
+    if (!m_File) {
+      std::cout << "Failed to open " << JsonlPath << std::endl;
+      return;
+    }
+
+    std::error_code ec;
+    m_FileSize = static_cast<size_t>(fs::file_size(JsonlPath, ec));
+  }
+
+  auto line = FormatMetricsJsonl(snapshot);
+  m_File << line;
+  m_File.flush();
+  m_FileSize += line.size();
+}
+
+
+
+void MetricsExporter::writeStatsd(const MetricsSnapshot& snapshot) {
+  if (m_Socket == InvalidSocket && !openSocket()) {
+    return;
+  }
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(StatsdPort);
+  inet_pton(AF_INET, StatsdHost, &addr.sin_addr);
+
+  for (const auto& datagram : FormatMetricsStatsd(snapshot, MaxDatagram)) {
+    // non-blocking: a full buffer drops the packet rather than waiting
+    sendto(static_cast<Socket>(m_Socket), datagram.data(), static_cast<int>(datagram.size()), 0,
+      reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+  }
+}
+
+
+
+void MetricsExporter::writePrometheus(const MetricsSnapshot& snapshot) {
+  // replaced in one go, a collector never reads half a file
+  auto tmp = std::string(PrometheusPath) + ".tmp";
+
+  {
+    std::ofstream file(tmp, std::ios::trunc);
+    if (!file) {
+      std::cout << "Failed to write " << tmp << std::endl;
+      return;
+    }
+
+    file << FormatMetricsPrometheus(snapshot);
+  }
+
+  std::error_code ec;
+  fs::rename(tmp, PrometheusPath, ec);
+}
+
+
+
+bool MetricsExporter::openSocket() {
+#ifdef _WIN32
+  Socket s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (s == INVALID_SOCKET) {
+    std::cout << "Failed to create the statsd socket" << std::endl;
+    return false;
+  }
+
+  u_long nonBlocking = 1;
+  ioctlsocket(s, FIONBIO, &nonBlocking);
+#else
+  Socket s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (s < 0) {
+    std::cout << "Failed to create the statsd socket" << std::endl;
+    return false;
+  }
+
+  fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+  m_Socket = static_cast<uintptr_t>(s);
+  return true;
+}
+
+
+
+void MetricsExporter::closeSocket() {
+  if (m_Socket == InvalidSocket) {
+    return;
+  }
+
+#ifdef _WIN32
+  closesocket(static_cast<Socket>(m_Socket));
+#else
+  close(static_cast<Socket>(m_Socket));
+#endif
+
+  m_Socket = InvalidSocket;
+}
+
+
+
+void MetricsExporter::closeOutputs() {
+  if (m_File.is_open()) {
+    m_File.close();
+  }
+
+  m_FileSize = 0;
+  closeSocket();
+}
\ No newline at end of file
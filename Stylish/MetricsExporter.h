@@ -0,0 +1,94 @@
+#pragma once
+
+#include "MetricsFormat.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+class Inference;
+class PerfMetrics;
+class StyleImageCache;
+
+//
+// Periodically exports the metrics for monitoring: as JSON lines to a rotating file, as statsd
+// gauges over UDP (localhost), or as a Prometheus text file (for a textfile collector).
+//
+// The UI thread only snapshots what it owns (FPS, style cache counters, settings) into a small
+// bounded queue, oldest dropped when full. A writer thread summarizes the lock-free histograms,
+// formats (MetricsFormat.h) and does the I/O, the socket being non-blocking, so exporting never
+// costs frame time.
+//
+class MetricsExporter {
+public:
+
+  enum class Mode {
+    Off = 0,
+    Jsonl,
+    Statsd,
+    Prometheus,
+    Count
+  };
+
+  MetricsExporter(PerfMetrics* metrics);
+
+  MetricsExporter(const MetricsExporter&) = delete;
+  MetricsExporter(MetricsExporter&&) = delete;
+
+  MetricsExporter& operator=(const MetricsExporter&) = delete;
+  MetricsExporter& operator=(MetricsExporter&&) = delete;
+
+  virtual ~MetricsExporter();
+
+  Mode getMode() const { return m_Mode; }
+  void setMode(Mode mode);
+
+  static const char* getModeName(Mode mode);
+
+  // Call once per frame from the UI thread, queues a sample every period
+  void update(float fps, const Inference& inf, const StyleImageCache& styles);
+
+  uint64_t getExported() const { return m_Exported; }
+  uint64_t getDropped() const { return m_Dropped; }
+
+private:
+
+  PerfMetrics* m_Metrics;
+
+  Mode m_Mode = Mode::Off;
+  std::chrono::steady_clock::time_point m_LastSample;
+
+  std::thread m_Writer;
+  std::mutex m_Mutex;
+  std::condition_variable m_Work;
+  std::deque<MetricsSnapshot> m_Queue;   // the UI thread's part only
+  Mode m_WriterMode = Mode::Off;      // under m_Mutex
+  bool m_Stop = false;
+
+  // writer thread only
+  std::ofstream m_File;
+  size_t m_FileSize = 0;
+  uintptr_t m_Socket = ~uintptr_t(0);  // SOCKET / fd, invalid until opened
+
+  std::atomic<uint64_t> m_Exported = 0;
+  std::atomic<uint64_t> m_Dropped = 0;   // samples the writer didn't keep up with
+
+
+  void writerLoop();
+  void write(Mode mode, MetricsSnapshot& snapshot);
+
+  void writeJsonl(const MetricsSnapshot& snapshot);
+  void writeStatsd(const MetricsSnapshot& snapshot);
+  void writePrometheus(const MetricsSnapshot& snapshot);
+
+  bool openSocket();
+  void closeSocket();
+  void closeOutputs();
+};
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "MetricsFormat.h"
+
+#include <iomanip>
+#include <sstream>
+
+
+namespace {
+  const char* StageNames[] = { "total", "pre", "model", "post" };
+
+
+  std::string Escape(const std::string& str) {
+    std::string escaped;
+
+    for (char c : str) {
+      if (c == '"' || c == '\\') {
+        escaped.push_back('\\');
+      }
+      escaped.push_back(c >= 0 && c < 0x20 ? ' ' : c);
+    }
+
+    return escaped;
+  }
+
+
+
+  void JsonSummary(std::ostream& out, const LatencyHistogram::Summary& s) {
+    out << "{\"count\":" << s.count << ",\"mean\":" << s.mean << ",\"p50\":" << s.p50 << ",\"p90\":" << s.p90
+      << ",\"p99\":" << s.p99 << ",\"max\":" << s.max << "}";
+  }
+
+
+
+  double HitRate(const MetricsSnapshot& s) {
+    auto lookups = s.styleHits + s.styleMisses;
+    return lookups ? static_cast<double>(s.styleHits) / lookups : 0.0;
+  }
+
+
+
+  // A name and value per metric, shared by the statsd and Prometheus formats
+  struct Gauge {
+    std::string name;
+    std::string labels;   // Prometheus only, e.g. stage="total"
+    double value;
+  };
+
+
+  std::vector<Gauge> Gauges(const MetricsSnapshot& s) {
+    std::vector<Gauge> gauges;
+
+    gauges.push_back({ "provider_gpu", "", s.provider == "GPU" ? 1.0 : 0.0 });
+    gauges.push_back({ "quality", "", static_cast<double>(s.quality) });
+
+    auto latency = [&gauges](const std::string& name, const std::string& labels, const LatencyHistogram::Summary& summary) {
+      gauges.push_back({ name + "_p50_ms", labels, summary.p50 });
+      gauges.push_back({ name + "_p90_ms", labels, summary.p90 });
+      gauges.push_back({ name + "_p99_ms", labels, summary.p99 });
+      gauges.push_back({ name + "_max_ms", labels, summary.max });
+    };
+
+    for (int i = 0; i < static_cast<int>(PerfMetrics::Stage::Count); i++) {
+      latency(std::string("inference_") + StageNames[i], std::string("stage=\"") + StageNames[i] + "\"", s.stages[i]);
+    }
+
+    latency("frame_latency", "", s.frameLatency);
+    latency("capture", "", s.capture);
+
+    gauges.push_back({ "fps", "", s.fps });
+    gauges.push_back({ "frames_presented", "", static_cast<double>(s.frames.presented) });
+    gauges.push_back({ "frames_dropped", "", static_cast<double>(s.frames.dropped) });
+    gauges.push_back({ "frames_skipped", "", static_cast<double>(s.frames.skipped) });
+    gauges.push_back({ "frames_reused", "", static_cast<double>(s.frames.reused) });
+
+    gauges.push_back({ "style_hit_rate", "", HitRate(s) });
+
+    gauges.push_back({ "memory_resident_bytes", "", static_cast<double>(s.process.resident) });
+    gauges.push_back({ "memory_private_bytes", "", static_cast<double>(s.process.privateBytes) });
+
+    for (const auto& account : s.accounts) {
+      gauges.push_back({ "memory_" + account.key + "_bytes", "", static_cast<double>(account.bytes) });
+      gauges.push_back({ "memory_" + account.key + "_peak_bytes", "", static_cast<double>(account.peak) });
+    }
+
+    return gauges;
+  }
+}
+
+
+
+std::string FormatMetricsJsonl(const MetricsSnapshot& s) {
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(3);
+
+  line << "{\"time\":" << s.time << ",\"fps\":" << s.fps
+    << ",\"provider\":\"" << s.provider << "\",\"quality\":" << s.quality
+    << ",\"modelTier\":\"" << Escape(s.modelTier) << "\"";
+
+  line << ",\"inference\":{";
+  for (int i = 0; i < static_cast<int>(PerfMetrics::Stage::Count); i++) {
+    line << (i ? "," : "") << "\"" << StageNames[i] << "\":";
+    JsonSummary(line, s.stages[i]);
+  }
+  line << "}";
+
+  line << ",\"frames\":{\"latency\":";
+  JsonSummary(line, s.frameLatency);
+  line << ",\"capture\":";
+  JsonSummary(line, s.capture);
+  line << ",\"presented\":" << s.frames.presented << ",\"dropped\":" << s.frames.dropped
+    << ",\"skipped\":" << s.frames.skipped << ",\"reused\":" << s.frames.reused << "}";
+
+  line << ",\"styles\":{\"hits\":" << s.styleHits << ",\"misses\":" << s.styleMisses
+    << ",\"hitRate\":" << HitRate(s)
+    << ",\"prefetched\":" << s.stylePrefetched << ",\"resident\":" << s.stylesResident
+    << ",\"bytes\":" << s.styleBytes << "}";
+
+  line << ",\"memory\":{\"resident\":" << s.process.resident << ",\"private\":" << s.process.privateBytes;
+
+  for (const auto& account : s.accounts) {
+    line << ",\"" << account.key << "\":{\"bytes\":" << account.bytes << ",\"peak\":" << account.peak << "}";
+  }
+
+  line << "}}\n";
+
+  return line.str();
+}
+
+
+
+std::vector<std::string> FormatMetricsStatsd(const MetricsSnapshot& snapshot, size_t maxDatagram) {
+  std::vector<std::string> datagrams;
+  std::string datagram;
+
+  for (const auto& gauge : Gauges(snapshot)) {
+    std::ostringstream line;
+    line << "stylish." << gauge.name << ":" << gauge.value << "|g\n";
+
+    if (!datagram.empty() && datagram.size() + line.str().size() > maxDatagram) {
+      datagrams.push_back(std::move(datagram));
+      datagram.clear();
+    }
+
+    datagram += line.str();
+  }
+
+  if (!datagram.empty()) {
+    datagrams.push_back(std::move(datagram));
+  }
+
+  return datagrams;
+}
+
+
+
+std::string FormatMetricsPrometheus(const MetricsSnapshot& snapshot) {
+  std::ostringstream text;
+  text << "stylish_info{provider=\"" << snapshot.provider << "\",model=\"" << Escape(snapshot.modelTier) << "\"} 1\n";
+
+  for (const auto& gauge : Gauges(snapshot)) {
+    text << "stylish_" << gauge.name;
+    if (!gauge.labels.empty()) {
+      text << "{" << gauge.labels << "}";
+    }
+    text << " " << gauge.value << "\n";
+  }
+
+  return text.str();
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "LatencyHistogram.h"
+#include "PerformanceMetrics.h"
+#include "ProcessMemory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+//
+// The text MetricsExporter exports, kept apart from its threads and I/O: a snapshot in, the JSON
+// line, statsd datagrams or Prometheus file out.
+//
+struct MetricsSnapshot {
+  struct Account {
+    std::string key;      // e.g. ort_cpu_arena
+    size_t bytes = 0;
+    size_t peak = 0;
+  };
+
+  // What only the UI thread may read, sampled there
+  int64_t time = 0;                 // ms since the epoch
+  float fps = 0.0f;
+  std::string provider;
+  int quality = 0;
+  std::string modelTier;
+  uint64_t styleHits = 0;
+  uint64_t styleMisses = 0;
+  uint64_t stylePrefetched = 0;
+  int stylesResident = 0;
+  size_t styleBytes = 0;
+
+  // The rest, summarized by the writer
+  LatencyHistogram::Summary stages[static_cast<int>(PerfMetrics::Stage::Count)];
+  LatencyHistogram::Summary frameLatency;
+  LatencyHistogram::Summary capture;
+  PerfMetrics::FrameCounts frames;
+  ProcessMemory process;
+  std::vector<Account> accounts;
+};
+
+// One line, newline included
+std::string FormatMetricsJsonl(const MetricsSnapshot& snapshot);
+
+// "stylish.name:value|g" gauges, packed into datagrams of at most maxDatagram bytes
+std::vector<std::string> FormatMetricsStatsd(const MetricsSnapshot& snapshot, size_t maxDatagram);
+
+// The whole text file, an info line then a "stylish_name{labels} value" line per gauge
+std::string FormatMetricsPrometheus(const MetricsSnapshot& snapshot);
\ No newline at end of file
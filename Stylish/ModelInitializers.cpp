@@ -0,0 +1,298 @@
+#include "ModelInitializers.h"
+
+#include <cstring>
+#include <iostream>
+#include <new>
+
+
+namespace {
+  constexpr size_t Alignment = 64;
+
+  // ONNX protobuf field numbers
+  constexpr uint32_t ModelProtoGraph = 7;
+  constexpr uint32_t GraphProtoInitializer = 5;
+  constexpr uint32_t TensorProtoDims = 1;
+  constexpr uint32_t TensorProtoDataType = 2;
+  constexpr uint32_t TensorProtoName = 8;
+  constexpr uint32_t TensorProtoRawData = 9;
+  constexpr uint32_t TensorProtoDataLocation = 14;
+
+  // ORT format models are flatbuffers with this file identifier
+  constexpr char OrtFormatIdentifier[] = "ORTM";
+
+  // Minimal protobuf wire format reader
+  class ProtoReader {
+  public:
+    ProtoReader(const uint8_t* data, size_t size) : m_Pos{ data }, m_End{ data + size } {}
+
+    bool done() const { return m_Pos >= m_End; }
+
+    bool varint(uint64_t& value) {
+      value = 0;
+      for (int shift = 0; shift < 64 && m_Pos < m_End; shift += 7) {
+        uint8_t b = *m_Pos++;
+        value |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool key(uint32_t& field, uint32_t& wireType) {
+      uint64_t k;
+      if (!varint(k)) {
+        return false;
+      }
+      field = static_cast<uint32_t>(k >> 3);
+      wireType = static_cast<uint32_t>(k & 0x7);
+      return true;
+    }
+
+    bool bytes(const uint8_t*& data, size_t& size) {
+      uint64_t len;
+      if (!varint(len) || len > static_cast<uint64_t>(m_End - m_Pos)) {
+        return false;
+      }
+      data = m_Pos;
+      size = static_cast<size_t>(len);
+      m_Pos += size;
+      return true;
+    }
+
+    bool skip(uint32_t wireType) {
+      uint64_t v;
+      const uint8_t* data;
+      size_t size;
+
+      switch (wireType) {
+        case 0: return varint(v);
+        case 1: return advance(8);
+        case 2: return bytes(data, size);
+        case 5: return advance(4);
+        default: return false; // groups are not used by ONNX
+      }
+    }
+
+  private:
+    const uint8_t* m_Pos;
+    const uint8_t* m_End;
+
+    bool advance(size_t n) {
+      if (n > static_cast<size_t>(m_End - m_Pos)) {
+        return false;
+      }
+      m_Pos += n;
+      return true;
+    }
+  };
+
+
+  size_t ElementSize(int32_t dataType) {
+    // ONNX TensorProto.DataType values match ONNXTensorElementDataType
+    switch (dataType) {
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: return 4;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8: return 1;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8: return 1;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16: return 2;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16: return 2;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32: return 4;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64: return 8;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL: return 1;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16: return 2;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE: return 8;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32: return 4;
+      case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64: return 8;
+      default: return 0;
+    }
+  }
+
+
+  struct TensorView {
+    std::string name;
+    std::vector<int64_t> dims;
+    int32_t dataType = 0;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    bool external = false;
+  };
+
+
+  bool ParseTensor(const uint8_t* data, size_t size, TensorView& tensor) {
+    ProtoReader reader(data, size);
+
+    while (!reader.done()) {
+      uint32_t field, wireType;
+      if (!reader.key(field, wireType)) {
+        return false;
+      }
+
+      uint64_t v;
+      const uint8_t* bytes;
+      size_t len;
+
+      if (field == TensorProtoDims && wireType == 0) {
+        if (!reader.varint(v)) return false;
+        tensor.dims.push_back(static_cast<int64_t>(v));
+      }
+      else if (field == TensorProtoDims && wireType == 2) { // packed
+        if (!reader.bytes(bytes, len)) return false;
+        ProtoReader packed(bytes, len);
+        while (!packed.done()) {
+          if (!packed.varint(v)) return false;
+          tensor.dims.push_back(static_cast<int64_t>(v));
+        }
+      }
+      else if (field == TensorProtoDataType && wireType == 0) {
+        if (!reader.varint(v)) return false;
+        tensor.dataType = static_cast<int32_t>(v);
+      }
+      else if (field == TensorProtoName && wireType == 2) {
+        if (!reader.bytes(bytes, len)) return false;
+        tensor.name.assign(reinterpret_cast<const char*>(bytes), len);
+      }
+      else if (field == TensorProtoRawData && wireType == 2) {
+        if (!reader.bytes(bytes, len)) return false;
+        tensor.data = bytes;
+        tensor.size = len;
+      }
+      else if (field == TensorProtoDataLocation && wireType == 0) {
+        if (!reader.varint(v)) return false;
+        tensor.external = v == 1;
+      }
+      else if (!reader.skip(wireType)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+
+  bool IsOrtFormat(const uint8_t* data, size_t size) {
+    return size >= 8 && memcmp(data + 4, OrtFormatIdentifier, 4) == 0;
+  }
+
+
+  bool FindGraph(const uint8_t* data, size_t size, const uint8_t*& graph, size_t& graphSize) {
+    ProtoReader reader(data, size);
+
+    while (!reader.done()) {
+      uint32_t field, wireType;
+      if (!reader.key(field, wireType)) {
+        return false;
+      }
+
+      if (field == ModelProtoGraph && wireType == 2) {
+        return reader.bytes(graph, graphSize);
+      }
+
+      if (!reader.skip(wireType)) {
+        return false;
+      }
+    }
+
+    return false;
+  }
+}
+
+
+
+void ModelInitializers::AlignedDeleter::operator()(uint8_t* p) const {
+  ::operator delete(p, std::align_val_t{ Alignment });
+}
+
+
+
+ModelInitializers::ModelInitializers(const void* modelData, size_t size, bool modelDataOutlives) : m_ModelDataOutlives{ modelDataOutlives } {
+  m_MemoryInfo = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault);
+
+  // the runtime reads the weights of an ORT format model straight from its bytes, see addTo()
+  if (IsOrtFormat(static_cast<const uint8_t*>(modelData), size)) {
+    m_OrtFormat = true;
+
+    if (modelDataOutlives) {
+      m_Bytes = size;
+    }
+    return;
+  }
+
+  const uint8_t* graph = nullptr;
+  size_t graphSize = 0;
+
+  if (!FindGraph(static_cast<const uint8_t*>(modelData), size, graph, graphSize)) {
+    std::cout << "Failed to parse model: initializers won't be shared between sessions.\n";
+    return;
+  }
+
+  ProtoReader reader(graph, graphSize);
+
+  while (!reader.done()) {
+    uint32_t field, wireType;
+    if (!reader.key(field, wireType)) {
+      break;
+    }
+
+    if (field != GraphProtoInitializer || wireType != 2) {
+      if (!reader.skip(wireType)) {
+        break;
+      }
+      continue;
+    }
+
+    const uint8_t* bytes;
+    size_t len;
+    if (!reader.bytes(bytes, len)) {
+      break;
+    }
+
+    TensorView tensor;
+    if (!ParseTensor(bytes, len, tensor) || tensor.external || tensor.name.empty() || !tensor.data) {
+      continue;
+    }
+
+    size_t elemSize = ElementSize(tensor.dataType);
+    size_t elemCount = 1;
+    for (auto d : tensor.dims) {
+      elemCount *= static_cast<size_t>(d);
+    }
+
+    if (elemSize == 0 || elemCount * elemSize != tensor.size || tensor.size == 0) {
+      continue;
+    }
+
+    // protobuf gives no alignment guarantees, copy whatever is unaligned (or doesn't outlive us)
+    auto* data = const_cast<uint8_t*>(tensor.data);
+
+    if (!modelDataOutlives || reinterpret_cast<uintptr_t>(data) % Alignment != 0) {
+      auto* copy = static_cast<uint8_t*>(::operator new(tensor.size, std::align_val_t{ Alignment }));
+      memcpy(copy, data, tensor.size);
+      m_Copies.emplace_back(copy);
+
+      data = copy;
+      m_CopiedBytes += tensor.size;
+    }
+
+    try {
+      m_Values.push_back(Ort::Value::CreateTensor(m_MemoryInfo, data, tensor.size, tensor.dims.data(), tensor.dims.size(),
+        static_cast<ONNXTensorElementDataType>(tensor.dataType)));
+      m_Names.push_back(tensor.name);
+      m_Bytes += tensor.size;
+    } catch (Ort::Exception& oe) {
+      std::cout << "ONNX exception caught: " << oe.what() << ". Code: " << oe.GetOrtErrorCode() << ".\n";
+    }
+  }
+}
+
+
+
+void ModelInitializers::addTo(Ort::SessionOptions& options) const {
+  if (m_OrtFormat && m_ModelDataOutlives) {
+    options.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+    options.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+  }
+
+  for (size_t i = 0; i < m_Values.size(); i++) {
+    options.AddInitializer(m_Names[i].c_str(), m_Values[i]);
+  }
+}
\ No newline at end of file
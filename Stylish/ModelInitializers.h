@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+
+//
+// The model's (top-level graph) initializers as OrtValues that can be added to any number of
+// session options, so every session reads the same weights instead of keeping its own copy.
+// Only initializers stored inline as raw data are picked up, the rest stay with the model.
+//
+// ONNX protobuf gives raw data no alignment, so most tensors end up copied (see getCopiedBytes()):
+// those weights are shared between the sessions but private to the process. ORT format models
+// (.ort) are not parsed: their sessions read every weight in place from the model bytes instead.
+//
+class ModelInitializers {
+public:
+
+  // If modelDataOutlives is true, suitably aligned tensors point straight into the model bytes,
+  // which must then remain valid for the lifetime of this object and every session using it.
+  ModelInitializers(const void* modelData, size_t size, bool modelDataOutlives);
+
+  ModelInitializers(const ModelInitializers&) = delete;
+  ModelInitializers(ModelInitializers&&) = delete;
+
+  ModelInitializers& operator=(const ModelInitializers&) = delete;
+  ModelInitializers& operator=(ModelInitializers&&) = delete;
+
+  void addTo(Ort::SessionOptions& options) const;
+
+  size_t getCount() const { return m_Names.size(); }
+  size_t getBytes() const { return m_Bytes; }               // of an ORT format model, the whole model
+  size_t getCopiedBytes() const { return m_CopiedBytes; }   // out of getBytes(), held in private memory
+
+  bool isOrtFormat() const { return m_OrtFormat; }
+
+private:
+
+  struct AlignedDeleter {
+    void operator()(uint8_t* p) const;
+  };
+
+  Ort::MemoryInfo m_MemoryInfo{ nullptr };
+
+  std::vector<std::string> m_Names;
+  std::vector<Ort::Value> m_Values;
+
+  // copies of tensors that could not be referenced in place
+  std::vector<std::unique_ptr<uint8_t, AlignedDeleter>> m_Copies;
+
+  size_t m_Bytes = 0;
+  size_t m_CopiedBytes = 0;
+
+  bool m_OrtFormat = false;
+  bool m_ModelDataOutlives = false;
+};
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "ModelManifest.h"
+
+#include <fstream>
+#include <iostream>
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+  std::string Trim(const std::string& str) {
+    auto begin = str.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+      return {};
+    }
+
+    auto end = str.find_last_not_of(" \t\r\n");
+    return str.substr(begin, end - begin + 1);
+  }
+}
+
+
+
+bool ModelManifest::load(const fs::path& path) {
+  m_Entries.clear();
+
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+
+  std::string line;
+  int lineNo = 0;
+
+  while (std::getline(file, line)) {
+    lineNo++;
+
+    line = Trim(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    auto split = line.find_first_of(" \t");
+    if (split == std::string::npos) {
+      std::cout << path.string() << ":" << lineNo << ": expected <name> <file>" << std::endl;
+      continue;
+    }
+
+    Entry entry;
+    entry.name = line.substr(0, split);
+    entry.path = path.parent_path() / fs::u8path(Trim(line.substr(split)));
+
+    m_Entries.push_back(std::move(entry));
+  }
+
+  return !m_Entries.empty();
+}
\ No newline at end of file
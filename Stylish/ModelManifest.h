@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+//
+// The model ladder: stylization networks of increasing size, used as quality tiers.
+//
+// One model per line, lightest first, paths relative to the manifest:
+//
+//   # name  file
+//   lite    arbitrary-image-stylization-lite.onnx
+//   full    arbitrary-image-stylization.onnx
+//
+// Every model must take and produce the same inputs/outputs as the others. ORT format models (.ort)
+// are read in place, weights included, rather than partly copied like ONNX ones.
+//
+class ModelManifest {
+public:
+
+  struct Entry {
+    std::string name;
+    std::filesystem::path path;
+  };
+
+  // Returns false (and keeps no entries) if the manifest is missing or lists no models
+  bool load(const std::filesystem::path& path);
+
+  const std::vector<Entry>& getEntries() const { return m_Entries; }
+
+private:
+  std::vector<Entry> m_Entries;
+};
\ No newline at end of file
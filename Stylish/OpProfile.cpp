@@ -0,0 +1,300 @@
+#include "OpProfile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+
+
+namespace {
+  // Just enough JSON for ORT's profiler output
+  struct Json {
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    double number = 0.0;
+    std::string str;
+    std::vector<Json> items;
+    std::vector<std::pair<std::string, Json>> members;
+
+    const Json* get(const std::string& key) const {
+      for (const auto& [k, v] : members) {
+        if (k == key) {
+          return &v;
+        }
+      }
+      return nullptr;
+    }
+  };
+
+
+  class JsonParser {
+  public:
+    JsonParser(const std::string& text) : m_Text{ text } {}
+
+    bool parse(Json& value) {
+      return parseValue(value, 0);
+    }
+
+  private:
+    const std::string& m_Text;
+    size_t m_Pos = 0;
+
+    static constexpr int MaxDepth = 64;
+
+    void skipWhitespace() {
+      while (m_Pos < m_Text.size() && std::isspace(static_cast<unsigned char>(m_Text[m_Pos]))) {
+        m_Pos++;
+      }
+    }
+
+    bool consume(char c) {
+      skipWhitespace();
+      if (m_Pos < m_Text.size() && m_Text[m_Pos] == c) {
+        m_Pos++;
+        return true;
+      }
+      return false;
+    }
+
+    bool parseValue(Json& value, int depth) {
+      if (depth > MaxDepth) {
+        return false;
+      }
+
+      skipWhitespace();
+      if (m_Pos >= m_Text.size()) {
+        return false;
+      }
+
+      char c = m_Text[m_Pos];
+
+      if (c == '{') {
+        m_Pos++;
+        value.type = Json::Type::Object;
+
+        if (consume('}')) {
+          return true;
+        }
+
+        do {
+          std::string key;
+          skipWhitespace();
+          if (!parseString(key) || !consume(':')) {
+            return false;
+          }
+
+          value.members.emplace_back(std::move(key), Json{});
+          if (!parseValue(value.members.back().second, depth + 1)) {
+            return false;
+          }
+        } while (consume(','));
+
+        return consume('}');
+      }
+
+      if (c == '[') {
+        m_Pos++;
+        value.type = Json::Type::Array;
+
+        if (consume(']')) {
+          return true;
+        }
+
+        do {
+          value.items.emplace_back();
+          if (!parseValue(value.items.back(), depth + 1)) {
+            return false;
+          }
+        } while (consume(','));
+
+        return consume(']');
+      }
+
+      if (c == '"') {
+        value.type = Json::Type::String;
+        return parseString(value.str);
+      }
+
+      if (m_Text.compare(m_Pos, 4, "true") == 0) {
+        value.type = Json::Type::Bool;
+        value.number = 1.0;
+        m_Pos += 4;
+        return true;
+      }
+
+      if (m_Text.compare(m_Pos, 5, "false") == 0) {
+        value.type = Json::Type::Bool;
+        m_Pos += 5;
+        return true;
+      }
+
+      if (m_Text.compare(m_Pos, 4, "null") == 0) {
+        m_Pos += 4;
+        return true;
+      }
+
+      // number
+      const char* begin = m_Text.c_str() + m_Pos;
+      char* end = nullptr;
+      value.number = std::strtod(begin, &end);
+
+      if (end == begin) {
+        return false;
+      }
+
+      value.type = Json::Type::Number;
+      m_Pos += end - begin;
+      return true;
+    }
+
+    bool parseString(std::string& str) {
+      if (m_Pos >= m_Text.size() || m_Text[m_Pos] != '"') {
+        return false;
+      }
+
+      m_Pos++;
+
+      while (m_Pos < m_Text.size()) {
+        char c = m_Text[m_Pos++];
+
+        if (c == '"') {
+          return true;
+        }
+
+        if (c == '\\' && m_Pos < m_Text.size()) {
+          char e = m_Text[m_Pos++];
+          switch (e) {
+            case 'n': str.push_back('\n'); break;
+            case 't': str.push_back('\t'); break;
+            case 'r': str.push_back('\r'); break;
+            case 'b': str.push_back('\b'); break;
+            case 'f': str.push_back('\f'); break;
+            case 'u': m_Pos = std::min(m_Pos + 4, m_Text.size()); str.push_back('?'); break; // not needed for op names
+            default: str.push_back(e); break;
+          }
+        }
+        else {
+          str.push_back(c);
+        }
+      }
+
+      return false;
+    }
+  };
+
+
+  // [{"float":[1,256,256,3]},{"float":[1,256,256,3]}] -> float[1,256,256,3] float[1,256,256,3]
+  std::string DescribeShapes(const Json* shapes) {
+    std::string str;
+
+    if (!shapes || shapes->type != Json::Type::Array) {
+      return str;
+    }
+
+    for (const auto& input : shapes->items) {
+      for (const auto& [type, dims] : input.members) {
+        if (!str.empty()) {
+          str += " ";
+        }
+
+        str += type + "[";
+        for (size_t i = 0; i < dims.items.size(); i++) {
+          str += (i ? "," : "") + std::to_string(static_cast<long long>(dims.items[i].number));
+        }
+        str += "]";
+      }
+    }
+
+    return str;
+  }
+}
+
+
+
+bool OpProfile::load(const std::string& path, int frames) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::cout << "Failed to open profile " << path << std::endl;
+    return false;
+  }
+
+  std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  Json root;
+  if (!JsonParser(text).parse(root) || root.type != Json::Type::Array) {
+    std::cout << "Failed to parse profile " << path << std::endl;
+    return false;
+  }
+
+  std::map<std::pair<std::string, std::string>, Op> ops;
+  float totalMs = 0.0f;
+
+  for (const auto& event : root.items) {
+    const auto* cat = event.get("cat");
+    const auto* name = event.get("name");
+    const auto* dur = event.get("dur");
+    const auto* args = event.get("args");
+
+    if (!cat || cat->str != "Node" || !name || !dur || !args) {
+      continue;
+    }
+
+    // ignore the fence events, only the kernel time is interesting
+    const std::string suffix = "_kernel_time";
+    if (name->str.size() < suffix.size() || name->str.compare(name->str.size() - suffix.size(), suffix.size(), suffix) != 0) {
+      continue;
+    }
+
+    const auto* opName = args->get("op_name");
+    if (!opName) {
+      continue;
+    }
+
+    auto shapes = DescribeShapes(args->get("input_type_shape"));
+    auto& op = ops[{ opName->str, shapes }];
+
+    float ms = static_cast<float>(dur->number / 1000.0);
+
+    op.type = opName->str;
+    op.shapes = shapes;
+    op.totalMs += ms;
+    op.calls++;
+
+    totalMs += ms;
+  }
+
+  m_Ops.clear();
+  for (auto& [_, op] : ops) {
+    m_Ops.push_back(std::move(op));
+  }
+
+  std::sort(m_Ops.begin(), m_Ops.end(), [](const Op& a, const Op& b) { return a.totalMs > b.totalMs; });
+
+  m_TotalMs = totalMs;
+  m_Frames = std::max(1, frames);
+  m_TracePath = path;
+
+  return true;
+}
+
+
+
+bool OpProfile::exportCsv(const std::string& path) const {
+  std::ofstream file(path);
+  if (!file) {
+    return false;
+  }
+
+  file << "op,input_shapes,calls,total_ms,ms_per_frame,percent\n";
+
+  for (const auto& op : m_Ops) {
+    file << op.type << ",\"" << op.shapes << "\"," << op.calls << "," << op.totalMs << ","
+      << op.totalMs / m_Frames << "," << (m_TotalMs > 0.0f ? 100.0f * op.totalMs / m_TotalMs : 0.0f) << "\n";
+  }
+
+  return static_cast<bool>(file);
+}
\ No newline at end of file
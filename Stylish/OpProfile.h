@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+//
+// Per-operator timings aggregated from an ONNX Runtime profiling trace (chrome trace JSON).
+// Kernel times are grouped by operator type and input shapes.
+//
+class OpProfile {
+public:
+
+  struct Op {
+    std::string type;     // e.g. Conv
+    std::string shapes;   // input shapes, e.g. float[1,256,256,3]
+    float totalMs = 0.0f; // over all profiled frames
+    int calls = 0;
+  };
+
+  bool load(const std::string& path, int frames);
+
+  bool exportCsv(const std::string& path) const;
+
+  // sorted by total time, descending
+  const std::vector<Op>& getOps() const { return m_Ops; }
+
+  float getTotalMs() const { return m_TotalMs; }
+  int getFrames() const { return m_Frames; }
+  const std::string& getTracePath() const { return m_TracePath; }
+
+private:
+  std::vector<Op> m_Ops;
+  float m_TotalMs = 0.0f;
+  int m_Frames = 0;
+  std::string m_TracePath;
+};
\ No newline at end of file
@@ -1,31 +1,36 @@
 #include "PerformanceMetrics.h"
 
-
-namespace {
-  int SampleCount = 100;
-}
+#include <algorithm>
 
 
+void PerfMetrics::collectInfRun(const std::vector<float>& metrics) {
+  auto count = std::min(metrics.size(), m_InfRun.size());
 
-PerfMetrics::PerfMetrics() {
-  m_InfRun = std::vector<float>(4, 0.0f);
-  m_Samples = std::vector<std::vector<float>>(4, std::vector<float>(SampleCount, 0.0f));
+  for (size_t i = 0; i < count; i++) {
+    m_InfRun[i].record(metrics[i]);
+  }
 }
 
 
 
-void PerfMetrics::collectInfRun(const std::vector<float>& metrics) {
-  for (int i = 0; i < 4; i++) {
-    m_InfRun[i] += metrics[i] - m_Samples[i][m_Index];
-    m_Samples[i][m_Index] = metrics[i];
-  }
+void PerfMetrics::collectFramePresented(float latencyMs, uint64_t dropped, bool stylized) {
+  m_FrameLatency.record(latencyMs);
 
-  m_Index = (m_Index + 1) % SampleCount;
+  m_FramesPresented.add();
+  m_FramesDropped.add(dropped);
+
+  if (!stylized) {
+    m_FramesSkipped.add();
+  }
 }
 
 
 
-float PerfMetrics::infRunTotal() const { return m_InfRun[0] / SampleCount; }
-float PerfMetrics::infRunPre() const { return m_InfRun[1] / SampleCount; }
-float PerfMetrics::infRunModel() const { return m_InfRun[2] / SampleCount; }
-float PerfMetrics::infRunPost() const { return m_InfRun[3] / SampleCount; }
\ No newline at end of file
+PerfMetrics::FrameCounts PerfMetrics::frameCounts() const {
+  FrameCounts counts;
+  counts.presented = m_FramesPresented.get();
+  counts.dropped = m_FramesDropped.get();
+  counts.skipped = m_FramesSkipped.get();
+  counts.reused = m_FramesReused.get();
+  return counts;
+}
\ No newline at end of file
@@ -1,30 +1,80 @@
 #pragma once
 
+#include "Instrumentation.h"
+#include "LatencyHistogram.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
 #include <vector>
 
 
+//
+// Sink of the instrumentation probes. Always present; nothing is collected while Instrumentation
+// is disabled, apart from one-off startup numbers.
+//
 class PerfMetrics {
 public:
 
-  PerfMetrics();
+  struct SessionMemory {
+    int sessions = 0;
+    size_t bytes = 0;               // measured cost of all sessions
+    size_t unsharedEstimate = 0;    // what they would cost if each loaded its own weights
+    size_t sharedInitializers = 0;  // weights shared by all sessions
+    size_t copiedInitializers = 0;  // out of those, copied out of the mapped model into private memory
+  };
+
+  enum class Stage { Total, Pre, Model, Post, Count };
+
+  // What happened to captured frames, counted at present
+  struct FrameCounts {
+    uint64_t presented = 0;
+    uint64_t dropped = 0;   // replaced by a newer capture before they were presented
+    uint64_t skipped = 0;   // presented without stylization (inference off or busy resizing)
+    uint64_t reused = 0;    // repaints of an already presented frame
+  };
+
+  PerfMetrics() = default;
 
   float infStart() const { return m_InfStart; }
-  
-  // note: values in the beginning will be inacurate while buffer fills up 
-  float infRunTotal() const;
-  float infRunPre() const;
-  float infRunModel() const;
-  float infRunPost() const;
+
+  // lock-free, runs may be collected from several threads while the UI reads
+  const LatencyHistogram& infRun(Stage stage) const { return m_InfRun[static_cast<int>(stage)]; }
 
   // metrics - total, pre, model, post
   void collectInfStart(float startTime) { m_InfStart = startTime; }
   void collectInfRun(const std::vector<float>& metrics);
 
+  // Age of the pixels on screen: capture to present
+  const LatencyHistogram& frameLatency() const { return m_FrameLatency; }
+  FrameCounts frameCounts() const;
+
+  void collectFramePresented(float latencyMs, uint64_t dropped, bool stylized);
+  void collectFrameReused() { m_FramesReused.add(); }
+
+  // Copying a capture out of the magnifier's buffer
+  LatencyHistogram& captureTime() { return m_CaptureTime; }
+  const LatencyHistogram& captureTime() const { return m_CaptureTime; }
+
+  SessionMemory sessionMemory() const { std::lock_guard<std::mutex> lock(m_Mutex); return m_SessionMemory; }
+  void collectSessionMemory(const SessionMemory& mem) { std::lock_guard<std::mutex> lock(m_Mutex); m_SessionMemory = mem; }
+
 private:
 
-  float m_InfStart = 0.0f;
+  std::atomic<float> m_InfStart = 0.0f;
+
+  SessionMemory m_SessionMemory;
+  mutable std::mutex m_Mutex;
+
+  std::array<LatencyHistogram, static_cast<int>(Stage::Count)> m_InfRun;
+
+  LatencyHistogram m_FrameLatency;
+  Instrumentation::Counter m_FramesPresented;
+  Instrumentation::Counter m_FramesDropped;
+  Instrumentation::Counter m_FramesSkipped;
+  Instrumentation::Counter m_FramesReused;
 
-  std::vector<float> m_InfRun;
-  std::vector<std::vector<float>> m_Samples;
-  int m_Index = 0;
+  LatencyHistogram m_CaptureTime;
 };
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "Pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+
+cv::Size ModelInputSize(cv::Size frame, int quality, int maxQuality) {
+  double factor = 1.0 / pow(2, maxQuality - quality);
+
+  int width = static_cast<int>(round(frame.width * factor)) & ~3;
+  int height = static_cast<int>(round(frame.height * factor)) & ~3;
+
+  return { width, height };
+}
+
+
+
+void PrepareModelInput(const cv::Mat& frame, cv::Size size, cv::Mat& nnInput) {
+  cv::resize(frame, nnInput, size, cv::INTER_AREA);
+
+  if (nnInput.channels() == 4) {
+    cv::cvtColor(nnInput, nnInput, cv::COLOR_BGRA2BGR);
+  }
+
+  nnInput.convertTo(nnInput, CV_32FC3, 1.0 / 255.0);
+}
+
+
+
+void FinishModelOutput(const cv::Mat& outputNN, int channels, cv::Size size, cv::Mat& output) {
+  cv::Mat output8U;
+  outputNN.convertTo(output8U, CV_8UC3, 255.0);
+
+  if (channels == 4) {
+    cv::cvtColor(output8U, output8U, cv::COLOR_BGR2BGRA);
+  }
+
+  cv::resize(output8U, output, size, cv::INTER_CUBIC); // TODO INTER_LINEAR as user-configurable option
+}
+
+
+
+void MakeStyleContent(const cv::Mat& frame, cv::Size styleSize, cv::Mat& content) {
+  cv::resize(frame, content, styleSize, 0, 0, cv::INTER_AREA);
+
+  if (content.channels() == 4) {
+    cv::cvtColor(content, content, cv::COLOR_BGRA2BGR);
+  }
+
+  content.convertTo(content, CV_32FC3, 1.0 / 255.0);
+}
+
+
+
+void MixStyle(const cv::Mat& style, const cv::Mat& content, float weight, cv::Mat& mixed) {
+  cv::addWeighted(style, weight, content, 1.0 - weight, 0.0, mixed);
+}
+
+
+
+void FitStyleImage(const cv::Mat& decoded, cv::Size size, cv::Mat& image) {
+  int side = std::min(decoded.cols, decoded.rows);
+  cv::Mat square = decoded(cv::Rect((decoded.cols - side) / 2, (decoded.rows - side) / 2, side, side));
+
+  cv::resize(square, image, size, cv::INTER_AREA);
+}
+
+
+
+void MakeStyleBlob(const cv::Mat& image, std::vector<float>& blob) {
+  blob.resize(static_cast<size_t>(image.cols) * image.rows * 3);
+
+  cv::Mat blobMat(image.rows, image.cols, CV_32FC3, blob.data());
+  image.convertTo(blobMat, CV_32FC3, 1.0 / 255.0);
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+
+//
+// The pixel work around the model, one function per step, shared by Inference, StyleImageCache and
+// the benchmarks (stylish-bench times these very functions). Frames are 8-bit BGR or BGRA, the model
+// takes and returns BGR floats in [0, 1].
+//
+
+// The model input size at a quality factor: halved per step below maxQuality, rounded down to multiples of 4
+cv::Size ModelInputSize(cv::Size frame, int quality, int maxQuality);
+
+// Frame -> model input at the given size. Alpha is dropped at model size, a fraction of the full frame.
+void PrepareModelInput(const cv::Mat& frame, cv::Size size, cv::Mat& nnInput);
+
+// Model output -> frame size, with the given number of channels (alpha restored at model size)
+void FinishModelOutput(const cv::Mat& outputNN, int channels, cv::Size size, cv::Mat& output);
+
+// Frame -> content image mixed into the style image, at style size
+void MakeStyleContent(const cv::Mat& frame, cv::Size styleSize, cv::Mat& content);
+
+// weight * style + (1 - weight) * content, all CV_32FC3 at style size
+void MixStyle(const cv::Mat& style, const cv::Mat& content, float weight, cv::Mat& mixed);
+
+// Decoded style image -> the 8-bit style tensor kept in the library: centre square, resized
+void FitStyleImage(const cv::Mat& decoded, cv::Size size, cv::Mat& image);
+
+// 8-bit style image -> the model's style input. The blob is HWC like a continuous CV_32FC3 image.
+void MakeStyleBlob(const cv::Mat& image, std::vector<float>& blob);
\ No newline at end of file
@@ -0,0 +1,32 @@
+#include "ProcessMemory.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fstream>
+#include <unistd.h>
+#endif
+
+
+ProcessMemory QueryProcessMemory() {
+  ProcessMemory mem;
+
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS_EX pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&pmc), sizeof(pmc))) {
+    mem.resident = pmc.WorkingSetSize;
+    mem.privateBytes = pmc.PrivateUsage;
+  }
+#else
+  std::ifstream statm("/proc/self/statm");
+  size_t size = 0, resident = 0, shared = 0;
+  if (statm >> size >> resident >> shared) {
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    mem.resident = resident * pageSize;
+    mem.privateBytes = (resident - shared) * pageSize;
+  }
+#endif
+
+  return mem;
+}
\ No newline at end of file
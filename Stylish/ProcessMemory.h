@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+
+struct ProcessMemory {
+  size_t resident = 0;      // working set / RSS
+  size_t privateBytes = 0;  // memory not shareable with other processes (commit charge on Windows)
+};
+
+ProcessMemory QueryProcessMemory();
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include "SessionPool.h"
+
+#include "ProcessMemory.h"
+
+#include <algorithm>
+
+
+SessionPool::Lease::~Lease() {
+  if (m_Pool && m_Session) {
+    m_Pool->release(m_Session);
+  }
+}
+
+
+
+SessionPool::Lease::Lease(Lease&& other) noexcept : m_Pool{ other.m_Pool }, m_Session{ other.m_Session } {
+  other.m_Pool = nullptr;
+  other.m_Session = nullptr;
+}
+
+
+
+SessionPool::SessionPool(const Ort::Env& env, const void* modelData, size_t modelSize, const Ort::SessionOptions& options, int size, OrtPrepackedWeightsContainer* prepackedWeights) {
+  size = std::max(1, size);
+
+  for (int i = 0; i < size; i++) {
+    auto before = QueryProcessMemory().privateBytes;
+
+    if (prepackedWeights) {
+      m_Sessions.push_back(std::make_unique<Ort::Session>(env, modelData, modelSize, options, prepackedWeights));
+    }
+    else {
+      m_Sessions.push_back(std::make_unique<Ort::Session>(env, modelData, modelSize, options));
+    }
+
+    auto after = QueryProcessMemory().privateBytes;
+
+    m_SessionBytes.push_back(after > before ? after - before : 0);
+    m_Idle.push_back(m_Sessions.back().get());
+  }
+}
+
+
+
+SessionPool::Lease SessionPool::acquire() {
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  m_Available.wait(lock, [this] { return !m_Idle.empty(); });
+
+  auto* session = m_Idle.back();
+  m_Idle.pop_back();
+
+  return Lease(this, session);
+}
+
+
+
+void SessionPool::release(Ort::Session* session) {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Idle.push_back(session);
+  }
+
+  m_Available.notify_one();
+}
\ No newline at end of file
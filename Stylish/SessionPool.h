@@ -0,0 +1,74 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+
+//
+// A fixed set of sessions over the same model and environment.
+// Callers lease whichever session is idle, so concurrent runs never share a session
+// and no session sits idle while there is work waiting.
+//
+class SessionPool {
+public:
+
+  // Returns its session to the pool when destroyed
+  class Lease {
+  public:
+    Lease(SessionPool* pool, Ort::Session* session) : m_Pool{ pool }, m_Session{ session } {}
+    ~Lease();
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    Lease(Lease&& other) noexcept;
+    Lease& operator=(Lease&& other) = delete;
+
+    Ort::Session* operator->() const { return m_Session; }
+    Ort::Session& operator*() const { return *m_Session; }
+    Ort::Session* get() const { return m_Session; }
+
+  private:
+    SessionPool* m_Pool;
+    Ort::Session* m_Session;
+  };
+
+  // The model bytes must stay valid while the pool exists if the options ask ORT to use them in place
+  SessionPool(const Ort::Env& env, const void* modelData, size_t modelSize, const Ort::SessionOptions& options, int size, OrtPrepackedWeightsContainer* prepackedWeights = nullptr);
+
+  SessionPool(const SessionPool&) = delete;
+  SessionPool(SessionPool&&) = delete;
+
+  SessionPool& operator=(const SessionPool&) = delete;
+  SessionPool& operator=(SessionPool&&) = delete;
+
+  // Blocks until a session is idle
+  Lease acquire();
+
+  int size() const { return static_cast<int>(m_Sessions.size()); }
+
+  // Any session can be used for model introspection (names, shapes)
+  Ort::Session& front() { return *m_Sessions.front(); }
+
+  // For read-only queries (allocator stats), the session may be running meanwhile
+  Ort::Session& at(int index) { return *m_Sessions[index]; }
+
+  // Private bytes each session added to the process when it was created
+  const std::vector<size_t>& getSessionBytes() const { return m_SessionBytes; }
+
+private:
+
+  std::vector<std::unique_ptr<Ort::Session>> m_Sessions;
+  std::vector<size_t> m_SessionBytes;
+
+  std::mutex m_Mutex;
+  std::condition_variable m_Available;
+  std::vector<Ort::Session*> m_Idle;
+
+
+  void release(Ort::Session* session);
+};
\ No newline at end of file
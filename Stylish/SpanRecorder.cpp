@@ -0,0 +1,201 @@
+#include "SpanRecorder.h"
+
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+
+namespace {
+  thread_local uint64_t CurrentFrame = 0;
+
+
+
+  std::string Escape(const std::string& str) {
+    std::string escaped;
+
+    for (char c : str) {
+      if (c == '"' || c == '\\') {
+        escaped.push_back('\\');
+      }
+      escaped.push_back(c >= 0 && c < 0x20 ? ' ' : c);
+    }
+
+    return escaped;
+  }
+}
+
+
+
+SpanRecorder::Scope::Scope(const char* name) : m_Name{ name }, m_Begin{ Instrumentation::isEnabled() ? SpanRecorder::instance().now() : -1 } {
+}
+
+
+
+SpanRecorder::Scope::~Scope() {
+  if (m_Begin >= 0) {
+    auto& recorder = SpanRecorder::instance();
+    recorder.record(m_Name, m_Begin, recorder.now());
+  }
+}
+
+
+
+SpanRecorder& SpanRecorder::instance() {
+  static SpanRecorder recorder;
+  return recorder;
+}
+
+
+
+SpanRecorder::SpanRecorder() : m_Start{ std::chrono::steady_clock::now() } {
+}
+
+
+
+int64_t SpanRecorder::now() const {
+  return toNs(std::chrono::steady_clock::now());
+}
+
+
+
+int64_t SpanRecorder::toNs(std::chrono::steady_clock::time_point time) const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time - m_Start).count();
+}
+
+
+
+void SpanRecorder::setFrame(uint64_t frame) {
+  CurrentFrame = frame;
+}
+
+
+
+uint64_t SpanRecorder::getFrame() {
+  return CurrentFrame;
+}
+
+
+
+SpanRecorder::Ring& SpanRecorder::threadRing() {
+  thread_local Ring* ring = nullptr;
+
+  if (!ring) {
+    std::lock_guard<std::mutex> lock(m_RingsMutex);
+
+    m_Rings.push_back(std::make_unique<Ring>());
+    ring = m_Rings.back().get();
+    ring->thread = static_cast<uint32_t>(m_Rings.size());
+  }
+
+  return *ring;
+}
+
+
+
+void SpanRecorder::nameThread(const std::string& name) {
+  auto& ring = threadRing();
+
+  std::lock_guard<std::mutex> lock(m_RingsMutex);
+  ring.name = name;
+}
+
+
+
+void SpanRecorder::record(const char* name, int64_t beginNs, int64_t endNs) {
+  if (!Instrumentation::isEnabled()) {
+    return;
+  }
+
+  auto& ring = threadRing();
+
+  auto index = ring.written.load(std::memory_order_relaxed);
+  auto& span = ring.spans[index % RingSize];
+
+  span.name.store(name, std::memory_order_relaxed);
+  span.frame.store(CurrentFrame, std::memory_order_relaxed);
+  span.begin.store(beginNs, std::memory_order_relaxed);
+  span.end.store(endNs, std::memory_order_relaxed);
+
+  ring.written.store(index + 1, std::memory_order_release);
+}
+
+
+
+bool SpanRecorder::dump(const std::string& path, float seconds) const {
+  struct Event {
+    const char* name;
+    uint64_t frame;
+    int64_t begin;
+    int64_t end;
+    uint32_t thread;
+  };
+
+  std::vector<Event> events;
+  std::vector<std::pair<uint32_t, std::string>> threads;
+
+  int64_t from = now() - static_cast<int64_t>(seconds * 1e9);
+
+  {
+    std::lock_guard<std::mutex> lock(m_RingsMutex);
+
+    for (const auto& ring : m_Rings) {
+      threads.emplace_back(ring->thread, ring->name.empty() ? "thread " + std::to_string(ring->thread) : ring->name);
+
+      auto written = ring->written.load(std::memory_order_acquire);
+      auto first = written > RingSize ? written - RingSize : 0;
+      auto copied = events.size();
+
+      for (auto i = first; i < written; i++) {
+        const auto& span = ring->spans[i % RingSize];
+        events.push_back({ span.name.load(std::memory_order_relaxed), span.frame.load(std::memory_order_relaxed),
+          span.begin.load(std::memory_order_relaxed), span.end.load(std::memory_order_relaxed), ring->thread });
+      }
+
+      // the thread kept recording meanwhile, drop the slots it may have reused
+      std::atomic_thread_fence(std::memory_order_acquire);
+      auto overwritten = ring->written.load(std::memory_order_relaxed);
+
+      if (overwritten > RingSize && overwritten - RingSize > first) {
+        auto stale = std::min<size_t>(overwritten - RingSize - first, events.size() - copied);
+        events.erase(events.begin() + copied, events.begin() + copied + stale);
+      }
+    }
+  }
+
+  events.erase(std::remove_if(events.begin(), events.end(), [from](const Event& e) { return e.end < from; }), events.end());
+  std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.begin < b.begin; });
+
+  std::ofstream file(path);
+  if (!file) {
+    std::cout << "Failed to write trace " << path << std::endl;
+    return false;
+  }
+
+  // microseconds, keep the nanoseconds
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+  bool first = true;
+
+  for (const auto& [thread, name] : threads) {
+    file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+      << ",\"args\":{\"name\":\"" << Escape(name) << "\"}}";
+    first = false;
+  }
+
+  for (const auto& e : events) {
+    file << (first ? "" : ",\n") << "{\"name\":\"" << Escape(e.name) << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+      << ",\"ts\":" << e.begin / 1000.0 << ",\"dur\":" << (e.end - e.begin) / 1000.0
+      << ",\"args\":{\"frame\":" << e.frame << "}}";
+    first = false;
+  }
+
+  file << "\n]}\n";
+
+  std::cout << "Wrote " << events.size() << " spans to " << path << std::endl;
+
+  return static_cast<bool>(file);
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+//
+// Per-frame pipeline spans (capture, conversions, resizes, the model, blits, UI), for diagnosing
+// stutter. Recorded only while Instrumentation is enabled. Each thread records into its own ring
+// buffer of the latest spans; recording is a clock read and a few relaxed stores, no locks. A dump
+// writes the last few seconds of every thread as Chrome trace JSON, open it in chrome://tracing or
+// ui.perfetto.dev.
+//
+// Spans are tagged with the thread's current frame, set where a frame enters the pipeline.
+//
+class SpanRecorder {
+public:
+
+  // Times the enclosing block
+  class Scope {
+  public:
+    explicit Scope(const char* name);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    const char* m_Name;
+    int64_t m_Begin; // -1 if not recording
+  };
+
+  static SpanRecorder& instance();
+
+  SpanRecorder(const SpanRecorder&) = delete;
+  SpanRecorder(SpanRecorder&&) = delete;
+
+  SpanRecorder& operator=(const SpanRecorder&) = delete;
+  SpanRecorder& operator=(SpanRecorder&&) = delete;
+
+  virtual ~SpanRecorder() = default;
+
+  // name must outlive the recorder (string literal)
+  void record(const char* name, int64_t beginNs, int64_t endNs);
+
+  // Frame the calling thread's spans belong to from now on
+  static void setFrame(uint64_t frame);
+  static uint64_t getFrame();
+
+  // Shown instead of the thread id in the trace
+  void nameThread(const std::string& name);
+
+  // Writes the spans that ended in the last N seconds
+  bool dump(const std::string& path, float seconds) const;
+
+  int64_t now() const;
+
+  // A steady_clock time taken anyway (e.g. for timings) as a span time, saves reading the clock again
+  int64_t toNs(std::chrono::steady_clock::time_point time) const;
+
+private:
+
+  static constexpr size_t RingSize = 16384; // per thread, ~30 s at 60 fps and ~10 spans per frame
+
+  struct Span {
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> frame;
+    std::atomic<int64_t> begin;
+    std::atomic<int64_t> end;
+  };
+
+  // Written by its thread only. The dump keeps what wasn't overwritten while it was copying.
+  struct Ring {
+    std::array<Span, RingSize> spans;
+    std::atomic<uint64_t> written = 0;
+    uint32_t thread = 0;
+    std::string name;
+  };
+
+  SpanRecorder();
+
+  std::chrono::steady_clock::time_point m_Start;
+
+  // Rings outlive their threads, so a dump still sees threads that have exited
+  mutable std::mutex m_RingsMutex;
+  std::vector<std::unique_ptr<Ring>> m_Rings;
+
+
+  Ring& threadRing();
+};
\ No newline at end of file
@@ -1,103 +1,160 @@
 #include "StyleImageCache.h"
 
+#include "MemoryAccounting.h"
+#include "Pipeline.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 
 namespace fs = std::filesystem;
 
 
 namespace {
-  cv::Mat cropToSquare(const cv::Mat& image) {
-    int height = image.rows;
-    int width = image.cols;
+  const char* LibraryExtension = ".pack";
+
+  const int ThumbnailQuality = 90;
 
-    // Determine the size of the square
-    int minDim = height < width ? height : width;
+  // thumbnails going into the atlas per frame
+  const size_t MaxThumbnailUploadsPerFrame = 8;
 
-    // Calculate the top-left corner of the square
-    int x = (width - minDim) / 2;
-    int y = (height - minDim) / 2;
+  // blobs made ahead of time, at most
+  const size_t MaxPrefetch = 8;
 
-    // Crop the image to the square
-    cv::Rect square_roi(x, y, minDim, minDim);
-    cv::Mat cropped_image = image(square_roi);
+  // previously active styles considered for prefetching
+  const size_t MaxHistory = 8;
 
-    return cropped_image;
+  // styles at least this similar are collapsed into one (cosine similarity of their descriptors)
+  const float DuplicateSimilarity = 0.99f;
+
+
+  // <folder>.<generation>.pack, next to the folder
+  fs::path LibraryPath(const std::string& folder, int64_t generation) {
+    return fs::path(folder + "." + std::to_string(generation) + LibraryExtension);
   }
 
 
 
-  ID3D11ShaderResourceView* MatToTexture(ID3D11Device* device, ID3D11DeviceContext* context, const cv::Mat& mat) {
-    if (mat.empty())
-      return nullptr;
+  // The library generations of the folder on disk, by generation
+  std::map<int64_t, fs::path> FindLibraries(const std::string& folder) {
+    std::map<int64_t, fs::path> libraries;
 
-    D3D11_TEXTURE2D_DESC desc;
-    ZeroMemory(&desc, sizeof(desc));
-    desc.Width = mat.cols;
-    desc.Height = mat.rows;
-    desc.MipLevels = 1;
-    desc.ArraySize = 1;
-    desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
-    desc.SampleDesc.Count = 1;
-    desc.Usage = D3D11_USAGE_DEFAULT;
-    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-    desc.CPUAccessFlags = 0;
-
-    std::vector<unsigned char> imageData(mat.cols * mat.rows * 4);
-    if (mat.channels() == 1) {
-      for (int y = 0; y < mat.rows; ++y) {
-        for (int x = 0; x < mat.cols; ++x) {
-          unsigned char value = mat.at<unsigned char>(y, x);
-          imageData[(y * mat.cols + x) * 4 + 0] = value;
-          imageData[(y * mat.cols + x) * 4 + 1] = value;
-          imageData[(y * mat.cols + x) * 4 + 2] = value;
-          imageData[(y * mat.cols + x) * 4 + 3] = 255;
-        }
+    fs::path parent = fs::path(folder).parent_path();
+    std::string prefix = fs::path(folder).filename().u8string() + ".";
+
+    std::error_code ec;
+    for (const auto& file : fs::directory_iterator(parent.empty() ? fs::path(".") : parent, ec)) {
+      std::string name = file.path().filename().u8string();
+
+      if (name.size() <= prefix.size() + strlen(LibraryExtension) || name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - strlen(LibraryExtension), std::string::npos, LibraryExtension) != 0) {
+        continue;
       }
-    }
-    else if (mat.channels() == 3) {
-      for (int y = 0; y < mat.rows; ++y) {
-        for (int x = 0; x < mat.cols; ++x) {
-          cv::Vec3b value = mat.at<cv::Vec3b>(y, x);
-          imageData[(y * mat.cols + x) * 4 + 0] = value[0];
-          imageData[(y * mat.cols + x) * 4 + 1] = value[1];
-          imageData[(y * mat.cols + x) * 4 + 2] = value[2];
-          imageData[(y * mat.cols + x) * 4 + 3] = 255;
-        }
+
+      std::string generation = name.substr(prefix.size(), name.size() - prefix.size() - strlen(LibraryExtension));
+      if (generation.size() > 18 || !std::all_of(generation.begin(), generation.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        continue;
       }
+
+      libraries[std::stoll(generation)] = file.path();
     }
-    else if (mat.channels() == 4) {
-      for (int y = 0; y < mat.rows; ++y) {
-        for (int x = 0; x < mat.cols; ++x) {
-          cv::Vec4b value = mat.at<cv::Vec4b>(y, x);
-          imageData[(y * mat.cols + x) * 4 + 0] = value[0];
-          imageData[(y * mat.cols + x) * 4 + 1] = value[1];
-          imageData[(y * mat.cols + x) * 4 + 2] = value[2];
-          imageData[(y * mat.cols + x) * 4 + 3] = value[3];
+
+    return libraries;
+  }
+
+
+  // Dimensions from the JPEG frame header, without decoding anything
+  std::optional<cv::Size> ReadJpegSize(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+
+    unsigned char soi[2];
+    if (!file.read(reinterpret_cast<char*>(soi), 2) || soi[0] != 0xFF || soi[1] != 0xD8) {
+      return {};
+    }
+
+    unsigned char marker[4];
+    while (file.read(reinterpret_cast<char*>(marker), 4)) {
+      if (marker[0] != 0xFF) {
+        return {};
+      }
+
+      int length = (marker[2] << 8) | marker[3];
+
+      // SOF0..SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+      bool sof = marker[1] >= 0xC0 && marker[1] <= 0xCF && marker[1] != 0xC4 && marker[1] != 0xC8 && marker[1] != 0xCC;
+
+      if (sof) {
+        unsigned char frame[5];
+        if (!file.read(reinterpret_cast<char*>(frame), 5)) {
+          return {};
         }
+
+        return cv::Size((frame[3] << 8) | frame[4], (frame[1] << 8) | frame[2]);
+      }
+
+      if (length < 2) {
+        return {};
       }
+
+      file.seekg(length - 2, std::ios::cur);
     }
 
-    D3D11_SUBRESOURCE_DATA subResource;
-    subResource.pSysMem = imageData.data();
-    subResource.SysMemPitch = mat.cols * 4;
-    subResource.SysMemSlicePitch = 0;
+    return {};
+  }
 
-    ID3D11Texture2D* texture = nullptr;
-    HRESULT hr = device->CreateTexture2D(&desc, &subResource, &texture);
-    if (FAILED(hr)) {
-      std::cout << "Failed to create texture from image data" << std::endl;
-      return nullptr;
+
+
+  // JPEGs can be decoded at 1/2, 1/4 or 1/8 scale (DCT scaling), which is much cheaper than
+  // decoding at full size only to shrink it. Pick the smallest scale that still covers the target.
+  // Other formats would be decoded fully and then resized by imread anyway, so read them as is.
+  int ReadFlags(const std::string& path, int targetSize) {
+    auto size = ReadJpegSize(path);
+    if (!size) {
+      return cv::IMREAD_COLOR;
     }
 
-    ID3D11ShaderResourceView* textureView = nullptr;
-    hr = device->CreateShaderResourceView(texture, nullptr, &textureView);
-    texture->Release();
+    int minDim = std::min(size->width, size->height);
 
-    if (FAILED(hr)) {
-      std::cout << "Failed to create shader resource view from texture" << std::endl;
-      return nullptr;
+    if (minDim >= 8 * targetSize) {
+      return cv::IMREAD_REDUCED_COLOR_8;
+    }
+    if (minDim >= 4 * targetSize) {
+      return cv::IMREAD_REDUCED_COLOR_4;
+    }
+    if (minDim >= 2 * targetSize) {
+      return cv::IMREAD_REDUCED_COLOR_2;
+    }
+
+    return cv::IMREAD_COLOR;
+  }
+
+
+
+  // Decode, crop and resize a style image. Returns false if the file is not an image.
+  bool PrepStyleImage(const std::string& path, cv::Size size, cv::Mat& image) {
+    cv::Mat img;
+
+    try {
+      img = cv::imread(path, ReadFlags(path, std::max(size.width, size.height)));
+    } catch (std::exception& e) {
+      std::cout << "Failed to read " << path << ": " << e.what() << std::endl;
+      return false;
+    }
+
+    if (img.empty()) {
+      return false;
     }
 
-    return textureView;
+    FitStyleImage(img, size, image);
+
+    return true;
   }
 }
 
@@ -109,70 +166,963 @@ StyleImageCache::~StyleImageCache() {
 
 
 
-void StyleImageCache::load(const std::string& folder, ID3D11Device* device, ID3D11DeviceContext* context) {
+void StyleImageCache::load(const std::string& folder, ThumbnailTextures* textures) {
+  clear();
+
   m_PathToFolder = folder;
-  
-  // Iterate through the files in the directory
-  for (const auto& entry : fs::directory_iterator(folder)) {
-    std::string filePath = entry.path().string();
-    fs::file_time_type lastWrite = fs::last_write_time(filePath);
-
-    // don't reload unchanged files
-    auto it = m_Images.find(filePath);
-    if (it != m_Images.end() && it->second.lastWrite == lastWrite) {
+  m_Textures = textures;
+
+  // The first load happens right away, so the styles are there from the start (and for the saved settings)
+  try {
+    if (auto snapshot = scan(true)) {
+      publish(*snapshot);
+    }
+  } catch (std::exception& e) {
+    std::cout << "Failed to load styles: " << e.what() << std::endl;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_LoaderMutex);
+    m_LoaderStop = false;
+  }
+
+  m_Loader = std::thread(&StyleImageCache::loaderLoop, this);
+
+  {
+    std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+    m_PrefetchStop = false;
+  }
+
+  m_Prefetcher = std::thread(&StyleImageCache::prefetcherLoop, this);
+
+  m_Watcher = std::make_unique<DirectoryWatcher>(folder, [this](const std::vector<std::string>& changed) { reload(changed); });
+}
+
+
+
+void StyleImageCache::reload() {
+  reload(std::vector<std::string>());
+}
+
+
+
+void StyleImageCache::reload(const std::vector<std::string>& changed) {
+  {
+    std::lock_guard<std::mutex> lock(m_LoaderMutex);
+    m_ReloadRequested = true;
+
+    if (changed.empty()) {
+      m_ReloadAll = true;
+    }
+    else {
+      m_ReloadNames.insert(changed.begin(), changed.end());
+    }
+  }
+
+  m_LoaderWork.notify_one();
+}
+
+
+
+void StyleImageCache::update() {
+  Snapshot* snapshot = nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(m_LoaderMutex);
+    snapshot = m_Pending.get();
+  }
+
+  if (snapshot) {
+    publish(*snapshot);
+
+    // only now may the loader start on the next one
+    {
+      std::lock_guard<std::mutex> lock(m_LoaderMutex);
+      m_Pending.reset();
+    }
+
+    m_LoaderWork.notify_one();
+  }
+
+  uploadDecodedThumbnails();
+  updatePrefetch();
+  updateMemoryAccounts();
+}
+
+
+
+void StyleImageCache::updateMemoryAccounts() const {
+  auto& accounting = MemoryAccounting::instance();
+
+  size_t pageBytes = static_cast<size_t>(m_Atlas.getPageSize()) * m_Atlas.getPageSize() * 4;
+
+  accounting.get(MemoryAccounting::Subsystem::StyleImages).set(m_OwnedImageBytes);
+  accounting.get(MemoryAccounting::Subsystem::StyleBlobs).set(m_Residency.bytes + m_BlendBlob.capacity() * sizeof(float));
+  size_t pages = std::count_if(m_AtlasPages.begin(), m_AtlasPages.end(), [](void* page) { return page != nullptr; });
+
+  accounting.get(MemoryAccounting::Subsystem::Textures).set(pages * pageBytes);
+}
+
+
+
+void StyleImageCache::updatePrefetch() {
+  // blobs made since the last frame
+  std::vector<Prefetched> prefetched;
+
+  {
+    std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+    prefetched.swap(m_Prefetched);
+  }
+
+  for (auto& result : prefetched) {
+    auto it = m_Images.find(result.path);
+
+    // gone, changed, or materialized in the meantime
+    if (it == m_Images.end() || it->second.m_PrefetchTicket != result.ticket || !it->second.m_Blob.empty()) {
       continue;
     }
 
-    cv::Mat img = cv::imread(filePath, cv::IMREAD_COLOR);
-    if (img.empty()) {
+    auto& img = it->second;
+    img.m_PrefetchTicket = 0;
+    img.m_Blob = std::move(result.blob);
+
+    m_Resident.push_front(img.path);
+    img.m_Lru = m_Resident.begin();
+    m_Residency.bytes += tensorBytes();
+    m_Residency.prefetched++;
+  }
+
+  if (!prefetched.empty()) {
+    trim();
+  }
+
+  // Candidates, most likely first: hovered, recently used, then on screen
+
+  std::vector<std::string> candidates;
+
+  if (!m_Hovered.empty()) {
+    candidates.push_back(m_Hovered);
+  }
+
+  candidates.insert(candidates.end(), m_History.begin(), m_History.end());
+
+  for (size_t i : m_Visible) {
+    if (i < m_List.size()) {
+      candidates.push_back(m_List[i]->path);
+    }
+  }
+
+  m_Hovered.clear();
+  m_Visible.clear();
+
+  std::vector<PrefetchJob> jobs;
+
+  for (const auto& path : candidates) {
+    if (jobs.size() == MaxPrefetch) {
+      break;
+    }
+
+    auto it = m_Images.find(path);
+    if (it == m_Images.end() || !it->second.m_Blob.empty()) {
+      continue;
+    }
+
+    auto duplicate = std::find_if(jobs.begin(), jobs.end(), [&](const PrefetchJob& job) { return job.path == path; });
+    if (duplicate != jobs.end()) {
       continue;
     }
 
-    img = cropToSquare(img);
+    auto& img = it->second;
+    if (!img.m_PrefetchTicket) {
+      img.m_PrefetchTicket = m_NextPrefetchTicket++;
+    }
+
+    jobs.push_back({ img.path, img.m_PrefetchTicket, m_Library, img.m_Image });
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+
+    // the one being made is done already
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [&](const PrefetchJob& job) { return job.path == m_PrefetchInFlight; }), jobs.end());
+    m_PrefetchJobs.swap(jobs);
+  }
+
+  m_PrefetchWork.notify_one();
+}
+
+
+
+void StyleImageCache::prefetcherLoop() {
+  // never in the way of the capture/inference threads (elsewhere the thread keeps the default priority)
+#ifdef _WIN32
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+  // only runs when a core would otherwise be idle, no privileges needed to lower it
+  sched_param param{};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+  std::unique_lock<std::mutex> lock(m_PrefetchMutex);
+
+  while (true) {
+    m_PrefetchWork.wait(lock, [this] { return m_PrefetchStop || !m_PrefetchJobs.empty(); });
+
+    if (m_PrefetchStop) {
+      break;
+    }
+
+    auto job = std::move(m_PrefetchJobs.front());
+    m_PrefetchJobs.erase(m_PrefetchJobs.begin());
+    m_PrefetchInFlight = job.path;
+
+    lock.unlock();
+
+    Prefetched result{ job.path, job.ticket, {} };
+    MakeStyleBlob(job.image, result.blob);
+
+    lock.lock();
+
+    m_PrefetchInFlight.clear();
+    m_Prefetched.push_back(std::move(result));
+  }
+}
+
+
+
+void StyleImageCache::stopPrefetcher() {
+  if (m_Prefetcher.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_PrefetchMutex);
+      m_PrefetchStop = true;
+    }
+
+    m_PrefetchWork.notify_all();
+    m_Prefetcher.join();
+  }
+
+  m_PrefetchJobs.clear();
+  m_Prefetched.clear();
+  m_PrefetchInFlight.clear();
+}
+
+
+
+std::vector<size_t> StyleImageCache::findSimilar(const std::string& path, int count) const {
+  std::vector<size_t> similar;
+
+  const float* descriptor = m_Index ? m_Index->find(path) : nullptr;
+  if (!descriptor) {
+    return similar;
+  }
+
+  for (const auto& match : m_Index->nearest(descriptor, count, path)) {
+    const auto& key = m_Index->getKey(match.index);
+
+    auto it = std::lower_bound(m_List.begin(), m_List.end(), key, [](const StyleImage* img, const std::string& path) {
+      return img->path < path;
+    });
+
+    if (it != m_List.end() && (*it)->path == key) {
+      similar.push_back(it - m_List.begin());
+    }
+  }
+
+  return similar;
+}
+
+
+
+void StyleImageCache::requestThumbnails(size_t first, size_t last) {
+  last = std::min(last, m_List.size());
+
+  for (size_t i = first; i < last; i++) {
+    auto& img = *m_List[i];
+
+    // on screen, so a prefetch candidate too
+    m_Visible.push_back(i);
+
+    if (img.m_ThumbnailSlot.page >= 0 || img.m_ThumbnailTicket) {
+      continue;
+    }
+
+    img.m_ThumbnailTicket = m_NextThumbnailTicket++;
+
+    // the library stays mapped (and the image valid) until the decode is done
+    auto job = [this, path = img.path, ticket = img.m_ThumbnailTicket, library = m_Library, image = img.m_Image,
+      data = img.m_EncodedThumbnail, size = img.m_EncodedThumbnailSize]() {
+      DecodedThumbnail decoded{ path, ticket, {} };
+
+      if (data) {
+        try {
+          cv::Mat encoded(1, static_cast<int>(size), CV_8U, const_cast<uint8_t*>(data));
+          decoded.image = cv::imdecode(encoded, cv::IMREAD_COLOR);
+        } catch (std::exception& e) {
+          std::cout << "Failed to decode the thumbnail of " << path << ": " << e.what() << std::endl;
+        }
+      }
+
+      if (decoded.image.empty()) {
+        decoded.image = image;
+      }
+
+      std::lock_guard<std::mutex> lock(m_ThumbnailMutex);
+      m_DecodedThumbnails.push_back(std::move(decoded));
+    };
+
+    m_ThumbnailJobs.push_back(m_Workers.submit(std::move(job)));
+  }
+}
 
-    // prep for Inference
-    
-    cv::Size sz(m_ImgSize.first, m_ImgSize.second);
 
-    cv::Mat resizedImg;
-    cv::resize(img, resizedImg, sz, cv::INTER_AREA);
 
-    cv::Mat styleImg;
-    resizedImg.convertTo(styleImg, CV_32FC3, 1.0 / 255.0);
+void StyleImageCache::uploadDecodedThumbnails() {
+  std::vector<DecodedThumbnail> decoded;
 
-    auto width = styleImg.size().width;
-    auto height = styleImg.size().height;
-    auto channels = 3;
+  // a bounded number per frame, so scrolling through new thumbnails never stalls a frame
+  {
+    std::lock_guard<std::mutex> lock(m_ThumbnailMutex);
 
-    auto blob = std::vector<float>(height * width * channels);
+    auto count = std::min(m_DecodedThumbnails.size(), MaxThumbnailUploadsPerFrame);
+    auto end = m_DecodedThumbnails.begin() + count;
 
-    for (int h = 0; h < height; ++h) {
-      for (int w = 0; w < width; ++w) {
-        for (int c = 0; c < channels; ++c) {
-          blob[h * width * channels + w * channels + c] = styleImg.at<cv::Vec3f>(h, w)[c];
+    std::move(m_DecodedThumbnails.begin(), end, std::back_inserter(decoded));
+    m_DecodedThumbnails.erase(m_DecodedThumbnails.begin(), end);
+  }
+
+  std::vector<StyleImage*> added;
+
+  for (auto& thumbnail : decoded) {
+    auto it = m_Images.find(thumbnail.path);
+
+    // the style was removed or changed in the meantime
+    if (it == m_Images.end() || it->second.m_ThumbnailTicket != thumbnail.ticket) {
+      continue;
+    }
+
+    auto& img = it->second;
+    img.m_ThumbnailTicket = 0;
+    img.m_ThumbnailSlot = m_Atlas.add(thumbnail.image);
+
+    added.push_back(&img);
+  }
+
+  if (!added.empty()) {
+    uploadThumbnails();
+  }
+
+  for (auto* img : added) {
+    int page = img->m_ThumbnailSlot.page;
+    img->m_Thumbnail = page >= 0 ? m_AtlasPages[page] : nullptr;
+  }
+
+  m_ThumbnailJobs.erase(std::remove_if(m_ThumbnailJobs.begin(), m_ThumbnailJobs.end(), [](const std::future<void>& job) {
+    return job.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }), m_ThumbnailJobs.end());
+}
+
+
+
+bool StyleImageCache::isLoading() const {
+  std::lock_guard<std::mutex> lock(m_LoaderMutex);
+  return m_ReloadRequested || m_Loading || m_Pending;
+}
+
+
+
+std::unique_ptr<StyleImageCache::Snapshot> StyleImageCache::scan(bool force, const std::unordered_set<std::string>* changedNames) {
+  int width = m_ImgSize.first;
+  int height = m_ImgSize.second;
+
+  if (m_LoaderGeneration < 0) {
+    openNewestLibrary();
+  }
+
+  deleteRetiredLibraries();
+
+  // Unchanged files come straight from the library, new and changed ones need prepping
+
+  std::vector<StyleLibrary::Entry> entries;
+  std::vector<size_t> stale;
+
+  auto addFile = [&](const fs::directory_entry& file) {
+    StyleLibrary::Entry entry;
+    entry.name = file.path().filename().u8string();
+    entry.mtime = file.last_write_time().time_since_epoch().count();
+
+    const auto* packed = m_LoaderLibrary ? m_LoaderLibrary->find(entry.name) : nullptr;
+    if (packed && packed->mtime == entry.mtime) {
+      entries.push_back(*packed);
+    }
+    else {
+      stale.push_back(entries.size());
+      entries.push_back(std::move(entry));
+    }
+  };
+
+  if (changedNames && m_LoaderLibraryCurrent) {
+    // the library holds the rest of the folder, no need to list it
+    if (m_LoaderLibrary) {
+      for (const auto& packed : m_LoaderLibrary->getEntries()) {
+        if (!changedNames->count(packed.name)) {
+          entries.push_back(packed);
         }
       }
     }
 
+    for (const auto& name : *changedNames) {
+      std::error_code ec;
+      fs::directory_entry file(fs::path(m_PathToFolder) / fs::u8path(name), ec);
+
+      // gone (deleted or renamed away)
+      if (ec || !file.is_regular_file(ec)) {
+        continue;
+      }
+
+      addFile(file);
+    }
+  }
+  else {
+    for (const auto& file : fs::directory_iterator(m_PathToFolder)) {
+      if (file.is_regular_file()) {
+        addFile(file);
+      }
+    }
+  }
+
+  size_t packedCount = m_LoaderLibrary ? m_LoaderLibrary->getEntries().size() : 0;
+  bool changed = !stale.empty() || entries.size() != packedCount;
+
+  if (!changed) {
+    m_LoaderLibraryCurrent = true;
+
+    if (!force) {
+      return nullptr;
+    }
+  }
+
+  auto snapshot = std::make_unique<Snapshot>();
+  snapshot->library = m_LoaderLibrary;
+  snapshot->entries = entries;
+
+  std::vector<std::vector<uchar>> encoded(stale.size());
+  std::vector<float> descriptors(stale.size() * StyleIndex::DescriptorSize);
+  std::vector<cv::Mat> owned(entries.size());
+
+  if (changed) {
+    // prep for Inference, in parallel
+
+    cv::Size sz(width, height);
 
-    // prep thumbnail
-    
-    auto* thumbnail = MatToTexture(device, context, resizedImg);
+    m_Workers.parallelFor(stale.size(), [&](size_t i) {
+      auto& entry = entries[stale[i]];
+      auto& image = owned[stale[i]];
 
+      if (!PrepStyleImage((fs::path(m_PathToFolder) / fs::u8path(entry.name)).string(), sz, image)) {
+        return;
+      }
+
+      cv::imencode(".jpg", image, encoded[i], { cv::IMWRITE_JPEG_QUALITY, ThumbnailQuality });
 
-    // done
+      float* descriptor = descriptors.data() + i * StyleIndex::DescriptorSize;
+      StyleIndex::describe(image.data, width, height, descriptor);
 
-    m_Images.emplace(filePath, StyleImage{ filePath, lastWrite, styleImg, blob, thumbnail });
+      entry.pixels = image.data;
+      entry.descriptor = descriptor;
+      entry.thumbnail = encoded[i].data();
+      entry.thumbnailSize = encoded[i].size();
+    });
   }
 
+  // Near-duplicates collapse into one unique style. The library's verdicts hold for unchanged files;
+  // only new and changed ones (and those whose original is gone) are compared, against the unique
+  // styles kept first, then among themselves. A reload costs changed x all, not all x all.
+
+  std::unordered_map<std::string, size_t> byName;
+  std::vector<bool> fresh(entries.size(), false);
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    byName[entries[i].name] = i;
+  }
+
+  for (size_t i : stale) {
+    fresh[i] = true;
+  }
+
+  auto keptUnique = [&](size_t i) {
+    return entries[i].pixels && !fresh[i] && entries[i].duplicateOf.empty();
+  };
+
+  StyleIndex unique;
+  std::vector<size_t> dirty;
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (keptUnique(i)) {
+      unique.add(entries[i].name, entries[i].descriptor);
+    }
+    else if (entries[i].pixels) {
+      auto original = entries[i].duplicateOf.empty() ? byName.end() : byName.find(entries[i].duplicateOf);
+
+      if (fresh[i] || original == byName.end() || !keptUnique(original->second)) {
+        dirty.push_back(i);
+      }
+    }
+  }
+
+  m_Workers.parallelFor(dirty.size(), [&](size_t k) {
+    auto& entry = entries[dirty[k]];
+
+    size_t match = 0;
+    if (unique.findSimilar(entry.descriptor, DuplicateSimilarity, match)) {
+      entry.duplicateOf = unique.getKey(match);
+    }
+    else {
+      entry.duplicateOf.clear();
+    }
+  });
+
+  StyleIndex rest;
+  std::vector<size_t> restEntries;
+
+  for (size_t i : dirty) {
+    if (entries[i].duplicateOf.empty()) {
+      rest.add(entries[i].name, entries[i].descriptor);
+      restEntries.push_back(i);
+    }
+  }
+
+  auto duplicateOf = rest.findDuplicates(DuplicateSimilarity, m_Workers);
+
+  for (size_t i = 0; i < restEntries.size(); i++) {
+    if (duplicateOf[i] != i) {
+      entries[restEntries[i]].duplicateOf = rest.getKey(duplicateOf[i]);
+    }
+  }
+
+  // Similarity index of the unique styles
+
+  auto stylePath = [&](const std::string& name) {
+    return (fs::path(m_PathToFolder) / fs::u8path(name)).string();
+  };
+
+  snapshot->index = std::make_shared<StyleIndex>();
+  snapshot->index->reserve(entries.size());
+
+  for (const auto& entry : entries) {
+    if (!entry.pixels) {
+      continue;
+    }
+
+    if (entry.duplicateOf.empty()) {
+      snapshot->index->add(stylePath(entry.name), entry.descriptor);
+    }
+    else {
+      snapshot->duplicates[stylePath(entry.name)] = stylePath(entry.duplicateOf);
+    }
+  }
+
+  if (changed) {
+    auto library = writeLibrary(entries);
+    m_LoaderLibraryCurrent = library != nullptr;
+
+    if (library) {
+      snapshot->library = library;
+      snapshot->entries = library->getEntries();
+    }
+    else {
+      // e.g. read-only install, keep the new images in memory (and list the whole folder next time)
+      snapshot->entries = entries;
+      snapshot->owned = std::move(owned);
+
+      // their encoded thumbnails (and descriptors) go away with this scan, the thumbnails are made from the images instead
+      for (size_t i : stale) {
+        snapshot->entries[i].descriptor = nullptr;
+        snapshot->entries[i].thumbnail = nullptr;
+        snapshot->entries[i].thumbnailSize = 0;
+      }
+    }
+  }
+
+  return snapshot;
+}
+
+
+
+void StyleImageCache::openNewestLibrary() {
+  auto libraries = FindLibraries(m_PathToFolder);
+
+  m_LoaderGeneration = libraries.empty() ? 0 : libraries.rbegin()->first;
+
+  for (auto it = libraries.rbegin(); it != libraries.rend(); ++it) {
+    if (!m_LoaderLibrary) {
+      auto library = std::make_shared<StyleLibrary>();
+      if (library->open(it->second, m_ImgSize.first, m_ImgSize.second, 3, StyleIndex::DescriptorSize)) {
+        m_LoaderLibrary = library;
+        m_LoaderLibraryPath = it->second;
+        continue;
+      }
+    }
+
+    // older (or unusable) generations, left behind by this or another process
+    m_RetiredLibraries.push_back({ it->second, {} });
+  }
+}
+
+
+
+std::shared_ptr<StyleLibrary> StyleImageCache::writeLibrary(const std::vector<StyleLibrary::Entry>& entries) {
+  int width = m_ImgSize.first;
+  int height = m_ImgSize.second;
+
+  // past any generation on disk, another process may have written some since
+  auto libraries = FindLibraries(m_PathToFolder);
+  int64_t generation = std::max(m_LoaderGeneration, libraries.empty() ? 0 : libraries.rbegin()->first) + 1;
+
+  auto path = LibraryPath(m_PathToFolder, generation);
+  auto tempPath = path;
+  tempPath += ".tmp";
+
+  std::error_code ec;
+
+  if (!StyleLibrary::write(tempPath, width, height, 3, StyleIndex::DescriptorSize, entries)) {
+    fs::remove(tempPath, ec);
+    return nullptr;
+  }
+
+  fs::rename(tempPath, path, ec);
+  if (ec) {
+    std::cout << "Failed to rename " << tempPath.string() << ": " << ec.message() << std::endl;
+    fs::remove(tempPath, ec);
+    return nullptr;
+  }
+
+  auto library = std::make_shared<StyleLibrary>();
+  if (!library->open(path, width, height, 3, StyleIndex::DescriptorSize)) {
+    fs::remove(path, ec);
+    return nullptr;
+  }
+
+  // the previous generation goes once the UI, decodes and prefetches in flight let go of it
+  if (m_LoaderLibrary) {
+    m_RetiredLibraries.push_back({ m_LoaderLibraryPath, m_LoaderLibrary });
+  }
+
+  m_LoaderLibrary = library;
+  m_LoaderLibraryPath = path;
+  m_LoaderGeneration = generation;
+
+  return library;
+}
+
+
+
+void StyleImageCache::deleteRetiredLibraries() {
+  m_RetiredLibraries.erase(std::remove_if(m_RetiredLibraries.begin(), m_RetiredLibraries.end(), [](const RetiredLibrary& retired) {
+    if (!retired.library.expired()) {
+      return false;
+    }
+
+    std::error_code ec;
+    fs::remove(retired.path, ec);
+
+    return !ec;
+  }), m_RetiredLibraries.end());
+}
+
+
+
+void StyleImageCache::loaderLoop() {
+  std::unique_lock<std::mutex> lock(m_LoaderMutex);
+
+  while (true) {
+    // the previous snapshot must have been swapped in first, see update()
+    m_LoaderWork.wait(lock, [this] { return m_LoaderStop || (m_ReloadRequested && !m_Pending); });
+
+    if (m_LoaderStop) {
+      break;
+    }
+
+    bool all = m_ReloadAll;
+    auto names = std::move(m_ReloadNames);
+
+    m_ReloadRequested = false;
+    m_ReloadAll = false;
+    m_ReloadNames.clear();
+    m_Loading = true;
+
+    lock.unlock();
+
+    std::unique_ptr<Snapshot> snapshot;
+
+    try {
+      snapshot = scan(false, all ? nullptr : &names);
+    } catch (std::exception& e) {
+      std::cout << "Failed to reload styles: " << e.what() << std::endl;
+      m_LoaderLibraryCurrent = false;
+    }
+
+    lock.lock();
+
+    m_Loading = false;
+    m_Pending = std::move(snapshot);
+  }
+}
+
+
+
+void StyleImageCache::publish(Snapshot& snapshot) {
+  int width = m_ImgSize.first;
+  int height = m_ImgSize.second;
+
+  std::unordered_map<std::string, StyleImage> images;
+
+  for (size_t i = 0; i < snapshot.entries.size(); i++) {
+    const auto& entry = snapshot.entries[i];
+
+    if (!entry.pixels) {
+      continue;
+    }
+
+    StyleImage img;
+    img.path = (fs::path(m_PathToFolder) / fs::u8path(entry.name)).string();
+    img.lastWrite = fs::file_time_type(fs::file_time_type::duration(entry.mtime));
+
+    if (i < snapshot.owned.size() && !snapshot.owned[i].empty()) {
+      img.m_Image = snapshot.owned[i];
+    }
+    else {
+      // pages are read (and shared with other processes) via the page cache
+      img.m_Image = cv::Mat(height, width, CV_8UC3, const_cast<uint8_t*>(entry.pixels));
+      img.m_Mapped = true;
+    }
+
+    img.m_EncodedThumbnail = entry.thumbnail;
+    img.m_EncodedThumbnailSize = entry.thumbnailSize;
+
+    // unchanged styles keep their thumbnail (and blob)
+    auto prev = m_Images.find(img.path);
+
+    if (prev != m_Images.end() && prev->second.lastWrite == img.lastWrite) {
+      img.m_Thumbnail = prev->second.m_Thumbnail;
+      img.m_ThumbnailSlot = prev->second.m_ThumbnailSlot;
+      img.m_ThumbnailTicket = prev->second.m_ThumbnailTicket;
+      prev->second.m_ThumbnailSlot = {};
+
+      if (!prev->second.m_Blob.empty()) {
+        img.m_Blob.swap(prev->second.m_Blob);
+        img.m_Lru = prev->second.m_Lru;
+      }
+    }
+    auto path = img.path;
+    images.emplace(std::move(path), std::move(img));
+  }
+
+  // removed and changed styles go with the old set, and with them the old library
+  for (auto& [_, img] : m_Images) {
+    m_Atlas.remove(img.m_ThumbnailSlot);
+
+    if (!img.m_Blob.empty()) {
+      m_Resident.erase(img.m_Lru);
+      m_Residency.bytes -= tensorBytes();
+    }
+  }
+
+  m_Images = std::move(images);
+  m_Library = snapshot.library;
+  m_Index = snapshot.index;
+  m_Duplicates = std::move(snapshot.duplicates);
+
+  // new thumbnails are decoded once they are scrolled into view, see requestThumbnails()
+  m_List.clear();
+  m_List.reserve(m_Images.size() - m_Duplicates.size());
+  m_ListVersion++;
+  m_OwnedImageBytes = 0;
+
+  for (auto& [_, img] : m_Images) {
+    if (!m_Duplicates.count(img.path)) {
+      m_List.push_back(&img);
+    }
+
+    if (!img.m_Mapped) {
+      m_OwnedImageBytes += img.m_Image.total() * img.m_Image.elemSize();
+    }
+  }
+
+  std::sort(m_List.begin(), m_List.end(), [](const StyleImage* a, const StyleImage* b) { return a->path < b->path; });
+
   auto it = m_Images.find(m_ActiveImage);
   if (it == m_Images.end()) {
     m_ActiveImage = "";
   }
 
-  if (m_ActiveImage.empty() && m_Images.size() > 0) {
-    m_ActiveImage = m_Images.begin()->first;
+  if (m_ActiveImage.empty() && !m_List.empty()) {
+    m_ActiveImage = m_List.front()->path;
   }
+
+  // the blended styles may have changed
+  m_BlendDirty = true;
+
+  updatePins();
+}
+
+
+
+void StyleImageCache::materializeBlob(StyleImage& img) const {
+  if (!img.m_Blob.empty()) {
+    return;
+  }
+
+  MakeStyleBlob(img.m_Image, img.m_Blob);
+}
+
+
+
+size_t StyleImageCache::tensorBytes() const {
+  // the float blob and the 8-bit tensor it is made from
+  return static_cast<size_t>(m_ImgSize.first) * m_ImgSize.second * 3 * (sizeof(float) + 1);
+}
+
+
+
+void StyleImageCache::acquire(StyleImage& img) {
+  if (!img.m_Blob.empty()) {
+    m_Resident.splice(m_Resident.begin(), m_Resident, img.m_Lru);
+    return;
+  }
+
+  materializeBlob(img);
+
+  m_Resident.push_front(img.path);
+  img.m_Lru = m_Resident.begin();
+  m_Residency.bytes += tensorBytes();
+}
+
+
+
+void StyleImageCache::evict(StyleImage& img) {
+  std::vector<float>().swap(img.m_Blob);
+
+  m_Resident.erase(img.m_Lru);
+  m_Residency.bytes -= tensorBytes();
+
+  if (img.m_Mapped && m_Library) {
+    m_Library->discard(img.m_Image.data);
+  }
+}
+
+
+
+void StyleImageCache::updatePins() {
+  m_Pinned.clear();
+
+  // the neighbours in the list are the likely next picks
+  auto active = std::lower_bound(m_List.begin(), m_List.end(), m_ActiveImage, [](const StyleImage* img, const std::string& path) {
+    return img->path < path;
+  });
+
+  if (active != m_List.end() && (*active)->path == m_ActiveImage) {
+    if (active != m_List.begin()) {
+      m_Pinned.push_back((*std::prev(active))->path);
+    }
+
+    if (std::next(active) != m_List.end()) {
+      m_Pinned.push_back((*std::next(active))->path);
+    }
+
+    // last, so it is the most recently used
+    m_Pinned.push_back(m_ActiveImage);
+  }
+
+  if (!m_BlendImage.empty() && m_BlendImage != m_ActiveImage && m_Images.count(m_BlendImage)) {
+    m_Pinned.push_back(m_BlendImage);
+  }
+
+  for (const auto& path : m_Pinned) {
+    acquire(m_Images.at(path));
+  }
+
+  m_Residency.pinned = static_cast<int>(m_Pinned.size());
+
+  trim();
+}
+
+
+
+void StyleImageCache::trim() {
+  auto it = m_Resident.end();
+
+  while (m_Residency.bytes > m_Residency.budget && it != m_Resident.begin()) {
+    const auto& path = *--it;
+
+    if (std::find(m_Pinned.begin(), m_Pinned.end(), path) != m_Pinned.end()) {
+      continue;
+    }
+
+    auto& img = m_Images.at(path);
+
+    // evicting only invalidates this node
+    ++it;
+    evict(img);
+  }
+
+  m_Residency.resident = static_cast<int>(m_Resident.size());
+}
+
+
+
+void StyleImageCache::setMemoryBudget(size_t bytes) {
+  m_Residency.budget = bytes;
+  trim();
+}
+
+
+
+void StyleImageCache::uploadThumbnails() {
+  int pageSize = m_Atlas.getPageSize();
+
+  while (m_AtlasPages.size() < static_cast<size_t>(m_Atlas.getPageCount())) {
+    // even if null, so pages keep their index. Its thumbnails just don't show.
+    m_AtlasPages.push_back(m_Textures ? m_Textures->createPage(pageSize) : nullptr);
+  }
+
+  for (const auto& upload : m_Atlas.takeUploads()) {
+    if (auto* page = m_AtlasPages[upload.page]) {
+      m_Textures->update(page, upload.x, upload.y, upload.pixels);
+    }
+  }
+}
+
+
+
+void StyleImageCache::releaseImages() {
+  // decodes in flight still hold on to the images
+  for (auto& job : m_ThumbnailJobs) {
+    job.wait();
+  }
+
+  m_ThumbnailJobs.clear();
+  m_DecodedThumbnails.clear();
+
+  m_Images.clear();
+  m_List.clear();
+  m_ListVersion++;
+  m_OwnedImageBytes = 0;
+
+  m_Atlas.clear();
+
+  for (auto* page : m_AtlasPages) {
+    if (page) {
+      m_Textures->releasePage(page);
+    }
+  }
+
+  m_AtlasPages.clear();
+
+  m_Resident.clear();
+  m_Pinned.clear();
+  m_Residency.bytes = 0;
+  m_Residency.resident = 0;
+  m_Residency.pinned = 0;
 }
 
 
@@ -192,16 +1142,125 @@ const StyleImageCache::StyleImage* StyleImageCache::getActiveImage() const {
 void StyleImageCache::setActiveImage(std::string path) {
   auto it = m_Images.find(path);
 
-  if (it != m_Images.end()) {
-    m_ActiveImage = it->first;
+  if (it == m_Images.end() || it->first == m_ActiveImage) {
+    return;
+  }
+
+  if (it->second.m_Blob.empty()) {
+    m_Residency.misses++;
+  }
+  else {
+    m_Residency.hits++;
+  }
+
+  // going back to a previous style is common
+  if (!m_ActiveImage.empty()) {
+    m_History.erase(std::remove(m_History.begin(), m_History.end(), m_ActiveImage), m_History.end());
+    m_History.push_front(m_ActiveImage);
+
+    if (m_History.size() > MaxHistory) {
+      m_History.pop_back();
+    }
+  }
+
+  m_ActiveImage = it->first;
+  m_BlendDirty = true;
+
+  updatePins();
+}
+
+
+
+void StyleImageCache::setBlendImage(const std::string& path) {
+  if (path == m_BlendImage) {
+    return;
+  }
+
+  m_BlendImage = path;
+  m_BlendDirty = true;
+
+  updatePins();
+}
+
+
+
+void StyleImageCache::setBlendWeight(float weight) {
+  weight = std::clamp(weight, 0.0f, 1.0f);
+
+  if (weight != m_BlendWeight) {
+    m_BlendWeight = weight;
+    m_BlendDirty = true;
+  }
+}
+
+
+
+std::vector<float>* StyleImageCache::getStyleBlob() {
+  auto active = m_Images.find(m_ActiveImage);
+  if (active == m_Images.end()) {
+    return nullptr;
+  }
+
+  auto blend = m_Images.find(m_BlendImage);
+  if (blend == m_Images.end() || blend == active || m_BlendWeight <= 0.0f) {
+    return &active->second.m_Blob;
+  }
+
+  if (m_BlendDirty) {
+    const auto& a = active->second.m_Blob;
+    const auto& b = blend->second.m_Blob;
+
+    m_BlendBlob.resize(a.size());
+
+    for (size_t i = 0; i < a.size(); i++) {
+      m_BlendBlob[i] = a[i] + m_BlendWeight * (b[i] - a[i]);
+    }
+
+    m_BlendDirty = false;
   }
+
+  return &m_BlendBlob;
 }
 
 
+
 void StyleImageCache::clear() {
-  for (const auto& [_, img] : m_Images) {
-    if (img.m_Thumbnail) {
-      img.m_Thumbnail->Release();
+  m_Watcher.reset();
+
+  if (m_Loader.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(m_LoaderMutex);
+      m_LoaderStop = true;
     }
+
+    m_LoaderWork.notify_all();
+    m_Loader.join();
   }
+
+  stopPrefetcher();
+  m_Hovered.clear();
+  m_Visible.clear();
+  m_History.clear();
+
+  m_Pending.reset();
+  m_ReloadRequested = false;
+  m_ReloadAll = false;
+  m_ReloadNames.clear();
+
+  releaseImages();
+  m_Textures = nullptr;
+
+  m_Library.reset();
+  m_Index.reset();
+  m_Duplicates.clear();
+  m_LoaderLibrary.reset();
+  m_LoaderLibraryPath.clear();
+  m_LoaderGeneration = -1;
+  m_LoaderLibraryCurrent = false;
+
+  // nothing here maps them any more
+  deleteRetiredLibraries();
+  m_RetiredLibraries.clear();
+
+  updateMemoryAccounts();
 }
\ No newline at end of file
@@ -1,14 +1,28 @@
 #pragma once
 
+#include "DirectoryWatcher.h"
+#include "StyleIndex.h"
+#include "StyleLibrary.h"
+#include "ThreadPool.h"
+#include "ThumbnailAtlas.h"
+#include "ThumbnailTextures.h"
+
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <opencv2/opencv.hpp>
 
-#include <d3d11.h>
-
 
 class StyleImageCache {
 public:
@@ -16,10 +30,32 @@ public:
     std::string path;
     std::filesystem::file_time_type lastWrite;
 
-    cv::Mat m_Image;
-    std::vector<float> m_Blob;
+    cv::Mat m_Image;            // 8-bit BGR, m_ImgSize, usually a view of the mapped library
+    bool m_Mapped = false;      // m_Image is a view of the library
+    std::vector<float> m_Blob;  // model input, HWC float [0, 1], materialized on demand (see Residency)
+
+    void* m_Thumbnail = nullptr;                     // texture id of the atlas page, not owned. Null until uploaded.
+    ThumbnailAtlas::Slot m_ThumbnailSlot;
+
+    const uint8_t* m_EncodedThumbnail = nullptr;     // JPEG in the library, null to make it from m_Image
+    size_t m_EncodedThumbnailSize = 0;
+    uint64_t m_ThumbnailTicket = 0;                  // of the decode in flight, 0 if none
+    uint64_t m_PrefetchTicket = 0;                   // of the queued prefetch, 0 if none
 
-    ID3D11ShaderResourceView* m_Thumbnail;
+    std::list<std::string>::iterator m_Lru; // valid while the blob is materialized
+  };
+
+  // Only metadata and thumbnails stay resident for every style. Style tensors (the blob and the
+  // library pages it is made from) are materialized on demand and kept within a memory budget,
+  // least recently used out first. The active style and its neighbours in the list are pinned.
+  struct Residency {
+    size_t budget = 64 * 1024 * 1024;
+    size_t bytes = 0;   // materialized tensors
+    int resident = 0;
+    int pinned = 0;
+    uint64_t hits = 0;  // styles selected with their tensor already resident
+    uint64_t misses = 0;
+    uint64_t prefetched = 0;
   };
 
   StyleImageCache() = default;
@@ -32,7 +68,21 @@ public:
 
   virtual ~StyleImageCache();
 
-  void load(const std::string& folder, ID3D11Device* device, ID3D11DeviceContext* context);
+  // Loads the styles in the folder, bringing its library (<folder>.N.pack) up to date, then keeps
+  // watching the folder: changes are loaded in the background and swapped in by update().
+  // Thumbnails go to the textures (kept until clear()), without any there are none to show.
+  void load(const std::string& folder, ThumbnailTextures* textures = nullptr);
+
+  // Rescans the folder in the background
+  void reload();
+
+  // Rescans only the named files (in the folder) in the background, all of it if none are named
+  void reload(const std::vector<std::string>& changed);
+
+  // Swaps in the result of a finished background load. Call from the UI thread, once per frame.
+  void update();
+
+  bool isLoading() const;
 
   void clear();
   
@@ -42,17 +92,197 @@ public:
 
   const std::unordered_map<std::string, StyleImage>& getImages() const { return m_Images; }
 
+  // In list (path) order, near-duplicates left out (see getDuplicates)
+  size_t getImageCount() const { return m_List.size(); }
+  const StyleImage& getImage(size_t index) const { return *m_List[index]; }
+
+  // Changes whenever the list (and the similarity index) is replaced, list indices are stale then
+  uint64_t getListVersion() const { return m_ListVersion; }
+
+  // Up to count styles most similar to the given one, most similar first, as list indices
+  std::vector<size_t> findSimilar(const std::string& path, int count) const;
+
+  // Near-duplicate styles collapsed into another (path -> path of the one kept). They are left out of
+  // the list and the similarity index, but still loaded, so they can be made active.
+  const std::unordered_map<std::string, std::string>& getDuplicates() const { return m_Duplicates; }
+
+  // UI hint: the pointer is over this style, it may well be next. See update().
+  void hintHovered(const std::string& path) { m_Hovered = path; }
+
+  // Queues decoding of the missing thumbnails of images [first, last) on the workers.
+  // They go into the atlas in update(), a few per frame.
+  void requestThumbnails(size_t first, size_t last);
+
   const StyleImage* getActiveImage() const;
 
   void setActiveImage(std::string path);
 
+  // A second style image mixed into the active one, pixel by pixel (the model takes the style image
+  // itself, there is no embedding to interpolate). The mix is made once per change, not per frame.
+  void setBlendImage(const std::string& path); // empty - none
+  const std::string& getBlendImage() const { return m_BlendImage; }
+
+  void setBlendWeight(float weight);           // of the blend image, [0, 1]
+  float getBlendWeight() const { return m_BlendWeight; }
+
+  // The model's style input: the active style's blob, or its mix with the blend image. Null without an active style.
+  std::vector<float>* getStyleBlob();
+
+  const Residency& getResidency() const { return m_Residency; }
+
+  void setMemoryBudget(size_t bytes);
+
 private:
 
   std::pair<int, int> m_ImgSize = { 256, 256 };
 
   std::string m_PathToFolder;
 
+  // The result of a (re)load: everything the UI thread needs to swap in the new set of styles
+  struct Snapshot {
+    std::shared_ptr<StyleLibrary> library;      // backs the entries' pixels, unless owned
+    std::vector<StyleLibrary::Entry> entries;
+    std::vector<cv::Mat> owned;                 // images of entries that couldn't be written to a library
+    std::shared_ptr<StyleIndex> index;          // of the styles kept
+    std::unordered_map<std::string, std::string> duplicates;
+  };
+
+  struct PrefetchJob {
+    std::string path;
+    uint64_t ticket;
+    std::shared_ptr<StyleLibrary> library;      // keeps the image mapped
+    cv::Mat image;
+  };
+
+  struct Prefetched {
+    std::string path;
+    uint64_t ticket;
+    std::vector<float> blob;
+  };
+
+  struct DecodedThumbnail {
+    std::string path;
+    uint64_t ticket;
+    cv::Mat image;
+  };
+
   std::unordered_map<std::string, StyleImage> m_Images;
+  std::vector<StyleImage*> m_List;              // m_Images sorted by path, without the near-duplicates
+  uint64_t m_ListVersion = 0;
+  size_t m_OwnedImageBytes = 0;                 // images not backed by the library
   
   std::string m_ActiveImage;
+
+  std::string m_BlendImage;
+  float m_BlendWeight = 0.5f;
+  std::vector<float> m_BlendBlob;
+  bool m_BlendDirty = true;
+
+  // backs m_Images
+  std::shared_ptr<StyleLibrary> m_Library;
+
+  std::shared_ptr<StyleIndex> m_Index;
+  std::unordered_map<std::string, std::string> m_Duplicates;
+
+  Residency m_Residency;
+  std::list<std::string> m_Resident;  // styles with a materialized tensor, most recently used first
+  std::vector<std::string> m_Pinned;
+
+  ThumbnailTextures* m_Textures = nullptr;
+
+  // All thumbnails live in a few atlas pages, so the style list draws with one or two texture binds
+  ThumbnailAtlas m_Atlas;
+  std::vector<void*> m_AtlasPages;  // texture ids by page, null if not created
+
+  std::mutex m_ThumbnailMutex;
+  std::vector<DecodedThumbnail> m_DecodedThumbnails;
+  std::vector<std::future<void>> m_ThumbnailJobs;
+  uint64_t m_NextThumbnailTicket = 1;
+
+  // decoding and preprocessing of the style images
+  ThreadPool m_Workers;
+
+  std::unique_ptr<DirectoryWatcher> m_Watcher;
+
+  // Background loading, one snapshot at a time
+  std::thread m_Loader;
+  mutable std::mutex m_LoaderMutex;
+  std::condition_variable m_LoaderWork;
+  bool m_ReloadRequested = false;
+  bool m_ReloadAll = false;                     // else only m_ReloadNames changed
+  std::unordered_set<std::string> m_ReloadNames;
+  bool m_Loading = false;
+  bool m_LoaderStop = false;
+  std::unique_ptr<Snapshot> m_Pending;          // finished, waiting for update()
+
+  // Prefetching: blobs of the styles likely to be picked next (hovered, recently used, on screen)
+  // are made ahead of time on a low priority thread and swapped in by update()
+  std::thread m_Prefetcher;
+  std::mutex m_PrefetchMutex;
+  std::condition_variable m_PrefetchWork;
+  std::vector<PrefetchJob> m_PrefetchJobs;      // most likely first, replaced every frame
+  std::vector<Prefetched> m_Prefetched;
+  std::string m_PrefetchInFlight;
+  bool m_PrefetchStop = false;
+  uint64_t m_NextPrefetchTicket = 1;
+
+  std::string m_Hovered;
+  std::vector<size_t> m_Visible;
+  std::deque<std::string> m_History;            // previously active styles, most recent first
+
+  // Loader state: the newest library. Every write is a new generation (<folder>.<N>.pack, written
+  // to a temporary file and renamed), so no file is ever rewritten while something maps it.
+  std::shared_ptr<StyleLibrary> m_LoaderLibrary;
+  std::filesystem::path m_LoaderLibraryPath;
+  int64_t m_LoaderGeneration = -1;              // newest on disk, -1 - before the first scan
+  bool m_LoaderLibraryCurrent = false;          // holds every file in the folder as of the last scan
+
+  // Older generations, deleted once nothing here maps them (deleting fails on Windows while
+  // another process still maps one, it is retried on the next scan)
+  struct RetiredLibrary {
+    std::filesystem::path path;
+    std::weak_ptr<StyleLibrary> library;
+  };
+
+  std::vector<RetiredLibrary> m_RetiredLibraries;
+
+
+  // Returns null if nothing changed since the last scan (unless forced). With the names of the changed
+  // files only those are looked at, the rest is taken from the library (if it is current).
+  std::unique_ptr<Snapshot> scan(bool force, const std::unordered_set<std::string>* changed = nullptr);
+  void loaderLoop();
+
+  // Opens the newest library generation, retiring the others
+  void openNewestLibrary();
+
+  // Writes the entries as the next library generation, null on failure
+  std::shared_ptr<StyleLibrary> writeLibrary(const std::vector<StyleLibrary::Entry>& entries);
+
+  void deleteRetiredLibraries();
+
+  void prefetcherLoop();
+  void updatePrefetch();
+  void stopPrefetcher();
+
+  void publish(Snapshot& snapshot);
+  void releaseImages();
+
+  // Style images, tensors and atlas pages in MemoryAccounting
+  void updateMemoryAccounts() const;
+
+  // Creates the atlas pages added since the last call and uploads the queued thumbnails
+  void uploadThumbnails();
+  void uploadDecodedThumbnails();
+
+  void materializeBlob(StyleImage& img) const;
+
+  // bytes a materialized style costs
+  size_t tensorBytes() const;
+
+  void acquire(StyleImage& img);
+  void evict(StyleImage& img);
+
+  // Pins (and materializes) the active style and its neighbours, then trims to the budget
+  void updatePins();
+  void trim();
 };
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "StyleIndex.h"
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+  const float ColourWeight = 0.6f;
+  const float TextureWeight = 0.4f;   // per scale
+  const float LayoutWeight = 0.6f;
+  const float MinLayoutContrast = 64.0f;  // length of the cell mean deviations, 8-bit units
+
+
+  // Eight partial sums: one running sum is a serial chain of float additions, which the compiler
+  // may not reorder, so it doesn't vectorize. Independent sums map onto SIMD lanes.
+  float Dot(const float* a, const float* b) {
+    static_assert(StyleIndex::DescriptorSize % 8 == 0, "descriptors are whole blocks of 8");
+
+    float sums[8] = {};
+    for (int i = 0; i < StyleIndex::DescriptorSize; i += 8) {
+      for (int j = 0; j < 8; j++) {
+        sums[j] += a[i + j] * b[i + j];
+      }
+    }
+
+    return ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+  }
+
+
+
+  // L1 normalize, square root, then weigh: the result has length `weight`
+  void Hellinger(float* histogram, int bins, float weight) {
+    float total = 0.0f;
+    for (int i = 0; i < bins; i++) {
+      total += histogram[i];
+    }
+
+    for (int i = 0; i < bins; i++) {
+      histogram[i] = total > 0.0f ? weight * std::sqrt(histogram[i] / total) : 0.0f;
+    }
+  }
+
+
+
+  // Magnitude-weighted, unsigned gradient orientations of every step-th pixel, central differences over step pixels
+  void Orientations(const std::vector<float>& gray, int width, int height, int step, float* histogram) {
+    const float pi = 3.14159265f;
+
+    for (int y = step; y < height - step; y += step) {
+      for (int x = step; x < width - step; x += step) {
+        float gx = gray[y * width + x + step] - gray[y * width + x - step];
+        float gy = gray[(y + step) * width + x] - gray[(y - step) * width + x];
+
+        float magnitude = std::sqrt(gx * gx + gy * gy);
+        if (magnitude == 0.0f) {
+          continue;
+        }
+
+        float angle = std::atan2(gy, gx);
+        if (angle < 0.0f) {
+          angle += pi;
+        }
+
+        int bin = std::min(StyleIndex::OrientationBins - 1, static_cast<int>(angle / pi * StyleIndex::OrientationBins));
+        histogram[bin] += magnitude;
+      }
+    }
+  }
+}
+
+
+
+void StyleIndex::describe(const uint8_t* bgr, int width, int height, float* descriptor) {
+  std::fill(descriptor, descriptor + DescriptorSize, 0.0f);
+
+  float* colour = descriptor;
+  float* texture = descriptor + ColourBins;
+  float* layout = texture + 2 * OrientationBins;
+
+  std::vector<float> gray(static_cast<size_t>(width) * height);
+
+  for (int y = 0; y < height; y++) {
+    float* row = layout + (y * LayoutCells / height) * LayoutCells * 3;
+
+    for (int x = 0; x < width; x++) {
+      int i = y * width + x;
+      const uint8_t* px = bgr + 3 * i;
+
+      colour[(px[0] >> 6) * 16 + (px[1] >> 6) * 4 + (px[2] >> 6)] += 1.0f;
+      gray[i] = 0.114f * px[0] + 0.587f * px[1] + 0.299f * px[2];
+
+      float* cell = row + (x * LayoutCells / width) * 3;
+      cell[0] += px[0];
+      cell[1] += px[1];
+      cell[2] += px[2];
+    }
+  }
+
+  Orientations(gray, width, height, 1, texture);
+  Orientations(gray, width, height, 2, texture + OrientationBins);
+
+  Hellinger(colour, ColourBins, ColourWeight);
+  Hellinger(texture, OrientationBins, TextureWeight);
+  Hellinger(texture + OrientationBins, OrientationBins, TextureWeight);
+
+  // layout: cell means minus the image mean, scaled to the weight
+  const int layoutSize = LayoutCells * LayoutCells * 3;
+  const float cellPixels = static_cast<float>(width) * height / (LayoutCells * LayoutCells);
+
+  float mean[3] = {};
+  for (int i = 0; i < layoutSize; i++) {
+    layout[i] /= cellPixels;
+    mean[i % 3] += layout[i] / (LayoutCells * LayoutCells);
+  }
+
+  float layoutLength = 0.0f;
+  for (int i = 0; i < layoutSize; i++) {
+    layout[i] -= mean[i % 3];
+    layoutLength += layout[i] * layout[i];
+  }
+
+  // a (nearly) flat layout stays short, rather than blowing up noise
+  layoutLength = std::max(std::sqrt(layoutLength), MinLayoutContrast);
+  for (int i = 0; i < layoutSize; i++) {
+    layout[i] = LayoutWeight * layout[i] / layoutLength;
+  }
+
+  float length = std::sqrt(Dot(descriptor, descriptor));
+  if (length > 0.0f) {
+    for (int i = 0; i < DescriptorSize; i++) {
+      descriptor[i] /= length;
+    }
+  }
+}
+
+
+
+void StyleIndex::clear() {
+  m_Keys.clear();
+  m_Lookup.clear();
+  m_Descriptors.clear();
+}
+
+
+
+void StyleIndex::reserve(size_t count) {
+  m_Keys.reserve(count);
+  m_Lookup.reserve(count);
+  m_Descriptors.reserve(count * DescriptorSize);
+}
+
+
+
+void StyleIndex::add(const std::string& key, const float* descriptor) {
+  m_Lookup[key] = m_Keys.size();
+  m_Keys.push_back(key);
+  m_Descriptors.insert(m_Descriptors.end(), descriptor, descriptor + DescriptorSize);
+}
+
+
+
+const float* StyleIndex::find(const std::string& key) const {
+  auto it = m_Lookup.find(key);
+  if (it == m_Lookup.end()) {
+    return nullptr;
+  }
+
+  return m_Descriptors.data() + it->second * DescriptorSize;
+}
+
+
+
+std::vector<StyleIndex::Match> StyleIndex::nearest(const float* descriptor, int k, const std::string& exclude) const {
+  std::vector<Match> matches;
+  matches.reserve(m_Keys.size());
+
+  for (size_t i = 0; i < m_Keys.size(); i++) {
+    if (m_Keys[i] != exclude) {
+      matches.push_back({ i, Dot(descriptor, m_Descriptors.data() + i * DescriptorSize) });
+    }
+  }
+
+  k = std::min(std::max(0, k), static_cast<int>(matches.size()));
+
+  auto bySimilarity = [](const Match& a, const Match& b) { return a.similarity > b.similarity; };
+  std::partial_sort(matches.begin(), matches.begin() + k, matches.end(), bySimilarity);
+
+  matches.resize(k);
+  return matches;
+}
+
+
+
+bool StyleIndex::findSimilar(const float* descriptor, float minSimilarity, size_t& index) const {
+  for (size_t i = 0; i < m_Keys.size(); i++) {
+    if (Dot(descriptor, m_Descriptors.data() + i * DescriptorSize) >= minSimilarity) {
+      index = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+
+std::vector<size_t> StyleIndex::findDuplicates(float minSimilarity, ThreadPool& pool) const {
+  const size_t BlockSize = 256;
+
+  std::vector<size_t> duplicateOf(m_Keys.size());
+  std::vector<size_t> representatives;
+
+  auto similar = [&](size_t i, size_t j) {
+    return Dot(m_Descriptors.data() + i * DescriptorSize, m_Descriptors.data() + j * DescriptorSize) >= minSimilarity;
+  };
+
+  // In index order, each entry joins the first group whose representative it's close to, or starts one.
+  // A block at a time: against the groups so far in parallel, then against those started within the block.
+  for (size_t begin = 0; begin < m_Keys.size(); begin += BlockSize) {
+    size_t end = std::min(m_Keys.size(), begin + BlockSize);
+    size_t known = representatives.size();
+
+    pool.parallelFor(end - begin, [&](size_t k) {
+      size_t i = begin + k;
+      duplicateOf[i] = i;
+
+      for (size_t r = 0; r < known; r++) {
+        if (similar(i, representatives[r])) {
+          duplicateOf[i] = representatives[r];
+          break;
+        }
+      }
+    });
+
+    for (size_t i = begin; i < end; i++) {
+      for (size_t r = known; r < representatives.size() && duplicateOf[i] == i; r++) {
+        if (similar(i, representatives[r])) {
+          duplicateOf[i] = representatives[r];
+        }
+      }
+
+      if (duplicateOf[i] == i) {
+        representatives.push_back(i);
+      }
+    }
+  }
+
+  return duplicateOf;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+class ThreadPool;
+
+
+//
+// Similarity index over style descriptors. A descriptor is a cheap colour, texture and layout
+// signature of the style tensor: a 4x4x4 BGR histogram and gradient orientation histograms at two
+// scales (square-rooted, Hellinger), plus the mean colours of a 4x4 grid (relative to the image
+// mean), normalized so the dot product of two is their cosine similarity. The histograms find
+// styles that look alike, the layout tells near-duplicates of one image from merely similar ones.
+//
+// Queries are brute force over one contiguous matrix, the dot products in SIMD-friendly partial
+// sums; tens of thousands of styles take well under a millisecond.
+//
+class StyleIndex {
+public:
+
+  static constexpr int ColourBins = 64;
+  static constexpr int OrientationBins = 8;
+  static constexpr int LayoutCells = 4;
+  static constexpr int DescriptorSize = ColourBins + 2 * OrientationBins + LayoutCells * LayoutCells * 3;
+
+  struct Match {
+    size_t index;
+    float similarity;
+  };
+
+  static void describe(const uint8_t* bgr, int width, int height, float* descriptor);
+
+  void clear();
+  void reserve(size_t count);
+
+  void add(const std::string& key, const float* descriptor);
+
+  size_t size() const { return m_Keys.size(); }
+  const std::string& getKey(size_t index) const { return m_Keys[index]; }
+
+  // Null if the key isn't indexed
+  const float* find(const std::string& key) const;
+
+  // The k entries most similar to the descriptor, most similar first, skipping `exclude`
+  std::vector<Match> nearest(const float* descriptor, int k, const std::string& exclude = {}) const;
+
+  // Finds the first entry at least minSimilarity to the descriptor, false if there is none
+  bool findSimilar(const float* descriptor, float minSimilarity, size_t& index) const;
+
+  // For every entry, the entry it is a near-duplicate of: the first group representative (in index
+  // order) it is at least minSimilarity to. Itself if it's unique, it represents a group then.
+  // Entries are compared to representatives only, so a chain of small steps doesn't merge styles
+  // that differ.
+  std::vector<size_t> findDuplicates(float minSimilarity, ThreadPool& pool) const;
+
+private:
+
+  std::vector<std::string> m_Keys;
+  std::unordered_map<std::string, size_t> m_Lookup;
+  std::vector<float> m_Descriptors;   // size() x DescriptorSize
+};
\ No newline at end of file
@@ -0,0 +1,285 @@
+#include "StyleLibrary.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+  const char Magic[4] = { 'S', 'T', 'Y', 'L' };
+  const uint32_t Version = 3;
+
+  const uint32_t NoDuplicate = UINT32_MAX;
+
+  // Tensors start on cache line boundaries
+  const uint64_t TensorAlignment = 64;
+
+#pragma pack(push, 1)
+  struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t count;
+    uint32_t descriptorSize;    // floats
+    uint32_t reserved;
+  };
+
+  struct EntryRecord {
+    uint64_t nameOffset;
+    uint64_t pixelsOffset;      // 0 - not an image
+    uint64_t descriptorOffset;
+    uint64_t thumbnailOffset;
+    int64_t mtime;
+    uint32_t nameSize;
+    uint32_t thumbnailSize;
+    uint32_t duplicateOf;       // entry index, NoDuplicate if unique
+  };
+#pragma pack(pop)
+
+
+  uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+}
+
+
+
+bool StyleLibrary::open(const fs::path& path, int width, int height, int channels, int descriptorSize) {
+  close();
+
+  if (!fs::exists(path) || !m_File.open(path)) {
+    return false;
+  }
+
+  const auto* data = static_cast<const uint8_t*>(m_File.data());
+  uint64_t size = m_File.size();
+
+  auto fail = [&](const char* reason) {
+    std::cout << "Ignoring style library " << path.string() << ": " << reason << std::endl;
+    close();
+    return false;
+  };
+
+  if (size < sizeof(FileHeader)) {
+    return fail("truncated");
+  }
+
+  FileHeader header;
+  std::memcpy(&header, data, sizeof(header));
+
+  if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version) {
+    return fail("unknown format");
+  }
+
+  if (header.width != static_cast<uint32_t>(width) || header.height != static_cast<uint32_t>(height) || header.channels != static_cast<uint32_t>(channels)) {
+    return fail("built for another tensor size");
+  }
+
+  if (header.descriptorSize != static_cast<uint32_t>(descriptorSize)) {
+    return fail("built for another descriptor");
+  }
+
+  if (header.count > (size - sizeof(FileHeader)) / sizeof(EntryRecord)) {
+    return fail("truncated");
+  }
+
+  uint64_t tensorSize = static_cast<uint64_t>(width) * height * channels;
+  uint64_t descriptorBytes = static_cast<uint64_t>(descriptorSize) * sizeof(float);
+
+  // any range must lie within the file
+  auto inside = [&](uint64_t offset, uint64_t length) {
+    return offset <= size && length <= size - offset;
+  };
+
+  m_Entries.reserve(header.count);
+
+  std::vector<uint32_t> duplicateOf(header.count, NoDuplicate);
+
+  for (uint32_t i = 0; i < header.count; i++) {
+    EntryRecord record;
+    std::memcpy(&record, data + sizeof(FileHeader) + i * sizeof(EntryRecord), sizeof(record));
+
+    if (!inside(record.nameOffset, record.nameSize) ||
+      (record.pixelsOffset && !inside(record.pixelsOffset, tensorSize)) ||
+      (record.pixelsOffset && !inside(record.descriptorOffset, descriptorBytes)) ||
+      (record.pixelsOffset && !inside(record.thumbnailOffset, record.thumbnailSize))) {
+      return fail("entry out of bounds");
+    }
+
+    if (record.pixelsOffset && record.descriptorOffset % alignof(float) != 0) {
+      return fail("misaligned descriptor");
+    }
+
+    Entry entry;
+    entry.name.assign(reinterpret_cast<const char*>(data + record.nameOffset), record.nameSize);
+    entry.mtime = record.mtime;
+
+    if (record.pixelsOffset) {
+      entry.pixels = data + record.pixelsOffset;
+      entry.descriptor = reinterpret_cast<const float*>(data + record.descriptorOffset);
+      entry.thumbnail = data + record.thumbnailOffset;
+      entry.thumbnailSize = record.thumbnailSize;
+    }
+
+    if (record.duplicateOf != NoDuplicate && record.duplicateOf >= header.count) {
+      return fail("entry out of bounds");
+    }
+
+    duplicateOf[i] = record.duplicateOf;
+
+    m_Index[entry.name] = m_Entries.size();
+    m_Entries.push_back(std::move(entry));
+  }
+
+  for (size_t i = 0; i < m_Entries.size(); i++) {
+    if (duplicateOf[i] != NoDuplicate) {
+      m_Entries[i].duplicateOf = m_Entries[duplicateOf[i]].name;
+    }
+  }
+
+  m_TensorSize = static_cast<size_t>(tensorSize);
+
+  return true;
+}
+
+
+
+void StyleLibrary::close() {
+  m_Entries.clear();
+  m_Index.clear();
+  m_TensorSize = 0;
+  m_File.close();
+}
+
+
+
+const StyleLibrary::Entry* StyleLibrary::find(const std::string& name) const {
+  auto it = m_Index.find(name);
+  if (it == m_Index.end()) {
+    return nullptr;
+  }
+
+  return &m_Entries[it->second];
+}
+
+
+
+void StyleLibrary::discard(const uint8_t* pixels) const {
+  if (pixels) {
+    m_File.discard(pixels, m_TensorSize);
+  }
+}
+
+
+
+bool StyleLibrary::write(const fs::path& path, int width, int height, int channels, int descriptorSize, const std::vector<Entry>& entries) {
+  uint64_t tensorSize = static_cast<uint64_t>(width) * height * channels;
+  uint64_t descriptorBytes = static_cast<uint64_t>(descriptorSize) * sizeof(float);
+
+  // Layout: header, records, tensors, descriptors, thumbnails, names
+
+  std::vector<EntryRecord> records(entries.size());
+
+  std::unordered_map<std::string, uint32_t> indices;
+  for (size_t i = 0; i < entries.size(); i++) {
+    indices[entries[i].name] = static_cast<uint32_t>(i);
+  }
+
+  uint64_t offset = sizeof(FileHeader) + entries.size() * sizeof(EntryRecord);
+  offset = AlignUp(offset, TensorAlignment);
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (entries[i].pixels) {
+      records[i].pixelsOffset = offset;
+      offset = AlignUp(offset + tensorSize, TensorAlignment);
+    }
+    else {
+      records[i].pixelsOffset = 0;
+    }
+  }
+
+  // right after the (aligned) tensors, so aligned for floats
+  for (size_t i = 0; i < entries.size(); i++) {
+    records[i].descriptorOffset = entries[i].pixels ? offset : 0;
+    offset += entries[i].pixels ? descriptorBytes : 0;
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    records[i].thumbnailOffset = entries[i].pixels ? offset : 0;
+    records[i].thumbnailSize = entries[i].pixels ? static_cast<uint32_t>(entries[i].thumbnailSize) : 0;
+    offset += records[i].thumbnailSize;
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    records[i].nameOffset = offset;
+    records[i].nameSize = static_cast<uint32_t>(entries[i].name.size());
+    records[i].mtime = entries[i].mtime;
+    offset += records[i].nameSize;
+
+    auto duplicate = entries[i].duplicateOf.empty() ? indices.end() : indices.find(entries[i].duplicateOf);
+    records[i].duplicateOf = duplicate != indices.end() ? duplicate->second : NoDuplicate;
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    std::cout << "Failed to create " << path.string() << std::endl;
+    return false;
+  }
+
+  FileHeader header = {};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.width = width;
+  header.height = height;
+  header.channels = channels;
+  header.count = static_cast<uint32_t>(entries.size());
+  header.descriptorSize = descriptorSize;
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(EntryRecord));
+
+  auto pad = [&](uint64_t to) {
+    static const char zeros[TensorAlignment] = {};
+    auto pos = static_cast<uint64_t>(file.tellp());
+    if (to > pos) {
+      file.write(zeros, to - pos);
+    }
+  };
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (entries[i].pixels) {
+      pad(records[i].pixelsOffset);
+      file.write(reinterpret_cast<const char*>(entries[i].pixels), tensorSize);
+    }
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (entries[i].pixels) {
+      pad(records[i].descriptorOffset);
+      file.write(reinterpret_cast<const char*>(entries[i].descriptor), descriptorBytes);
+    }
+  }
+
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (records[i].thumbnailSize) {
+      pad(records[i].thumbnailOffset);
+      file.write(reinterpret_cast<const char*>(entries[i].thumbnail), records[i].thumbnailSize);
+    }
+  }
+
+  for (const auto& entry : entries) {
+    file.write(entry.name.data(), entry.name.size());
+  }
+
+  if (!file) {
+    std::cout << "Failed to write " << path.string() << std::endl;
+    return false;
+  }
+
+  return true;
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+//
+// Packed style library: one file holding, for every file in the styles folder, its name, mtime,
+// the 8-bit BGR style tensor (model input size, crop and resize already applied), its similarity
+// descriptor (see StyleIndex) and a compressed (JPEG) thumbnail. The file is memory-mapped, so
+// style data lives in the page cache and is shared by every process using the same library.
+//
+// Files that aren't images are recorded too (without tensor/thumbnail) so they aren't retried
+// on every load. Near-duplicate detection is stored as well, so a reload only compares what changed.
+// Multi-byte fields are little-endian.
+//
+class StyleLibrary {
+public:
+
+  struct Entry {
+    std::string name;                 // file name within the styles folder
+    int64_t mtime = 0;                // file_time_type ticks
+
+    const uint8_t* pixels = nullptr;  // width x height x channels, null if the file is not an image
+    const float* descriptor = nullptr;
+    const uint8_t* thumbnail = nullptr;
+    size_t thumbnailSize = 0;
+
+    std::string duplicateOf;          // name of the entry this one is a near-duplicate of, empty if unique
+  };
+
+  StyleLibrary() = default;
+
+  StyleLibrary(const StyleLibrary&) = delete;
+  StyleLibrary(StyleLibrary&&) = delete;
+
+  StyleLibrary& operator=(const StyleLibrary&) = delete;
+  StyleLibrary& operator=(StyleLibrary&&) = delete;
+
+  // Fails if the file is missing, corrupt or was built for another tensor or descriptor size
+  bool open(const std::filesystem::path& path, int width, int height, int channels, int descriptorSize);
+  void close();
+
+  bool isOpen() const { return m_File.isOpen(); }
+
+  const std::vector<Entry>& getEntries() const { return m_Entries; }
+  const Entry* find(const std::string& name) const;
+
+  // Drops the pages of an entry's tensor (Entry::pixels) from memory until they are next touched
+  void discard(const uint8_t* pixels) const;
+
+  // Writes a library with the given entries. Their data may point into the currently mapped library.
+  static bool write(const std::filesystem::path& path, int width, int height, int channels, int descriptorSize, const std::vector<Entry>& entries);
+
+private:
+
+  MappedFile m_File;
+
+  std::vector<Entry> m_Entries;
+  std::unordered_map<std::string, size_t> m_Index;
+
+  size_t m_TensorSize = 0;
+};
\ No newline at end of file
@@ -5,10 +5,14 @@
 #include "Stylish.h"
 
 #include "CaptureWindow.h"
+#include "CaptureRecording.h"
 #include "UiControls.h"
 #include "Inference.h"
 #include "StyleImageCache.h"
 #include "PerformanceMetrics.h"
+#include "Instrumentation.h"
+#include "MemoryAccounting.h"
+#include "SpanRecorder.h"
 
 #include <windows.h>
 #include <DbgHelp.h>
@@ -17,10 +21,6 @@
 #include <shellscalingapi.h>
 
 
-// uncomment to view perfomance metrics
-//#define MEASURE_PERF
-
-
 namespace {
   HINSTANCE hInst;
 
@@ -33,6 +33,9 @@ namespace {
   // Capture window
   std::unique_ptr<CaptureWindow> g_CaptureWindow;
 
+  // Records captured frames on demand (from the UI)
+  std::unique_ptr<CaptureRecorder> g_CaptureRecorder;
+
   // ImGui UI (D3D11 backend)
   std::unique_ptr<UiControls> g_UI;
 
@@ -64,6 +67,9 @@ namespace {
               ShowWindow(g_UI->getWindowHandle(), SW_SHOW);
             }
           }
+          else if ((GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_SHIFT) & 0x8000) && (keyInfo->vkCode == VK_F9)) {
+            g_UI->dumpTrace();
+          }
         }
       }
     }
@@ -106,20 +112,27 @@ int main() {
 
   SetUnhandledExceptionFilter(AppUnhandledExceptionFilter);
 
-  std::unique_ptr<PerfMetrics> perfMetrics;
-#ifdef MEASURE_PERF
-  perfMetrics = std::make_unique<PerfMetrics>();
-#endif // MEASURE_PERF
+  // capture, inference and UI all run on this thread
+  SpanRecorder::instance().nameThread("main");
+
+  // off unless turned on by STYLISH_METRICS, the ini or the UI
+  Instrumentation::initFromEnvironment();
+
+  // before any Mat is made
+  MemoryAccounting::installMatAllocator();
+
+  auto perfMetrics = std::make_unique<PerfMetrics>();
 
   g_Inf = std::make_unique<Inference>(perfMetrics.get());
   g_StyleImageCache = std::make_unique<StyleImageCache>();
+  g_CaptureRecorder = std::make_unique<CaptureRecorder>();
 
   // Create windows
   hInst = GetModuleHandle(NULL);
   auto nCmdShow = SW_NORMAL;
 
-  g_CaptureWindow = std::make_unique<CaptureWindow>(hInst, nCmdShow, g_Inf.get(), g_StyleImageCache.get());
-  g_UI = std::make_unique<UiControls>(hInst, g_CaptureWindow->getWindowHandle(), nCmdShow, g_Inf.get(), g_StyleImageCache.get(), perfMetrics.get());
+  g_CaptureWindow = std::make_unique<CaptureWindow>(hInst, nCmdShow, g_Inf.get(), g_StyleImageCache.get(), perfMetrics.get(), g_CaptureRecorder.get());
+  g_UI = std::make_unique<UiControls>(hInst, g_CaptureWindow->getWindowHandle(), nCmdShow, g_Inf.get(), g_StyleImageCache.get(), perfMetrics.get(), g_CaptureRecorder.get());
 
   // Set up the keyboard hook
   keyboardHook = SetWindowsHookEx(WH_KEYBOARD_LL, KeyboardProc, NULL, 0);
@@ -139,6 +152,7 @@ int main() {
 
   g_UI.reset();
   g_CaptureWindow.reset();
+  g_CaptureRecorder.reset();
   g_StyleImageCache.reset();
   g_Inf.reset();
 
@@ -0,0 +1,188 @@
+//
+// CaptureRecording: recording frames and reading them back (keyframes, deltas, size changes, dirty
+// rects), rewinding, and refusing other files
+//
+
+#include "CaptureRecording.h"
+#include "Check.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+  using CaptureRecording::Rect;
+
+  struct Source {
+    cv::Mat bgra;                 // with a padded stride, as captures often are
+    std::vector<Rect> dirty;
+  };
+
+
+  // a few frames of one size with small edits between them, then a size change
+  std::vector<Source> MakeSources() {
+    std::vector<Source> sources;
+
+    cv::Mat base(48, 64, CV_8UC4);
+    cv::randu(base, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    for (int i = 0; i < 3; i++) {
+      cv::Mat padded(48, 64 + 4, CV_8UC4, cv::Scalar::all(0));
+      Source source;
+      source.bgra = padded(cv::Rect(0, 0, 64, 48));
+      base.copyTo(source.bgra);
+
+      cv::rectangle(source.bgra, cv::Rect(i * 10, i * 5, 8, 8), cv::Scalar(i * 40, 255, 0, 255), cv::FILLED);
+      source.dirty = { { i * 10, i * 5, i * 10 + 8, i * 5 + 8 } };
+
+      sources.push_back(source);
+    }
+
+    for (int i = 0; i < 2; i++) {
+      Source source;
+      source.bgra = cv::Mat(32, 32, CV_8UC4);
+      cv::randu(source.bgra, cv::Scalar::all(0), cv::Scalar::all(255));
+      source.dirty = { { 0, 0, 32, 32 }, { 1, 2, 3, 4 } };
+
+      sources.push_back(source);
+    }
+
+    return sources;
+  }
+
+
+  bool SameImage(const cv::Mat& bgr, const cv::Mat& bgra) {
+    cv::Mat expected;
+    cv::cvtColor(bgra, expected, cv::COLOR_BGRA2BGR);
+    return bgr.size() == expected.size() && bgr.type() == expected.type() && cv::norm(bgr, expected, cv::NORM_INF) == 0;
+  }
+
+
+  bool SameRects(const std::vector<Rect>& a, const std::vector<Rect>& b) {
+    if (a.size() != b.size()) {
+      return false;
+    }
+
+    for (size_t i = 0; i < a.size(); i++) {
+      if (a[i].left != b[i].left || a[i].top != b[i].top || a[i].right != b[i].right || a[i].bottom != b[i].bottom) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+
+
+  void TestRoundTrip(const fs::path& folder) {
+    auto sources = MakeSources();
+    auto path = (folder / "capture.strec").string();
+
+    // fewer frames than the encoder queue holds, so none are dropped
+    CaptureRecorder recorder;
+    CHECK(recorder.start(path));
+    CHECK(recorder.isRecording());
+
+    for (const auto& source : sources) {
+      recorder.add(source.bgra.data, source.bgra.cols, source.bgra.rows, source.bgra.step, source.dirty);
+    }
+
+    recorder.stop();
+    CHECK(!recorder.isRecording());
+    CHECK(recorder.getRecorded() == sources.size());
+    CHECK(recorder.getDropped() == 0);
+    CHECK(recorder.getBytes() == fs::file_size(path));
+
+    CaptureReader reader;
+    CHECK(reader.open(path));
+
+    CaptureRecording::Frame frame;
+    uint64_t lastTime = 0;
+
+    for (size_t i = 0; i < sources.size(); i++) {
+      CHECK(reader.next(frame));
+      CHECK(SameImage(frame.image, sources[i].bgra));
+      CHECK(SameRects(frame.dirty, sources[i].dirty));
+      CHECK(frame.timeUs >= lastTime);
+
+      // the first frame and the first of a new size are keyframes, the rest deltas
+      CHECK(frame.keyframe == (i == 0 || i == 3));
+
+      lastTime = frame.timeUs;
+    }
+
+    CHECK(!reader.next(frame));
+
+    CHECK(reader.rewind());
+    CHECK(reader.next(frame));
+    CHECK(SameImage(frame.image, sources[0].bgra));
+    CHECK(reader.next(frame));
+    CHECK(SameImage(frame.image, sources[1].bgra));
+
+    // a recording cut short reads up to the damaged record
+    auto truncated = (folder / "truncated.strec").string();
+    fs::copy_file(path, truncated);
+    fs::resize_file(truncated, fs::file_size(truncated) - 10);
+
+    CaptureReader cut;
+    CHECK(cut.open(truncated));
+
+    size_t frames = 0;
+    while (cut.next(frame)) {
+      frames++;
+    }
+
+    CHECK(frames == sources.size() - 1);
+  }
+
+
+
+  void TestNotARecording(const fs::path& folder) {
+    auto path = (folder / "other.bin").string();
+    std::ofstream(path, std::ios::binary) << "definitely not a recording";
+
+    CaptureReader reader;
+    CHECK(!reader.open(path));
+    CHECK(!reader.open((folder / "missing.strec").string()));
+    CHECK(!reader.rewind());
+  }
+
+
+
+  void TestNotStarted() {
+    CaptureRecorder recorder;
+
+    cv::Mat bgra(8, 8, CV_8UC4, cv::Scalar::all(1));
+    recorder.add(bgra.data, bgra.cols, bgra.rows, bgra.step, {});
+
+    CHECK(!recorder.isRecording());
+    CHECK(recorder.getRecorded() == 0);
+    CHECK(recorder.getDropped() == 0);
+  }
+}
+
+
+
+int main() {
+  auto folder = fs::temp_directory_path() / "stylish-test-recording";
+
+  std::error_code ec;
+  fs::remove_all(folder, ec);
+  fs::create_directories(folder);
+
+  TestRoundTrip(folder);
+  TestNotARecording(folder);
+  TestNotStarted();
+
+  fs::remove_all(folder, ec);
+
+  return Tests::Result();
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <iostream>
+
+
+//
+// Bare-bones checks for the test executables: a failed check prints itself and makes the exit
+// code 1, the remaining checks still run.
+//
+namespace Tests {
+  inline int& Failures() {
+    static int failures = 0;
+    return failures;
+  }
+
+  inline void Check(bool ok, const char* expression, const char* file, int line) {
+    if (!ok) {
+      std::cout << file << ":" << line << ": check failed: " << expression << std::endl;
+      Failures()++;
+    }
+  }
+
+  // for main's return
+  inline int Result() {
+    if (Failures() > 0) {
+      std::cout << Failures() << " check(s) failed" << std::endl;
+      return 1;
+    }
+
+    return 0;
+  }
+}
+
+#define CHECK(expression) Tests::Check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
\ No newline at end of file
@@ -0,0 +1,126 @@
+//
+// DirectoryWatcher: a burst of writes is reported once, with each changed name once, after the
+// folder has settled; deletions are reported too
+//
+
+#include "Check.h"
+#include "DirectoryWatcher.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+  // comfortably past the watcher's settle time and polling interval
+  const auto Timeout = std::chrono::seconds(5);
+
+
+  class Reports {
+  public:
+    void add(const std::vector<std::string>& changed) {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Reports.emplace_back(changed.begin(), changed.end());
+      m_Changed.notify_all();
+    }
+
+    // Waits until there are at least count reports, returns all of them so far
+    std::vector<std::set<std::string>> wait(size_t count) {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Changed.wait_for(lock, Timeout, [&] { return m_Reports.size() >= count; });
+      return m_Reports;
+    }
+
+  private:
+    std::mutex m_Mutex;
+    std::condition_variable m_Changed;
+    std::vector<std::set<std::string>> m_Reports;
+  };
+
+
+  void Write(const fs::path& path, const std::string& content) {
+    std::ofstream file(path, std::ios::binary);
+    file << content;
+  }
+
+
+
+  void TestCoalescing(const fs::path& folder) {
+    Reports reports;
+    DirectoryWatcher watcher(folder, [&](const std::vector<std::string>& changed) { reports.add(changed); });
+
+    // let the watcher thread set up before anything happens
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // a file written in pieces and a second one in between, never quiet for long
+    for (int i = 0; i < 10; i++) {
+      Write(folder / "a.png", std::string(1000 * (i + 1), 'a'));
+
+      if (i == 5) {
+        Write(folder / "b.png", "b");
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    }
+
+    auto received = reports.wait(1);
+    CHECK(received.size() == 1);
+
+    // nothing more trickles in after the burst was reported
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    CHECK(reports.wait(1).size() == 1);
+
+    if (!received.empty() && !watcher.isPolling()) {
+      CHECK((received[0] == std::set<std::string>{ "a.png", "b.png" }));
+    }
+
+    fs::remove(folder / "b.png");
+
+    received = reports.wait(2);
+    CHECK(received.size() == 2);
+
+    if (received.size() == 2 && !watcher.isPolling()) {
+      CHECK((received[1] == std::set<std::string>{ "b.png" }));
+    }
+  }
+
+
+
+  void TestQuiet(const fs::path& folder) {
+    Reports reports;
+
+    {
+      DirectoryWatcher watcher(folder, [&](const std::vector<std::string>& changed) { reports.add(changed); });
+      std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+
+    // no changes, nothing reported
+    CHECK(reports.wait(0).empty());
+  }
+}
+
+
+
+int main() {
+  auto folder = fs::temp_directory_path() / "stylish-test-watcher";
+
+  std::error_code ec;
+  fs::remove_all(folder, ec);
+  fs::create_directories(folder);
+
+  TestCoalescing(folder);
+  TestQuiet(folder);
+
+  fs::remove_all(folder, ec);
+
+  return Tests::Result();
+}
\ No newline at end of file
@@ -0,0 +1,145 @@
+//
+// LatencyHistogram: bucket bounds, quantiles within the bucket precision, lifetime vs window, and
+// recording from several threads at once
+//
+
+#include "Check.h"
+#include "LatencyHistogram.h"
+
+#include <cmath>
+#include <thread>
+#include <vector>
+
+
+namespace {
+  // relative error of the log buckets, with some slack for the bucket's middle
+  const float Precision = 0.07f;
+
+
+  bool Near(float value, float expected) {
+    return std::abs(value - expected) <= Precision * expected;
+  }
+
+
+
+  void TestBuckets() {
+    // contiguous (bounds are whole microseconds, so up to float rounding), and past the linear
+    // first microseconds no wider than one sub-bucket
+    for (int i = 0; i + 1 < LatencyHistogram::BucketCount; i++) {
+      float next = LatencyHistogram::bucketLow(i + 1);
+      CHECK(std::abs(LatencyHistogram::bucketHigh(i) - next) <= 1e-6f * next);
+      CHECK(LatencyHistogram::bucketLow(i) < LatencyHistogram::bucketHigh(i));
+
+      if (i >= LatencyHistogram::SubBuckets) {
+        float low = LatencyHistogram::bucketLow(i);
+        CHECK((LatencyHistogram::bucketHigh(i) - low) / low <= 1.0f / LatencyHistogram::SubBuckets + 1e-6f);
+      }
+    }
+
+    CHECK(LatencyHistogram::bucketLow(0) == 0.0f);
+  }
+
+
+
+  void TestEmpty() {
+    LatencyHistogram histogram;
+
+    auto summary = histogram.lifetime();
+    CHECK(summary.count == 0);
+    CHECK(summary.p50 == 0.0f && summary.p99 == 0.0f && summary.max == 0.0f);
+    CHECK(summary.quantile(0.5f) == 0.0f);
+
+    CHECK(histogram.window().count == 0);
+  }
+
+
+
+  void TestQuantiles() {
+    LatencyHistogram histogram;
+
+    // 1..1000 ms
+    for (int i = 1; i <= 1000; i++) {
+      histogram.record(static_cast<float>(i));
+    }
+
+    auto summary = histogram.lifetime();
+    CHECK(summary.count == 1000);
+    CHECK(Near(summary.mean, 500.5f));
+    CHECK(summary.max == 1000.0f);
+    CHECK(Near(summary.p50, 500.0f));
+    CHECK(Near(summary.p90, 900.0f));
+    CHECK(Near(summary.p99, 990.0f));
+    CHECK(summary.p50 <= summary.p90 && summary.p90 <= summary.p99 && summary.p99 <= summary.max);
+
+    CHECK(summary.buckets.size() == LatencyHistogram::BucketCount);
+    CHECK(summary.firstBucket <= summary.lastBucket);
+    CHECK(summary.buckets[summary.firstBucket] > 0 && summary.buckets[summary.lastBucket] > 0);
+
+    // never above the largest sample, even where the bucket's middle is
+    CHECK(summary.quantile(1.0f) <= summary.max);
+
+    // all of it recorded just now, so the window holds the same
+    auto window = histogram.window();
+    CHECK(window.count == summary.count);
+    CHECK(window.p50 == summary.p50 && window.max == summary.max);
+
+    auto p99 = histogram.windowP99();
+    CHECK(p99.size() == LatencyHistogram::WindowSeconds);
+    CHECK(p99.back() > 0.0f || p99[p99.size() - 2] > 0.0f);
+  }
+
+
+
+  void TestOutOfRange() {
+    LatencyHistogram histogram;
+
+    // negative counts as zero, beyond the last bucket goes into it
+    histogram.record(-5.0f);
+    histogram.record(1e9f);
+
+    auto summary = histogram.lifetime();
+    CHECK(summary.count == 2);
+    CHECK(summary.buckets[0] == 1);
+    CHECK(summary.buckets[LatencyHistogram::BucketCount - 1] == 1);
+    CHECK(summary.max == 1e9f);
+  }
+
+
+
+  void TestConcurrentRecording() {
+    LatencyHistogram histogram;
+
+    const int threads = 4;
+    const int samples = 20000;
+
+    std::vector<std::thread> recorders;
+    for (int t = 0; t < threads; t++) {
+      recorders.emplace_back([&histogram, t] {
+        for (int i = 0; i < samples; i++) {
+          histogram.record(1.0f + t);
+        }
+      });
+    }
+
+    for (auto& recorder : recorders) {
+      recorder.join();
+    }
+
+    auto summary = histogram.lifetime();
+    CHECK(summary.count == static_cast<uint64_t>(threads) * samples);
+    CHECK(summary.max == static_cast<float>(threads));
+    CHECK(Near(summary.mean, 2.5f));
+  }
+}
+
+
+
+int main() {
+  TestBuckets();
+  TestEmpty();
+  TestQuantiles();
+  TestOutOfRange();
+  TestConcurrentRecording();
+
+  return Tests::Result();
+}
\ No newline at end of file
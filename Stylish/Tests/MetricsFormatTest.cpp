@@ -0,0 +1,130 @@
+//
+// MetricsFormat: the JSON line, statsd datagrams and Prometheus text for a known snapshot
+//
+
+#include "Check.h"
+#include "MetricsFormat.h"
+
+#include <string>
+#include <vector>
+
+
+namespace {
+  bool Contains(const std::string& text, const std::string& part) {
+    return text.find(part) != std::string::npos;
+  }
+
+
+  size_t Count(const std::string& text, char c) {
+    size_t count = 0;
+    for (char x : text) {
+      count += x == c;
+    }
+    return count;
+  }
+
+
+  MetricsSnapshot Snapshot() {
+    MetricsSnapshot s;
+    s.time = 1700000000123;
+    s.fps = 59.5f;
+    s.provider = "GPU";
+    s.quality = 3;
+    s.modelTier = "fast \"v2\"";
+    s.styleHits = 3;
+    s.styleMisses = 1;
+    s.stylePrefetched = 2;
+    s.stylesResident = 5;
+    s.styleBytes = 4096;
+
+    s.stages[static_cast<int>(PerfMetrics::Stage::Total)].count = 10;
+    s.stages[static_cast<int>(PerfMetrics::Stage::Total)].p50 = 12.5f;
+    s.stages[static_cast<int>(PerfMetrics::Stage::Total)].p99 = 20.0f;
+    s.frameLatency.p90 = 30.0f;
+    s.frames.presented = 100;
+    s.frames.dropped = 7;
+    s.process.resident = 1000;
+    s.process.privateBytes = 800;
+    s.accounts = { { "mats", 64, 128 } };
+    return s;
+  }
+
+
+
+  void TestJsonl() {
+    auto line = FormatMetricsJsonl(Snapshot());
+
+    CHECK(!line.empty() && line.back() == '\n');
+    CHECK(Count(line, '\n') == 1);
+    CHECK(Count(line, '{') == Count(line, '}'));
+
+    CHECK(Contains(line, "{\"time\":1700000000123,\"fps\":59.500,\"provider\":\"GPU\",\"quality\":3"));
+    CHECK(Contains(line, "\"modelTier\":\"fast \\\"v2\\\"\""));
+    CHECK(Contains(line, "\"inference\":{\"total\":{\"count\":10,\"mean\":0.000,\"p50\":12.500,\"p90\":0.000,\"p99\":20.000,\"max\":0.000}"));
+    CHECK(Contains(line, "\"presented\":100,\"dropped\":7,\"skipped\":0,\"reused\":0}"));
+    CHECK(Contains(line, "\"hitRate\":0.750"));
+    CHECK(Contains(line, "\"memory\":{\"resident\":1000,\"private\":800,\"mats\":{\"bytes\":64,\"peak\":128}}}\n"));
+  }
+
+
+
+  void TestStatsd() {
+    auto snapshot = Snapshot();
+    auto datagrams = FormatMetricsStatsd(snapshot, 1400);
+
+    CHECK(!datagrams.empty());
+
+    std::string all;
+    for (const auto& datagram : datagrams) {
+      CHECK(datagram.size() <= 1400);
+      CHECK(!datagram.empty() && datagram.back() == '\n');
+      all += datagram;
+    }
+
+    CHECK(Contains(all, "stylish.provider_gpu:1|g\n"));
+    CHECK(Contains(all, "stylish.quality:3|g\n"));
+    CHECK(Contains(all, "stylish.inference_total_p50_ms:12.5|g\n"));
+    CHECK(Contains(all, "stylish.frame_latency_p90_ms:30|g\n"));
+    CHECK(Contains(all, "stylish.style_hit_rate:0.75|g\n"));
+    CHECK(Contains(all, "stylish.memory_mats_peak_bytes:128|g\n"));
+
+    // no labels in statsd
+    CHECK(!Contains(all, "stage="));
+
+    // small datagrams split between lines, never within one
+    auto small = FormatMetricsStatsd(snapshot, 100);
+    CHECK(small.size() > datagrams.size());
+
+    std::string joined;
+    for (const auto& datagram : small) {
+      CHECK(datagram.size() <= 100);
+      joined += datagram;
+    }
+    CHECK(joined == all);
+  }
+
+
+
+  void TestPrometheus() {
+    auto text = FormatMetricsPrometheus(Snapshot());
+
+    CHECK(text.rfind("stylish_info{provider=\"GPU\",model=\"fast \\\"v2\\\"\"} 1\n", 0) == 0);
+    CHECK(Contains(text, "\nstylish_inference_total_p50_ms{stage=\"total\"} 12.5\n"));
+    CHECK(Contains(text, "\nstylish_inference_post_p99_ms{stage=\"post\"} 0\n"));
+    CHECK(Contains(text, "\nstylish_frame_latency_p90_ms 30\n"));
+    CHECK(Contains(text, "\nstylish_frames_dropped 7\n"));
+    CHECK(Contains(text, "\nstylish_memory_resident_bytes 1000\n"));
+    CHECK(Contains(text, "\nstylish_memory_mats_bytes 64\n"));
+    CHECK(!text.empty() && text.back() == '\n');
+  }
+}
+
+
+
+int main() {
+  TestJsonl();
+  TestStatsd();
+  TestPrometheus();
+
+  return Tests::Result();
+}
\ No newline at end of file
@@ -0,0 +1,210 @@
+//
+// ModelInitializers: the protobuf reader picking a model's inline initializers, referencing aligned
+// ones in place, copying the rest, and leaving ORT format models to the runtime
+//
+
+#include "Check.h"
+#include "ModelInitializers.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace {
+  // ONNX field numbers and data types, as in ModelInitializers.cpp
+  const uint32_t ModelProtoProducerName = 2;
+  const uint32_t ModelProtoGraph = 7;
+  const uint32_t GraphProtoInitializer = 5;
+  const uint32_t TensorProtoDims = 1;
+  const uint32_t TensorProtoDataType = 2;
+  const uint32_t TensorProtoName = 8;
+  const uint32_t TensorProtoRawData = 9;
+  const uint32_t TensorProtoDataLocation = 14;
+
+  const uint64_t Float = 1;
+  const uint64_t Int64 = 7;
+
+
+  // Protobuf wire format writing
+
+  void Varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+      out += static_cast<char>((value & 0x7f) | 0x80);
+      value >>= 7;
+    }
+
+    out += static_cast<char>(value);
+  }
+
+
+  void VarintField(std::string& out, uint32_t field, uint64_t value) {
+    Varint(out, field << 3);
+    Varint(out, value);
+  }
+
+
+  void BytesField(std::string& out, uint32_t field, const std::string& bytes) {
+    Varint(out, (field << 3) | 2);
+    Varint(out, bytes.size());
+    out += bytes;
+  }
+
+
+  std::string Tensor(const std::string& name, uint64_t dataType, const std::vector<uint64_t>& dims, const std::string& raw, bool packedDims = false, bool external = false) {
+    std::string tensor;
+
+    if (packedDims) {
+      std::string packed;
+      for (auto d : dims) {
+        Varint(packed, d);
+      }
+      BytesField(tensor, TensorProtoDims, packed);
+    }
+    else {
+      for (auto d : dims) {
+        VarintField(tensor, TensorProtoDims, d);
+      }
+    }
+
+    VarintField(tensor, TensorProtoDataType, dataType);
+    BytesField(tensor, TensorProtoName, name);
+    BytesField(tensor, TensorProtoRawData, raw);
+
+    if (external) {
+      VarintField(tensor, TensorProtoDataLocation, 1);
+    }
+
+    return tensor;
+  }
+
+
+  std::string Model(const std::vector<std::string>& tensors, const std::string& producer = "test") {
+    std::string graph;
+    for (const auto& tensor : tensors) {
+      BytesField(graph, GraphProtoInitializer, tensor);
+    }
+
+    std::string model;
+    BytesField(model, ModelProtoProducerName, producer);
+    BytesField(model, ModelProtoGraph, graph);
+    return model;
+  }
+
+
+  // distinct bytes, so their position in the model can be found
+  std::string Raw(size_t size, char seed) {
+    std::string raw(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+      raw[i] = static_cast<char>(seed + i * 7);
+    }
+    return raw;
+  }
+
+
+  struct alignas(64) Buffer {
+    uint8_t bytes[1024];
+  };
+
+
+
+  void TestInitializers() {
+    auto model = Model({
+      Tensor("weights", Float, { 2, 2 }, Raw(16, 1)),
+      Tensor("indices", Int64, { 2 }, Raw(16, 2), true),
+      Tensor("external", Float, { 2 }, Raw(8, 3), false, true),
+      Tensor("mismatched", Float, { 3 }, Raw(8, 4)),
+      Tensor("", Float, { 2 }, Raw(8, 5)),
+    });
+
+    // the model bytes go away, so everything is copied
+    ModelInitializers initializers(model.data(), model.size(), false);
+
+    CHECK(initializers.getCount() == 2);
+    CHECK(initializers.getBytes() == 32);
+    CHECK(initializers.getCopiedBytes() == 32);
+    CHECK(!initializers.isOrtFormat());
+
+    Ort::SessionOptions options;
+    initializers.addTo(options);
+  }
+
+
+
+  void TestInPlace() {
+    auto raw = Raw(64, 9);
+
+    // a producer name long enough to put the raw data on a 64-byte boundary
+    auto model = Model({ Tensor("weights", Float, { 16 }, raw) });
+    size_t offset = model.find(raw);
+    size_t padding = (64 - offset % 64) % 64;
+
+    model = Model({ Tensor("weights", Float, { 16 }, raw) }, "test" + std::string(padding, ' '));
+    CHECK(model.find(raw) % 64 == 0);
+    CHECK(model.size() <= sizeof(Buffer::bytes));
+
+    Buffer aligned;
+    std::memcpy(aligned.bytes, model.data(), model.size());
+
+    ModelInitializers inPlace(aligned.bytes, model.size(), true);
+    CHECK(inPlace.getCount() == 1);
+    CHECK(inPlace.getBytes() == 64);
+    CHECK(inPlace.getCopiedBytes() == 0);
+
+    // one byte off
+    Buffer shifted;
+    std::memcpy(shifted.bytes + 1, model.data(), model.size());
+
+    ModelInitializers copied(shifted.bytes + 1, model.size(), true);
+    CHECK(copied.getCount() == 1);
+    CHECK(copied.getCopiedBytes() == 64);
+  }
+
+
+
+  void TestOrtFormat() {
+    Buffer model = {};
+    std::memcpy(model.bytes + 4, "ORTM", 4);
+
+    ModelInitializers mapped(model.bytes, 256, true);
+    CHECK(mapped.isOrtFormat());
+    CHECK(mapped.getCount() == 0);
+    CHECK(mapped.getBytes() == 256);
+    CHECK(mapped.getCopiedBytes() == 0);
+
+    Ort::SessionOptions options;
+    mapped.addTo(options);
+
+    // without the bytes outliving the sessions, the runtime must keep its own copy
+    ModelInitializers transient(model.bytes, 256, false);
+    CHECK(transient.isOrtFormat());
+    CHECK(transient.getBytes() == 0);
+  }
+
+
+
+  void TestGarbage() {
+    std::string garbage = "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff";
+
+    ModelInitializers initializers(garbage.data(), garbage.size(), false);
+    CHECK(initializers.getCount() == 0);
+    CHECK(initializers.getBytes() == 0);
+
+    // truncated in the middle of the graph
+    auto model = Model({ Tensor("weights", Float, { 4 }, Raw(16, 1)) });
+    ModelInitializers truncated(model.data(), model.size() - 4, false);
+    CHECK(truncated.getCount() == 0);
+  }
+}
+
+
+
+int main() {
+  TestInitializers();
+  TestInPlace();
+  TestOrtFormat();
+  TestGarbage();
+
+  return Tests::Result();
+}
\ No newline at end of file
@@ -0,0 +1,189 @@
+//
+// StyleIndex: descriptors, nearest neighbours and near-duplicate grouping (against group
+// representatives, so chains of close entries don't merge styles that differ)
+//
+
+#include "Check.h"
+#include "StyleIndex.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+
+namespace {
+  const float DuplicateSimilarity = 0.99f;
+
+
+  std::vector<float> Unit(float angle) {
+    std::vector<float> descriptor(StyleIndex::DescriptorSize, 0.0f);
+    descriptor[0] = std::cos(angle);
+    descriptor[1] = std::sin(angle);
+    return descriptor;
+  }
+
+
+  std::vector<float> Random(std::mt19937& random) {
+    std::normal_distribution<float> normal;
+    std::vector<float> descriptor(StyleIndex::DescriptorSize);
+
+    float length = 0.0f;
+    for (auto& x : descriptor) {
+      x = normal(random);
+      length += x * x;
+    }
+
+    for (auto& x : descriptor) {
+      x /= std::sqrt(length);
+    }
+
+    return descriptor;
+  }
+
+
+
+  void TestDescribe() {
+    const int width = 64;
+    const int height = 64;
+
+    std::vector<uint8_t> image(width * height * 3);
+    std::vector<uint8_t> other(width * height * 3);
+
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        uint8_t* px = &image[3 * (y * width + x)];
+        px[0] = static_cast<uint8_t>(4 * x);
+        px[1] = static_cast<uint8_t>(4 * y);
+        px[2] = 128;
+
+        // stripes, in other colours
+        uint8_t* po = &other[3 * (y * width + x)];
+        po[0] = (x / 4) % 2 ? 255 : 0;
+        po[1] = 32;
+        po[2] = static_cast<uint8_t>(255 - 4 * y);
+      }
+    }
+
+    std::vector<float> a(StyleIndex::DescriptorSize);
+    std::vector<float> b(StyleIndex::DescriptorSize);
+    StyleIndex::describe(image.data(), width, height, a.data());
+    StyleIndex::describe(other.data(), width, height, b.data());
+
+    float length = 0.0f;
+    for (float x : a) {
+      length += x * x;
+    }
+    CHECK(std::abs(length - 1.0f) < 1e-4f);
+
+    StyleIndex index;
+    index.add("image", a.data());
+    index.add("other", b.data());
+
+    auto matches = index.nearest(a.data(), 2);
+    CHECK(matches.size() == 2);
+    CHECK(matches[0].index == 0 && std::abs(matches[0].similarity - 1.0f) < 1e-4f);
+    CHECK(matches[1].index == 1 && matches[1].similarity < DuplicateSimilarity);
+  }
+
+
+
+  void TestNearest() {
+    StyleIndex index;
+
+    for (int i = 0; i < 5; i++) {
+      index.add("s" + std::to_string(i), Unit(0.3f * i).data());
+    }
+
+    CHECK(index.size() == 5);
+    CHECK(index.find("s3") && index.find("s3")[0] == Unit(0.3f * 3)[0]);
+    CHECK(!index.find("missing"));
+
+    // by similarity, skipping the excluded key
+    auto matches = index.nearest(Unit(0.65f).data(), 3, "s2");
+    CHECK(matches.size() == 3);
+    CHECK(matches[0].index == 1 || matches[0].index == 3);
+    CHECK(matches[0].similarity >= matches[1].similarity && matches[1].similarity >= matches[2].similarity);
+
+    for (const auto& match : matches) {
+      CHECK(index.getKey(match.index) != "s2");
+    }
+
+    // k past the end, or negative
+    CHECK(index.nearest(Unit(0.0f).data(), 10).size() == 5);
+    CHECK(index.nearest(Unit(0.0f).data(), -1).empty());
+
+    size_t similar = 0;
+    CHECK(index.findSimilar(Unit(0.61f).data(), DuplicateSimilarity, similar) && similar == 2);
+    CHECK(!index.findSimilar(Unit(0.15f).data(), DuplicateSimilarity, similar));
+  }
+
+
+
+  void TestChainedDuplicates() {
+    ThreadPool pool(2);
+
+    // a ~ b and b ~ c, but a and c are apart: c doesn't join a's group through b
+    float step = std::acos(0.995f);
+
+    StyleIndex index;
+    index.add("a", Unit(0.0f).data());
+    index.add("b", Unit(step).data());
+    index.add("c", Unit(2 * step).data());
+    index.add("d", Unit(2 * step + 0.01f).data());
+
+    auto duplicateOf = index.findDuplicates(DuplicateSimilarity, pool);
+    CHECK(duplicateOf.size() == 4);
+    CHECK(duplicateOf[0] == 0);
+    CHECK(duplicateOf[1] == 0);
+    CHECK(duplicateOf[2] == 2);
+    CHECK(duplicateOf[3] == 2);
+  }
+
+
+
+  void TestDuplicatesAcrossBlocks() {
+    ThreadPool pool(4);
+    std::mt19937 random(7);
+
+    // more entries than one block, copies both within a block and in later ones
+    const size_t unique = 300;
+
+    std::vector<std::vector<float>> descriptors;
+    for (size_t i = 0; i < unique; i++) {
+      descriptors.push_back(Random(random));
+    }
+
+    descriptors[20] = descriptors[10];
+
+    for (size_t i = 0; i < unique; i++) {
+      descriptors.push_back(descriptors[i]);
+    }
+
+    StyleIndex index;
+    for (size_t i = 0; i < descriptors.size(); i++) {
+      index.add(std::to_string(i), descriptors[i].data());
+    }
+
+    auto duplicateOf = index.findDuplicates(DuplicateSimilarity, pool);
+    CHECK(duplicateOf.size() == descriptors.size());
+
+    for (size_t i = 0; i < unique; i++) {
+      CHECK(duplicateOf[i] == (i == 20 ? 10 : i));
+      CHECK(duplicateOf[unique + i] == (i == 20 ? 10 : i));
+    }
+  }
+}
+
+
+
+int main() {
+  TestDescribe();
+  TestNearest();
+  TestChainedDuplicates();
+  TestDuplicatesAcrossBlocks();
+
+  return Tests::Result();
+}
\ No newline at end of file
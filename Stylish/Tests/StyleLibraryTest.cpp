@@ -0,0 +1,212 @@
+//
+// StyleLibrary: writing a library and reading it back, and refusing mismatched or corrupt files
+//
+
+#include "Check.h"
+#include "StyleLibrary.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+  const int Width = 4;
+  const int Height = 3;
+  const int Channels = 3;
+  const int DescriptorSize = 8;
+
+  const size_t TensorSize = Width * Height * Channels;
+
+
+  struct Source {
+    std::vector<uint8_t> pixels;
+    std::vector<float> descriptor;
+    std::string thumbnail;
+  };
+
+
+  Source MakeSource(int seed) {
+    Source source;
+
+    for (size_t i = 0; i < TensorSize; i++) {
+      source.pixels.push_back(static_cast<uint8_t>(seed * 31 + i));
+    }
+
+    for (int i = 0; i < DescriptorSize; i++) {
+      source.descriptor.push_back(seed + i * 0.25f);
+    }
+
+    source.thumbnail = "jpeg " + std::to_string(seed);
+    return source;
+  }
+
+
+  StyleLibrary::Entry MakeEntry(const std::string& name, int64_t mtime, const Source* source, const std::string& duplicateOf = "") {
+    StyleLibrary::Entry entry;
+    entry.name = name;
+    entry.mtime = mtime;
+    entry.duplicateOf = duplicateOf;
+
+    if (source) {
+      entry.pixels = source->pixels.data();
+      entry.descriptor = source->descriptor.data();
+      entry.thumbnail = reinterpret_cast<const uint8_t*>(source->thumbnail.data());
+      entry.thumbnailSize = source->thumbnail.size();
+    }
+
+    return entry;
+  }
+
+
+  bool SameEntry(const StyleLibrary::Entry& a, const StyleLibrary::Entry& b) {
+    if (a.name != b.name || a.mtime != b.mtime || a.duplicateOf != b.duplicateOf || !a.pixels != !b.pixels) {
+      return false;
+    }
+
+    if (!a.pixels) {
+      return true;
+    }
+
+    return std::memcmp(a.pixels, b.pixels, TensorSize) == 0 &&
+      std::memcmp(a.descriptor, b.descriptor, DescriptorSize * sizeof(float)) == 0 &&
+      a.thumbnailSize == b.thumbnailSize && std::memcmp(a.thumbnail, b.thumbnail, a.thumbnailSize) == 0;
+  }
+
+
+  bool SameEntries(const std::vector<StyleLibrary::Entry>& a, const std::vector<StyleLibrary::Entry>& b) {
+    if (a.size() != b.size()) {
+      return false;
+    }
+
+    for (size_t i = 0; i < a.size(); i++) {
+      if (!SameEntry(a[i], b[i])) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+
+
+  void TestRoundTrip(const fs::path& folder) {
+    auto first = MakeSource(1);
+    auto second = MakeSource(2);
+
+    std::vector<StyleLibrary::Entry> entries = {
+      MakeEntry("a.jpg", 123, &first),
+      MakeEntry("notes.txt", 7, nullptr),
+      MakeEntry("b.png", -5, &second, "a.jpg"),
+      MakeEntry("c.jpg", 9, &second, "gone.jpg"),
+    };
+
+    auto path = folder / "styles.1.pack";
+    CHECK(StyleLibrary::write(path, Width, Height, Channels, DescriptorSize, entries));
+
+    // a duplicate of an entry that isn't in the library reads back as unique
+    entries[3].duplicateOf.clear();
+
+    StyleLibrary library;
+    CHECK(library.open(path, Width, Height, Channels, DescriptorSize));
+    CHECK(library.isOpen());
+    CHECK(SameEntries(library.getEntries(), entries));
+
+    for (const auto& entry : library.getEntries()) {
+      if (entry.pixels) {
+        CHECK(reinterpret_cast<uintptr_t>(entry.pixels) % 64 == 0);
+        CHECK(reinterpret_cast<uintptr_t>(entry.descriptor) % alignof(float) == 0);
+      }
+    }
+
+    CHECK(library.find("b.png") && library.find("b.png")->duplicateOf == "a.jpg");
+    CHECK(library.find("notes.txt") && !library.find("notes.txt")->pixels);
+    CHECK(!library.find("d.jpg"));
+
+    // rewriting straight from the mapped entries, as a reload does
+    auto next = folder / "styles.2.pack";
+    CHECK(StyleLibrary::write(next, Width, Height, Channels, DescriptorSize, library.getEntries()));
+
+    StyleLibrary rewritten;
+    CHECK(rewritten.open(next, Width, Height, Channels, DescriptorSize));
+    CHECK(SameEntries(rewritten.getEntries(), entries));
+
+    library.close();
+    CHECK(!library.isOpen());
+    CHECK(library.getEntries().empty());
+  }
+
+
+
+  void TestEmpty(const fs::path& folder) {
+    auto path = folder / "empty.pack";
+    CHECK(StyleLibrary::write(path, Width, Height, Channels, DescriptorSize, {}));
+
+    StyleLibrary library;
+    CHECK(library.open(path, Width, Height, Channels, DescriptorSize));
+    CHECK(library.getEntries().empty());
+  }
+
+
+
+  void TestMismatch(const fs::path& folder) {
+    auto source = MakeSource(3);
+
+    auto path = folder / "mismatch.pack";
+    CHECK(StyleLibrary::write(path, Width, Height, Channels, DescriptorSize, { MakeEntry("a.jpg", 1, &source) }));
+
+    StyleLibrary library;
+    CHECK(!library.open(path, Width + 1, Height, Channels, DescriptorSize));
+    CHECK(!library.open(path, Width, Height, 4, DescriptorSize));
+    CHECK(!library.open(path, Width, Height, Channels, DescriptorSize * 2));
+    CHECK(!library.open(folder / "missing.pack", Width, Height, Channels, DescriptorSize));
+    CHECK(!library.isOpen());
+  }
+
+
+
+  void TestCorrupt(const fs::path& folder) {
+    auto source = MakeSource(4);
+
+    auto path = folder / "corrupt.pack";
+    CHECK(StyleLibrary::write(path, Width, Height, Channels, DescriptorSize, { MakeEntry("a.jpg", 1, &source), MakeEntry("b.jpg", 2, &source) }));
+
+    StyleLibrary library;
+
+    // the last name runs past the end
+    fs::resize_file(path, fs::file_size(path) - 1);
+    CHECK(!library.open(path, Width, Height, Channels, DescriptorSize));
+
+    // not even the records
+    fs::resize_file(path, 40);
+    CHECK(!library.open(path, Width, Height, Channels, DescriptorSize));
+
+    // not a library
+    fs::resize_file(path, 0);
+    CHECK(!library.open(path, Width, Height, Channels, DescriptorSize));
+  }
+}
+
+
+
+int main() {
+  auto folder = fs::temp_directory_path() / "stylish-test-library";
+
+  std::error_code ec;
+  fs::remove_all(folder, ec);
+  fs::create_directories(folder);
+
+  TestRoundTrip(folder);
+  TestEmpty(folder);
+  TestMismatch(folder);
+  TestCorrupt(folder);
+
+  fs::remove_all(folder, ec);
+
+  return Tests::Result();
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+//
+// ThumbnailAtlas: packing, overflow to new pages, padding between slots, UVs, uploads and slot reuse
+//
+
+#include "Check.h"
+#include "ThumbnailAtlas.h"
+
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+
+namespace {
+  cv::Mat Image(int width, int height, int type = CV_8UC3) {
+    cv::Mat image(height, width, type);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    return image;
+  }
+
+
+  // at least a pixel of padding between the two, when on the same page
+  bool Apart(const ThumbnailAtlas::Slot& a, const ThumbnailAtlas::Slot& b) {
+    return a.page != b.page ||
+      a.x + a.width + 1 <= b.x || b.x + b.width + 1 <= a.x ||
+      a.y + a.height + 1 <= b.y || b.y + b.height + 1 <= a.y;
+  }
+
+
+
+  void TestPacking() {
+    ThumbnailAtlas atlas(128);
+
+    std::vector<ThumbnailAtlas::Slot> slots;
+    for (int i = 0; i < 6; i++) {
+      slots.push_back(atlas.add(Image(30, 20)));
+    }
+
+    CHECK(atlas.getPageCount() == 1);
+
+    for (size_t i = 0; i < slots.size(); i++) {
+      const auto& slot = slots[i];
+
+      CHECK(slot.page == 0);
+      CHECK(slot.width == 30 && slot.height == 20);
+      CHECK(slot.x >= 0 && slot.y >= 0 && slot.x + slot.width <= 128 && slot.y + slot.height <= 128);
+
+      for (size_t j = i + 1; j < slots.size(); j++) {
+        CHECK(Apart(slot, slots[j]));
+      }
+    }
+  }
+
+
+
+  void TestUVs() {
+    ThumbnailAtlas atlas(256);
+
+    atlas.add(Image(40, 40));
+    auto slot = atlas.add(Image(50, 30));
+
+    CHECK(slot.page == 0);
+    CHECK(slot.u0 == slot.x / 256.0f);
+    CHECK(slot.v0 == slot.y / 256.0f);
+    CHECK(slot.u1 == (slot.x + 50) / 256.0f);
+    CHECK(slot.v1 == (slot.y + 30) / 256.0f);
+    CHECK(slot.u0 < slot.u1 && slot.v0 < slot.v1);
+  }
+
+
+
+  void TestPageOverflow() {
+    // 30x30 plus padding: four fit a 64x64 page
+    ThumbnailAtlas atlas(64);
+
+    std::vector<ThumbnailAtlas::Slot> slots;
+    for (int i = 0; i < 5; i++) {
+      slots.push_back(atlas.add(Image(30, 30)));
+    }
+
+    CHECK(atlas.getPageCount() == 2);
+
+    for (int i = 0; i < 4; i++) {
+      CHECK(slots[i].page == 0);
+    }
+
+    CHECK(slots[4].page == 1);
+    CHECK(slots[4].x == 0 && slots[4].y == 0);
+
+    // a smaller one still finds room on the first page
+    auto small = atlas.add(Image(1, 1));
+    CHECK(small.page == 0);
+
+    for (const auto& slot : slots) {
+      CHECK(Apart(small, slot));
+    }
+  }
+
+
+
+  void TestOversized() {
+    ThumbnailAtlas atlas(64);
+
+    auto slot = atlas.add(Image(200, 100));
+
+    CHECK(slot.page == 0);
+    CHECK(slot.width < 64 && slot.height < 64);
+    CHECK(slot.width > slot.height);
+  }
+
+
+
+  void TestUploads() {
+    ThumbnailAtlas atlas(128);
+
+    auto gray = atlas.add(Image(10, 12, CV_8UC1));
+    auto bgr = atlas.add(Image(10, 12, CV_8UC3));
+    auto bgra = atlas.add(Image(10, 12, CV_8UC4));
+    auto unsupported = atlas.add(Image(10, 12, CV_8UC2));
+
+    CHECK(unsupported.page == -1);
+
+    auto uploads = atlas.takeUploads();
+    CHECK(uploads.size() == 3);
+
+    const ThumbnailAtlas::Slot* slots[] = { &gray, &bgr, &bgra };
+
+    for (size_t i = 0; i < uploads.size() && i < 3; i++) {
+      CHECK(uploads[i].page == slots[i]->page);
+      CHECK(uploads[i].x == slots[i]->x && uploads[i].y == slots[i]->y);
+      CHECK(uploads[i].pixels.type() == CV_8UC4);
+      CHECK(uploads[i].pixels.cols == 10 && uploads[i].pixels.rows == 12);
+    }
+
+    CHECK(atlas.takeUploads().empty());
+  }
+
+
+
+  void TestReuse() {
+    ThumbnailAtlas atlas(128);
+
+    auto first = atlas.add(Image(20, 20));
+    atlas.add(Image(20, 20));
+
+    // its pending upload goes with it
+    atlas.remove(first);
+    CHECK(atlas.takeUploads().size() == 1);
+
+    auto reused = atlas.add(Image(20, 20));
+    CHECK(reused.page == first.page && reused.x == first.x && reused.y == first.y);
+
+    // only by thumbnails of the same size
+    atlas.remove(reused);
+    auto other = atlas.add(Image(21, 20));
+    CHECK(other.x != first.x || other.y != first.y);
+
+    atlas.clear();
+    CHECK(atlas.getPageCount() == 0);
+    CHECK(atlas.takeUploads().empty());
+  }
+}
+
+
+
+int main() {
+  TestPacking();
+  TestUVs();
+  TestPageOverflow();
+  TestOversized();
+  TestUploads();
+  TestReuse();
+
+  return Tests::Result();
+}
\ No newline at end of file
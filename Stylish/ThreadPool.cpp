@@ -0,0 +1,100 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+
+ThreadPool::ThreadPool(int threads) {
+  if (threads <= 0) {
+    threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+
+  for (int i = 0; i < threads; i++) {
+    m_Workers.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stop = true;
+  }
+
+  m_WorkAvailable.notify_all();
+
+  for (auto& worker : m_Workers) {
+    worker.join();
+  }
+}
+
+
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+  if (count == 0) {
+    return;
+  }
+
+  // everyone pulls the next index as soon as they are done, so uneven items balance out
+  std::atomic<size_t> next = 0;
+
+  auto worker = [&]() {
+    for (size_t i = next++; i < count; i = next++) {
+      fn(i);
+    }
+  };
+
+  std::vector<std::future<void>> helpers;
+  auto helperCount = std::min(count - 1, m_Workers.size());
+
+  for (size_t i = 0; i < helperCount; i++) {
+    helpers.push_back(submit(worker));
+  }
+
+  std::exception_ptr error;
+
+  try {
+    worker();
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  // wait for every helper before leaving, they reference our locals
+  for (auto& helper : helpers) {
+    try {
+      helper.get();
+    } catch (...) {
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+
+
+void ThreadPool::work() {
+  while (true) {
+    std::function<void()> task;
+
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_WorkAvailable.wait(lock, [this] { return m_Stop || !m_Queue.empty(); });
+
+      if (m_Stop && m_Queue.empty()) {
+        return;
+      }
+
+      task = std::move(m_Queue.front());
+      m_Queue.pop();
+    }
+
+    task();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+//
+// Fixed set of worker threads for background and data-parallel CPU work (decoding, resizing, ...).
+// Inference runs on it are bounded by the session pools, see Inference::stylizeConcurrent.
+//
+class ThreadPool {
+public:
+
+  // 0 - one thread per hardware thread
+  explicit ThreadPool(int threads = 0);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  virtual ~ThreadPool();
+
+  template <typename F>
+  auto submit(F&& task) -> std::future<decltype(task())> {
+    using Result = decltype(task());
+
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    auto future = packaged->get_future();
+
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      m_Queue.emplace([packaged]() { (*packaged)(); });
+    }
+
+    m_WorkAvailable.notify_one();
+
+    return future;
+  }
+
+  // Runs fn(i) for every i in [0, count) and waits for all of them. The calling thread takes part.
+  // The first exception thrown by fn is rethrown once everything has finished.
+  // Must not be called from one of the pool's own threads.
+  void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+  int size() const { return static_cast<int>(m_Workers.size()); }
+
+private:
+
+  std::vector<std::thread> m_Workers;
+
+  std::mutex m_Mutex;
+  std::condition_variable m_WorkAvailable;
+  std::queue<std::function<void()>> m_Queue;
+  bool m_Stop = false;
+
+
+  void work();
+};
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "ThumbnailAtlas.h"
+
+#include <algorithm>
+
+// Our own copy: imgui_draw.cpp compiles its implementation as static
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imgui/imstb_rectpack.h"
+
+
+namespace {
+  // between thumbnails, so sampling one never bleeds into its neighbours
+  const int Padding = 1;
+}
+
+
+
+struct ThumbnailAtlas::Page {
+  stbrp_context context;
+  std::vector<stbrp_node> nodes;
+};
+
+
+
+ThumbnailAtlas::ThumbnailAtlas(int pageSize) : m_PageSize{ std::max(64, pageSize) } {
+}
+
+
+
+ThumbnailAtlas::~ThumbnailAtlas() = default;
+
+
+
+ThumbnailAtlas::Slot ThumbnailAtlas::place(int width, int height) {
+  // a freed slot of the same size first
+  auto free = std::find_if(m_Free.begin(), m_Free.end(), [&](const Slot& slot) {
+    return slot.width == width && slot.height == height;
+  });
+
+  if (free != m_Free.end()) {
+    Slot slot = *free;
+    m_Free.erase(free);
+    return slot;
+  }
+
+  stbrp_rect rect = {};
+  rect.w = width + Padding;
+  rect.h = height + Padding;
+
+  // older pages may still have room (for smaller thumbnails)
+  for (size_t i = 0; i <= m_Pages.size(); i++) {
+    if (i == m_Pages.size()) {
+      auto page = std::make_unique<Page>();
+      page->nodes.resize(m_PageSize);
+      stbrp_init_target(&page->context, m_PageSize, m_PageSize, page->nodes.data(), static_cast<int>(page->nodes.size()));
+      m_Pages.push_back(std::move(page));
+    }
+
+    if (stbrp_pack_rects(&m_Pages[i]->context, &rect, 1) && rect.was_packed) {
+      Slot slot;
+      slot.page = static_cast<int>(i);
+      slot.x = rect.x;
+      slot.y = rect.y;
+      slot.width = width;
+      slot.height = height;
+
+      float size = static_cast<float>(m_PageSize);
+      slot.u0 = slot.x / size;
+      slot.v0 = slot.y / size;
+      slot.u1 = (slot.x + width) / size;
+      slot.v1 = (slot.y + height) / size;
+
+      return slot;
+    }
+  }
+
+  return {};
+}
+
+
+
+ThumbnailAtlas::Slot ThumbnailAtlas::add(const cv::Mat& image) {
+  if (image.empty()) {
+    return {};
+  }
+
+  cv::Mat bgra;
+
+  switch (image.channels()) {
+    case 1: cv::cvtColor(image, bgra, cv::COLOR_GRAY2BGRA); break;
+    case 3: cv::cvtColor(image, bgra, cv::COLOR_BGR2BGRA); break;
+    case 4: bgra = image.clone(); break;
+    default: return {};
+  }
+
+  int maxSize = m_PageSize - Padding;
+  if (bgra.cols > maxSize || bgra.rows > maxSize) {
+    float scale = static_cast<float>(maxSize) / std::max(bgra.cols, bgra.rows);
+    cv::resize(bgra, bgra, cv::Size(), scale, scale, cv::INTER_AREA);
+  }
+
+  Slot slot = place(bgra.cols, bgra.rows);
+
+  if (slot.page >= 0) {
+    m_Uploads.push_back({ slot.page, slot.x, slot.y, bgra });
+  }
+
+  return slot;
+}
+
+
+
+void ThumbnailAtlas::remove(const Slot& slot) {
+  if (slot.page < 0) {
+    return;
+  }
+
+  // a pending upload for it would now overwrite whatever reuses the slot
+  m_Uploads.erase(std::remove_if(m_Uploads.begin(), m_Uploads.end(), [&](const Upload& upload) {
+    return upload.page == slot.page && upload.x == slot.x && upload.y == slot.y;
+  }), m_Uploads.end());
+
+  m_Free.push_back(slot);
+}
+
+
+
+void ThumbnailAtlas::clear() {
+  m_Pages.clear();
+  m_Free.clear();
+  m_Uploads.clear();
+}
+
+
+
+std::vector<ThumbnailAtlas::Upload> ThumbnailAtlas::takeUploads() {
+  std::vector<Upload> uploads;
+  uploads.swap(m_Uploads);
+  return uploads;
+}
\ No newline at end of file
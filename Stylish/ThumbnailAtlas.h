@@ -0,0 +1,70 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+
+//
+// CPU side of the thumbnail atlas: packs thumbnails into a few large pages (stb_rect_pack) and
+// queues their pixels (BGRA) as sub-rect uploads. Creating the page textures and uploading is
+// up to the renderer, so nothing here depends on D3D.
+//
+// Packing is append-only; removed slots are reused by thumbnails of the same size, which is
+// all of them in practice.
+//
+class ThumbnailAtlas {
+public:
+
+  struct Slot {
+    int page = -1;
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+
+    float u0 = 0.0f, v0 = 0.0f, u1 = 0.0f, v1 = 0.0f;
+  };
+
+  struct Upload {
+    int page;
+    int x;
+    int y;
+    cv::Mat pixels; // BGRA
+  };
+
+  explicit ThumbnailAtlas(int pageSize = 2048);
+
+  ThumbnailAtlas(const ThumbnailAtlas&) = delete;
+  ThumbnailAtlas(ThumbnailAtlas&&) = delete;
+
+  ThumbnailAtlas& operator=(const ThumbnailAtlas&) = delete;
+  ThumbnailAtlas& operator=(ThumbnailAtlas&&) = delete;
+
+  virtual ~ThumbnailAtlas();
+
+  // Gray, BGR or BGRA. Thumbnails larger than a page are shrunk to fit.
+  Slot add(const cv::Mat& image);
+  void remove(const Slot& slot);
+
+  void clear();
+
+  int getPageSize() const { return m_PageSize; }
+  int getPageCount() const { return static_cast<int>(m_Pages.size()); }
+
+  // Uploads queued since the last call, oldest first
+  std::vector<Upload> takeUploads();
+
+private:
+
+  struct Page;
+
+  int m_PageSize;
+
+  std::vector<std::unique_ptr<Page>> m_Pages;
+  std::vector<Slot> m_Free;
+  std::vector<Upload> m_Uploads;
+
+  Slot place(int width, int height);
+};
\ No newline at end of file
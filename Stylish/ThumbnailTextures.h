@@ -0,0 +1,23 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+
+//
+// Renderer side of the thumbnail atlas: the GPU textures behind its pages. StyleImageCache only
+// deals in the ids returned here (an ImTextureID for the UI), so it builds without a renderer;
+// with none, thumbnails are packed but never uploaded.
+//
+class ThumbnailTextures {
+public:
+
+  virtual ~ThumbnailTextures() = default;
+
+  // A cleared size x size BGRA page, null on failure
+  virtual void* createPage(int size) = 0;
+
+  // Copies BGRA pixels into the page, top-left at (x, y)
+  virtual void update(void* page, int x, int y, const cv::Mat& pixels) = 0;
+
+  virtual void releasePage(void* page) = 0;
+};
\ No newline at end of file
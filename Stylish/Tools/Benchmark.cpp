@@ -0,0 +1,578 @@
+//
+// stylish-bench: micro benchmarks of the per-frame pixel work around the model and macro benchmarks
+// of end-to-end stylization at common window sizes.
+//
+// Results go to stdout and, with --json, to a file with one benchmark per line, so two runs diff
+// cleanly. With --baseline, p50s are compared against a stored run and regressions beyond the
+// threshold make the exit code 2.
+//
+// The micro benchmarks call the app's own pixel steps (Pipeline.h, ThumbnailAtlas), only the
+// Win32/D3D parts can't run here:
+//
+//   unpack, pack        BGRA <-> BGR of a whole frame, Inference::run's cost when input and output formats differ
+//   downscale, upscale  Inference::stylize's pre and post processing of a BGRA capture, per quality factor
+//   style_snapshot      a frame made into the content image mixed into the style (once per style weight change)
+//   style_mix           that content mixed into the style image (once per style or weight change)
+//   style_decode        decoding a style image, at the reduced scale StyleImageCache picks for large JPEGs
+//   style_fit           crop and resize of a decoded style image into the library's 8-bit tensor (once per file)
+//   style_blob          the 8-bit tensor into the model's style input (StyleImageCache materializing a style)
+//   thumbnail_add       a thumbnail into the atlas, its BGRA expansion for the texture
+//
+// The macro benchmarks call Inference::run on BGRA frame views, stylized in place, as the capture
+// window does. With --sessions n, they also time batches of n frames stylized concurrently on a pool
+// of n sessions (Inference::stylizeConcurrent).
+//
+// Run from the directory holding models/ for the macro benchmarks.
+//
+
+#include "Common.h"
+
+#include "Inference.h"
+#include "Pipeline.h"
+#include "ThumbnailAtlas.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  struct Options {
+    bool micro = true;
+    bool macro = true;
+    std::string filter;             // only benchmarks whose name contains it
+    int quality = -1;               // -1 - every quality factor
+    int provider = -1;              // Inference::Provider, -1 - keep the default
+    int tier = -1;
+    int frames = 10;                // per macro configuration
+    int sessions = 1;               // session pool size, above 1 batches are timed as well
+    int threads = -1;               // OpenCV threads, -1 - OpenCV's default
+    double minSeconds = 0.5;        // per micro benchmark
+    std::string json;
+    std::string baseline;
+    double threshold = 10.0;        // % slower than the baseline that counts as a regression
+  };
+
+  struct WindowSize {
+    const char* name;
+    int width;
+    int height;
+  };
+
+  const WindowSize WindowSizes[] = {
+    { "640x480", 640, 480 },
+    { "1280x720", 1280, 720 },
+    { "1920x1080", 1920, 1080 },
+    { "2560x1440", 2560, 1440 },
+  };
+
+  struct Result {
+    std::string name;
+    size_t iterations = 0;
+    double mean = 0.0;  // ms
+    double min = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+  };
+
+  // as in Inference and StyleImageCache
+  const std::pair<int, int> QualityRange = { 0, 3 };
+  const cv::Size StyleSize = { 256, 256 };
+
+  const int WarmUpRuns = 2;
+  const size_t MaxIterations = 1000;
+  const size_t MinIterations = 5;
+
+
+  void PrintUsage() {
+    std::cout <<
+      "Usage: stylish-bench [options]\n"
+      "  --micro-only, --macro-only\n"
+      "  --filter <text>     only benchmarks whose name contains text\n"
+      "  --quality <n>       only this quality factor (default: all)\n"
+      "  --provider cpu|gpu  for the macro benchmarks\n"
+      "  --tier <n>          model tier for the macro benchmarks\n"
+      "  --frames <n>        stylized frames per macro configuration (default: 10)\n"
+      "  --sessions <n>      session pool size, above 1 also times batches of n frames stylized concurrently\n"
+      "  --threads <n>       OpenCV threads\n"
+      "  --min-time <s>      minimum time per micro benchmark (default: 0.5)\n"
+      "  --json <path>       write the results as JSON\n"
+      "  --baseline <path>   compare with a previous --json run\n"
+      "  --threshold <pct>   p50 slowdown that counts as a regression (default: 10)\n";
+  }
+
+
+
+  bool ParseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      bool hasValue = i + 1 < argc;
+
+      if (arg == "--micro-only") {
+        options.macro = false;
+      }
+      else if (arg == "--macro-only") {
+        options.micro = false;
+      }
+      else if (arg == "--filter" && hasValue) {
+        options.filter = argv[++i];
+      }
+      else if (arg == "--quality" && hasValue) {
+        options.quality = std::clamp(std::atoi(argv[++i]), QualityRange.first, QualityRange.second);
+      }
+      else if (arg == "--provider" && hasValue) {
+        std::string provider = argv[++i];
+        if (provider != "cpu" && provider != "gpu") {
+          return false;
+        }
+        options.provider = provider == "gpu" ? Inference::GPU : Inference::CPU;
+      }
+      else if (arg == "--tier" && hasValue) {
+        options.tier = std::atoi(argv[++i]);
+      }
+      else if (arg == "--frames" && hasValue) {
+        options.frames = std::max(1, std::atoi(argv[++i]));
+      }
+      else if (arg == "--sessions" && hasValue) {
+        options.sessions = std::max(1, std::atoi(argv[++i]));
+      }
+      else if (arg == "--threads" && hasValue) {
+        options.threads = std::atoi(argv[++i]);
+      }
+      else if (arg == "--min-time" && hasValue) {
+        options.minSeconds = std::max(0.0, std::atof(argv[++i]));
+      }
+      else if (arg == "--json" && hasValue) {
+        options.json = argv[++i];
+      }
+      else if (arg == "--baseline" && hasValue) {
+        options.baseline = argv[++i];
+      }
+      else if (arg == "--threshold" && hasValue) {
+        options.threshold = std::atof(argv[++i]);
+      }
+      else {
+        return false;
+      }
+    }
+
+    return options.micro || options.macro;
+  }
+
+
+
+  double Ms(Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+  }
+
+
+
+  Result Summarize(const std::string& name, std::vector<double> samples) {
+    Result result;
+    result.name = name;
+    result.iterations = samples.size();
+
+    if (samples.empty()) {
+      return result;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    auto at = [&](double q) { return samples[std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()))]; };
+
+    double sum = 0.0;
+    for (auto sample : samples) {
+      sum += sample;
+    }
+
+    result.mean = sum / samples.size();
+    result.min = samples.front();
+    result.p50 = at(0.5);
+    result.p90 = at(0.9);
+    result.p99 = at(0.99);
+    result.max = samples.back();
+
+    return result;
+  }
+
+
+
+  class Suite {
+  public:
+    Suite(const Options& options) : m_Options{ options } {}
+
+    bool selected(const std::string& name) const {
+      return m_Options.filter.empty() || name.find(m_Options.filter) != std::string::npos;
+    }
+
+    // Repeats fn for the minimum time (within the iteration bounds), after a warm-up call
+    void measure(const std::string& name, const std::function<void()>& fn) {
+      if (!selected(name)) {
+        return;
+      }
+
+      fn();
+
+      std::vector<double> samples;
+      auto end = Clock::now() + std::chrono::duration<double>(m_Options.minSeconds);
+
+      while (samples.size() < MaxIterations && (samples.size() < MinIterations || Clock::now() < end)) {
+        auto begin = Clock::now();
+        fn();
+        samples.push_back(Ms(Clock::now() - begin));
+      }
+
+      add(Summarize(name, std::move(samples)));
+    }
+
+    void add(const Result& result) {
+      std::cout << std::left << std::setw(36) << result.name << std::right << std::fixed << std::setprecision(3)
+        << std::setw(7) << result.iterations
+        << std::setw(11) << result.mean
+        << std::setw(11) << result.p50
+        << std::setw(11) << result.p90
+        << std::setw(11) << result.p99 << std::endl;
+
+      m_Results.push_back(result);
+    }
+
+    const std::vector<Result>& results() const { return m_Results; }
+
+  private:
+    const Options& m_Options;
+    std::vector<Result> m_Results;
+  };
+
+
+
+  cv::Mat RandomImage(int width, int height, int type) {
+    cv::Mat image(height, width, type);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    return image;
+  }
+
+
+
+  void RunMicro(Suite& suite, const Options& options) {
+    for (const auto& size : WindowSizes) {
+      std::string suffix = std::string("/") + size.name;
+
+      // a capture, as the window hands it to Inference::run
+      auto frame = RandomImage(size.width, size.height, CV_8UC4);
+
+      cv::Mat bgr;
+      cv::Mat bgra;
+      suite.measure("unpack" + suffix, [&] { cv::cvtColor(frame, bgr, cv::COLOR_BGRA2BGR); });
+      suite.measure("pack" + suffix, [&] { cv::cvtColor(bgr, bgra, cv::COLOR_BGR2BGRA); });
+
+      for (int q = QualityRange.first; q <= QualityRange.second; q++) {
+        if (options.quality >= 0 && q != options.quality) {
+          continue;
+        }
+
+        std::string quality = "/q" + std::to_string(q);
+        auto scaled = ModelInputSize(frame.size(), q, QualityRange.second);
+
+        cv::Mat nnInput;
+        suite.measure("downscale" + quality + suffix, [&] { PrepareModelInput(frame, scaled, nnInput); });
+
+        // the model output, floats in [0, 1] at the scaled size
+        cv::Mat outputNN(scaled, CV_32FC3);
+        cv::randu(outputNN, cv::Scalar::all(0.0f), cv::Scalar::all(1.0f));
+
+        cv::Mat output;
+        suite.measure("upscale" + quality + suffix, [&] { FinishModelOutput(outputNN, frame.channels(), frame.size(), output); });
+      }
+
+      cv::Mat content;
+      suite.measure("style_snapshot" + suffix, [&] { MakeStyleContent(frame, StyleSize, content); });
+    }
+
+    cv::Mat style(StyleSize, CV_32FC3);
+    cv::Mat content(StyleSize, CV_32FC3);
+    cv::randu(style, cv::Scalar::all(0.0f), cv::Scalar::all(1.0f));
+    cv::randu(content, cv::Scalar::all(0.0f), cv::Scalar::all(1.0f));
+
+    cv::Mat mixed;
+    suite.measure("style_mix/256x256", [&] { MixStyle(style, content, 0.5f, mixed); });
+
+    // a typical photo as style image
+    auto source = RandomImage(1920, 1080, CV_8UC3);
+    cv::GaussianBlur(source, source, cv::Size(0, 0), 3.0); // noise is no photo, to the JPEG codec at least
+
+    std::vector<uchar> jpeg;
+    cv::imencode(".jpg", source, jpeg, { cv::IMWRITE_JPEG_QUALITY, 90 });
+
+    cv::Mat decoded;
+    suite.measure("style_decode/full/1920x1080", [&] { decoded = cv::imdecode(jpeg, cv::IMREAD_COLOR); });
+    suite.measure("style_decode/reduced/1920x1080", [&] { decoded = cv::imdecode(jpeg, cv::IMREAD_REDUCED_COLOR_4); });
+
+    cv::Mat styleImage;
+    suite.measure("style_fit/1920x1080", [&] { FitStyleImage(source, StyleSize, styleImage); });
+
+    // from the 8-bit tensor, as stored in the library
+    std::vector<float> blob;
+    suite.measure("style_blob/256x256", [&] { MakeStyleBlob(styleImage, blob); });
+
+    // the slot is reused every time, its pending upload goes with it
+    ThumbnailAtlas atlas(1024);
+    suite.measure("thumbnail_add/256x256", [&] { atlas.remove(atlas.add(styleImage)); });
+  }
+
+
+
+  // Inference::run as the capture window calls it: a BGRA frame stylized in place
+  void RunMacro(Suite& suite, const Options& options) {
+    Inference inf(nullptr);
+
+    if (options.provider == Inference::GPU && !inf.isGPUReady()) {
+      std::cout << "GPU provider unavailable, benchmarking the CPU" << std::endl;
+    }
+    else if (options.provider >= 0) {
+      inf.setProvider(static_cast<Inference::Provider>(options.provider));
+    }
+
+    if (options.tier >= 0 && !inf.setModelTier(options.tier, true)) {
+      std::cout << "Model tier " << options.tier << " unavailable" << std::endl;
+      return;
+    }
+
+    if (options.sessions > 1 && !inf.setSessionPoolSize(options.sessions)) {
+      std::cout << "Failed to create " << options.sessions << " sessions" << std::endl;
+      return;
+    }
+
+    std::string prefix = std::string("e2e/") + (inf.getProvider() == Inference::GPU ? "gpu" : "cpu") + "/" +
+      inf.getModelTierName(inf.getModelTier());
+
+    std::vector<float> styleBlob(static_cast<size_t>(StyleSize.area()) * 3);
+    cv::Mat style(StyleSize, CV_32FC3, styleBlob.data());
+    cv::randu(style, cv::Scalar::all(0.0f), cv::Scalar::all(1.0f));
+
+    const std::pair<int, int> styleSize = { StyleSize.width, StyleSize.height };
+
+    for (int q = QualityRange.first; q <= QualityRange.second; q++) {
+      if (options.quality >= 0 && q != options.quality) {
+        continue;
+      }
+
+      inf.setQualityPerfFactor(q);
+
+      for (const auto& size : WindowSizes) {
+        std::string name = prefix + "/q" + std::to_string(q) + "/" + size.name;
+
+        if (!suite.selected(name)) {
+          continue;
+        }
+
+        auto source = RandomImage(size.width, size.height, CV_8UC4);
+        cv::Mat frame(source.size(), CV_8UC4);
+
+        // the capture buffer, stylized in place
+        FrameView view{ frame.data, frame.cols, frame.rows, frame.step, PixelFormat::BGRA8 };
+
+        for (int i = 0; i < WarmUpRuns; i++) {
+          source.copyTo(frame);
+          inf.run(view, view, styleBlob, styleSize);
+        }
+
+        std::vector<double> total;
+        std::vector<double> pre;
+        std::vector<double> model;
+        std::vector<double> post;
+
+        for (int i = 0; i < options.frames; i++) {
+          // a fresh capture each time, not a stylized one
+          source.copyTo(frame);
+
+          Inference::Timings timings;
+
+          auto begin = Clock::now();
+          inf.run(view, view, styleBlob, styleSize, &timings);
+
+          total.push_back(Ms(Clock::now() - begin));
+          pre.push_back(timings.pre);
+          model.push_back(timings.model);
+          post.push_back(timings.post);
+        }
+
+        suite.add(Summarize(name + "/total", std::move(total)));
+        suite.add(Summarize(name + "/pre", std::move(pre)));
+        suite.add(Summarize(name + "/model", std::move(model)));
+        suite.add(Summarize(name + "/post", std::move(post)));
+
+        if (options.sessions <= 1) {
+          continue;
+        }
+
+        // a batch per pooled session (e.g. tiles of a large frame), whole batch times
+        std::vector<cv::Mat> batch(options.sessions);
+        std::vector<cv::Mat> stylized;
+        std::vector<double> batchTotal;
+
+        for (int i = 0; i < options.frames; i++) {
+          for (auto& input : batch) {
+            source.copyTo(input);
+          }
+
+          auto begin = Clock::now();
+          inf.stylizeConcurrent(batch, stylized, styleBlob, styleSize);
+
+          batchTotal.push_back(Ms(Clock::now() - begin));
+        }
+
+        suite.add(Summarize(name + "/batch" + std::to_string(options.sessions), std::move(batchTotal)));
+      }
+    }
+  }
+
+
+
+  bool WriteJson(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream file(path);
+    if (!file) {
+      std::cout << "Failed to write " << path << std::endl;
+      return false;
+    }
+
+    file << std::fixed << std::setprecision(4);
+    file << "{\n";
+    file << "  \"opencv\": \"" << CV_VERSION << "\",\n";
+    file << "  \"opencv_threads\": " << cv::getNumThreads() << ",\n";
+    file << "  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+      const auto& r = results[i];
+
+      file << "    { \"name\": \"" << Tools::Escape(r.name) << "\", \"iterations\": " << r.iterations
+        << ", \"mean_ms\": " << r.mean << ", \"min_ms\": " << r.min << ", \"p50_ms\": " << r.p50
+        << ", \"p90_ms\": " << r.p90 << ", \"p99_ms\": " << r.p99 << ", \"max_ms\": " << r.max
+        << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+
+    file << "  ]\n";
+    file << "}\n";
+
+    return static_cast<bool>(file);
+  }
+
+
+
+  // p50 by name from a file WriteJson wrote, one benchmark per line
+  std::map<std::string, double> ReadBaseline(const std::string& path) {
+    std::map<std::string, double> p50s;
+
+    std::ifstream file(path);
+    if (!file) {
+      std::cout << "Failed to open baseline " << path << std::endl;
+      return p50s;
+    }
+
+    const std::string nameKey = "\"name\": \"";
+    const std::string p50Key = "\"p50_ms\": ";
+
+    std::string line;
+    while (std::getline(file, line)) {
+      auto name = line.find(nameKey);
+      auto p50 = line.find(p50Key);
+
+      if (name == std::string::npos || p50 == std::string::npos) {
+        continue;
+      }
+
+      name += nameKey.size();
+      auto nameEnd = line.find('"', name);
+
+      if (nameEnd != std::string::npos) {
+        p50s[line.substr(name, nameEnd - name)] = std::atof(line.c_str() + p50 + p50Key.size());
+      }
+    }
+
+    return p50s;
+  }
+
+
+
+  // Returns the number of regressions
+  int CompareWithBaseline(const std::vector<Result>& results, const std::string& path, double threshold) {
+    auto baseline = ReadBaseline(path);
+    if (baseline.empty()) {
+      return 0;
+    }
+
+    std::cout << "\nvs. " << path << " (p50, regression beyond +" << threshold << "%)\n";
+
+    int regressions = 0;
+
+    for (const auto& result : results) {
+      auto it = baseline.find(result.name);
+      if (it == baseline.end() || it->second <= 0.0) {
+        continue;
+      }
+
+      double change = 100.0 * (result.p50 - it->second) / it->second;
+      bool regressed = change > threshold;
+
+      regressions += regressed ? 1 : 0;
+
+      std::cout << std::left << std::setw(36) << result.name << std::right << std::fixed << std::setprecision(3)
+        << std::setw(11) << it->second << std::setw(11) << result.p50
+        << std::showpos << std::setprecision(1) << std::setw(9) << change << "%" << std::noshowpos
+        << (regressed ? "  REGRESSED" : "") << "\n";
+    }
+
+    return regressions;
+  }
+}
+
+
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseArgs(argc, argv, options)) {
+    PrintUsage();
+    return 1;
+  }
+
+  if (options.threads >= 0) {
+    cv::setNumThreads(options.threads);
+  }
+
+  Suite suite(options);
+
+  std::cout << std::left << std::setw(36) << "benchmark" << std::right << std::setw(7) << "iters"
+    << std::setw(11) << "mean(ms)" << std::setw(11) << "p50" << std::setw(11) << "p90" << std::setw(11) << "p99" << std::endl;
+
+  if (options.micro) {
+    RunMicro(suite, options);
+  }
+
+  if (options.macro) {
+    RunMacro(suite, options);
+  }
+
+  if (!options.json.empty() && !WriteJson(options.json, suite.results())) {
+    return 1;
+  }
+
+  if (!options.baseline.empty() && CompareWithBaseline(suite.results(), options.baseline, options.threshold) > 0) {
+    return 2;
+  }
+
+  return 0;
+}
\ No newline at end of file
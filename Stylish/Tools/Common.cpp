@@ -0,0 +1,44 @@
+#include "Common.h"
+
+#include "Pipeline.h"
+
+#include <iostream>
+
+#include <opencv2/imgcodecs.hpp>
+
+
+bool Tools::MakeStyleBlob(const std::string& path, std::vector<float>& blob) {
+  if (path.empty()) {
+    blob.resize(static_cast<size_t>(StyleSize.first) * StyleSize.second * 3);
+    cv::Mat blobMat(StyleSize.second, StyleSize.first, CV_32FC3, blob.data());
+    cv::randu(blobMat, cv::Scalar::all(0.0f), cv::Scalar::all(1.0f));
+    return true;
+  }
+
+  auto image = cv::imread(path, cv::IMREAD_COLOR);
+  if (image.empty()) {
+    std::cout << "Failed to load style image " << path << std::endl;
+    return false;
+  }
+
+  cv::Mat styleImage;
+  FitStyleImage(image, cv::Size(StyleSize.first, StyleSize.second), styleImage);
+  ::MakeStyleBlob(styleImage, blob);
+
+  return true;
+}
+
+
+
+std::string Tools::Escape(const std::string& str) {
+  std::string escaped;
+
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+    }
+    escaped.push_back(c);
+  }
+
+  return escaped;
+}
\ No newline at end of file
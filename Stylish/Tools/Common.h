@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+
+//
+// Bits shared by the headless tools
+//
+namespace Tools {
+  // Style input size, as used by the app
+  const std::pair<int, int> StyleSize = { 256, 256 };
+
+  // The style image cache's own preparation (Pipeline.h): center square, style size, floats in [0, 1].
+  // A random style input if path is empty.
+  bool MakeStyleBlob(const std::string& path, std::vector<float>& blob);
+
+  // For JSON strings
+  std::string Escape(const std::string& str);
+}
\ No newline at end of file
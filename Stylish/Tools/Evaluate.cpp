@@ -0,0 +1,583 @@
+//
+// stylish-eval: what each speed/quality configuration (model tier x quality factor) costs in
+// fidelity and buys in latency.
+//
+// Every content/style pair of a corpus is stylized with the heaviest model at maximum quality, the
+// reference, then with each configuration. Outputs are scored against the reference with PSNR and
+// SSIM, and optionally with a perceptual metric (an LPIPS-style ONNX model taking two NCHW RGB
+// images in [-1, 1] and returning a distance). Latency is the stylization time per frame.
+//
+// The table lists every configuration with its Pareto status on latency vs. the chosen metric, and
+// the best configuration within common frame budgets, which is what presets should ship.
+//
+// Run from the directory holding models/.
+//
+
+#include "Common.h"
+
+#include "Inference.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  enum class Metric {
+    Psnr,
+    Ssim,
+    Perceptual
+  };
+
+  struct Options {
+    std::string content;
+    std::string styles;
+    cv::Size size = { 1280, 720 };  // content is resized to this window size
+    int maxPairs = 32;
+    int runs = 3;                   // timed runs per pair and configuration
+    int provider = -1;              // Inference::Provider, -1 - keep the default
+    std::string perceptual;         // model path, no perceptual metric if empty
+    Metric metric = Metric::Ssim;
+    std::string json;
+  };
+
+  struct Pair {
+    std::string content;
+    std::string style;
+    cv::Mat image;
+    std::vector<float> styleBlob;
+    cv::Mat reference;
+  };
+
+  struct Config {
+    int tier = 0;
+    int quality = 0;
+    std::string name;
+
+    std::vector<double> latencies;  // ms, every timed run
+    double p50 = 0.0;
+    double mean = 0.0;
+
+    double psnr = 0.0;              // means over the pairs
+    double ssim = 0.0;
+    double perceptual = 0.0;
+
+    bool reference = false;
+    bool pareto = false;
+  };
+
+  // frame time budgets for the recommendations: 60, 30, 20 and 10 fps
+  const double Budgets[] = { 1000.0 / 60, 1000.0 / 30, 1000.0 / 20, 1000.0 / 10 };
+
+  // PSNR of identical images is infinite, cap it for the averages
+  const double MaxPsnr = 100.0;
+
+
+  void PrintUsage() {
+    std::cout <<
+      "Usage: stylish-eval --content <dir> --styles <dir> [options]\n"
+      "  --size <w>x<h>        window size the content is resized to (default: 1280x720)\n"
+      "  --max-pairs <n>       content/style pairs to evaluate at most (default: 32)\n"
+      "  --runs <n>            timed runs per pair and configuration (default: 3)\n"
+      "  --provider cpu|gpu\n"
+      "  --perceptual <onnx>   also score with a perceptual model (LPIPS-style)\n"
+      "  --metric psnr|ssim|perceptual  quality axis of the Pareto front (default: ssim)\n"
+      "  --json <path>         also write the table as JSON\n";
+  }
+
+
+
+  bool ParseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      bool hasValue = i + 1 < argc;
+
+      if (arg == "--content" && hasValue) {
+        options.content = argv[++i];
+      }
+      else if (arg == "--styles" && hasValue) {
+        options.styles = argv[++i];
+      }
+      else if (arg == "--size" && hasValue) {
+        std::string size = argv[++i];
+        auto x = size.find('x');
+        int width = std::atoi(size.c_str());
+        int height = x != std::string::npos ? std::atoi(size.c_str() + x + 1) : 0;
+
+        if (width < 16 || height < 16) {
+          return false;
+        }
+        options.size = { width, height };
+      }
+      else if (arg == "--max-pairs" && hasValue) {
+        options.maxPairs = std::max(1, std::atoi(argv[++i]));
+      }
+      else if (arg == "--runs" && hasValue) {
+        options.runs = std::max(1, std::atoi(argv[++i]));
+      }
+      else if (arg == "--provider" && hasValue) {
+        std::string provider = argv[++i];
+        if (provider != "cpu" && provider != "gpu") {
+          return false;
+        }
+        options.provider = provider == "gpu" ? Inference::GPU : Inference::CPU;
+      }
+      else if (arg == "--perceptual" && hasValue) {
+        options.perceptual = argv[++i];
+      }
+      else if (arg == "--metric" && hasValue) {
+        std::string metric = argv[++i];
+        if (metric == "psnr") {
+          options.metric = Metric::Psnr;
+        }
+        else if (metric == "ssim") {
+          options.metric = Metric::Ssim;
+        }
+        else if (metric == "perceptual") {
+          options.metric = Metric::Perceptual;
+        }
+        else {
+          return false;
+        }
+      }
+      else if (arg == "--json" && hasValue) {
+        options.json = argv[++i];
+      }
+      else {
+        return false;
+      }
+    }
+
+    if (options.metric == Metric::Perceptual && options.perceptual.empty()) {
+      std::cout << "--metric perceptual needs --perceptual" << std::endl;
+      return false;
+    }
+
+    return !options.content.empty() && !options.styles.empty();
+  }
+
+
+
+  std::vector<std::string> ListImages(const std::string& folder) {
+    std::vector<std::string> paths;
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(folder, ec)) {
+      if (entry.is_regular_file() && cv::haveImageReader(entry.path().string())) {
+        paths.push_back(entry.path().string());
+      }
+    }
+
+    if (ec) {
+      std::cout << "Failed to list " << folder << ": " << ec.message() << std::endl;
+    }
+
+    // stable pairing across runs and machines
+    std::sort(paths.begin(), paths.end());
+
+    return paths;
+  }
+
+
+
+  // Mean SSIM over the channels, 11x11 Gaussian window (sigma 1.5), as in Wang et al.
+  double Ssim(const cv::Mat& a, const cv::Mat& b) {
+    const double C1 = (0.01 * 255) * (0.01 * 255);
+    const double C2 = (0.03 * 255) * (0.03 * 255);
+    const cv::Size Window(11, 11);
+
+    cv::Mat x;
+    cv::Mat y;
+    a.convertTo(x, CV_32F);
+    b.convertTo(y, CV_32F);
+
+    cv::Mat muX;
+    cv::Mat muY;
+    cv::GaussianBlur(x, muX, Window, 1.5);
+    cv::GaussianBlur(y, muY, Window, 1.5);
+
+    cv::Mat muX2 = muX.mul(muX);
+    cv::Mat muY2 = muY.mul(muY);
+    cv::Mat muXY = muX.mul(muY);
+
+    cv::Mat sigmaX2;
+    cv::Mat sigmaY2;
+    cv::Mat sigmaXY;
+    cv::GaussianBlur(x.mul(x), sigmaX2, Window, 1.5);
+    cv::GaussianBlur(y.mul(y), sigmaY2, Window, 1.5);
+    cv::GaussianBlur(x.mul(y), sigmaXY, Window, 1.5);
+
+    sigmaX2 -= muX2;
+    sigmaY2 -= muY2;
+    sigmaXY -= muXY;
+
+    cv::Mat numerator = (2 * muXY + C1).mul(2 * sigmaXY + C2);
+    cv::Mat denominator = (muX2 + muY2 + C1).mul(sigmaX2 + sigmaY2 + C2);
+
+    cv::Mat map;
+    cv::divide(numerator, denominator, map);
+
+    auto mean = cv::mean(map);
+
+    return (mean[0] + mean[1] + mean[2]) / 3.0;
+  }
+
+
+
+  //
+  // Perceptual distance from an ONNX model, e.g. LPIPS exported with two inputs
+  // (1, 3, H, W) RGB in [-1, 1] and a single distance as output. Lower is closer.
+  //
+  class PerceptualMetric {
+  public:
+    bool load(const std::string& path) {
+      try {
+        m_Env = std::make_unique<Ort::Env>(OrtLoggingLevel::ORT_LOGGING_LEVEL_ERROR, "Perceptual");
+        m_Session = std::make_unique<Ort::Session>(*m_Env, fs::path(path).c_str(), Ort::SessionOptions{});
+
+        if (m_Session->GetInputCount() != 2 || m_Session->GetOutputCount() < 1) {
+          std::cout << path << " must take two images and return a distance" << std::endl;
+          return false;
+        }
+
+        Ort::AllocatorWithDefaultOptions allocator;
+
+        for (size_t i = 0; i < 2; i++) {
+          m_InputNames.push_back(m_Session->GetInputNameAllocated(i, allocator).get());
+        }
+
+        m_OutputName = m_Session->GetOutputNameAllocated(0, allocator).get();
+
+        // fixed input size if the model declares one
+        auto shape = m_Session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if (shape.size() == 4 && shape[2] > 0 && shape[3] > 0) {
+          m_Size = cv::Size(static_cast<int>(shape[3]), static_cast<int>(shape[2]));
+        }
+      } catch (Ort::Exception& oe) {
+        std::cout << "Failed to load perceptual model " << path << ": " << oe.what() << std::endl;
+        return false;
+      }
+
+      return true;
+    }
+
+    double distance(const cv::Mat& a, const cv::Mat& b) {
+      auto x = toTensor(a);
+      auto y = toTensor(b);
+
+      cv::Size size = m_Size.area() > 0 ? m_Size : a.size();
+      std::vector<int64_t> dims = { 1, 3, size.height, size.width };
+
+      auto memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+      std::vector<Ort::Value> inputs;
+      inputs.emplace_back(Ort::Value::CreateTensor<float>(memoryInfo, x.data(), x.size(), dims.data(), dims.size()));
+      inputs.emplace_back(Ort::Value::CreateTensor<float>(memoryInfo, y.data(), y.size(), dims.data(), dims.size()));
+
+      const char* inputNames[] = { m_InputNames[0].c_str(), m_InputNames[1].c_str() };
+      const char* outputNames[] = { m_OutputName.c_str() };
+
+      auto outputs = m_Session->Run(Ort::RunOptions{ nullptr }, inputNames, inputs.data(), inputs.size(), outputNames, 1);
+
+      return outputs.front().GetTensorMutableData<float>()[0];
+    }
+
+  private:
+    std::unique_ptr<Ort::Env> m_Env;
+    std::unique_ptr<Ort::Session> m_Session;
+    std::vector<std::string> m_InputNames;
+    std::string m_OutputName;
+    cv::Size m_Size;
+
+    std::vector<float> toTensor(const cv::Mat& image) const {
+      cv::Mat rgb;
+      cv::cvtColor(image, rgb, cv::COLOR_BGR2RGB);
+
+      if (m_Size.area() > 0 && rgb.size() != m_Size) {
+        cv::resize(rgb, rgb, m_Size, 0, 0, cv::INTER_AREA);
+      }
+
+      rgb.convertTo(rgb, CV_32FC3, 2.0 / 255.0, -1.0);
+
+      // HWC -> CHW
+      std::vector<float> tensor(static_cast<size_t>(rgb.total()) * 3);
+      std::vector<cv::Mat> planes;
+      for (int c = 0; c < 3; c++) {
+        planes.emplace_back(rgb.rows, rgb.cols, CV_32F, tensor.data() + c * rgb.total());
+      }
+      cv::split(rgb, planes);
+
+      return tensor;
+    }
+  };
+
+
+
+  // Pareto front on (lower latency, better quality)
+  void MarkPareto(std::vector<Config>& configs, Metric metric) {
+    auto quality = [metric](const Config& c) {
+      switch (metric) {
+        case Metric::Psnr: return c.psnr;
+        case Metric::Perceptual: return -c.perceptual;
+        default: return c.ssim;
+      }
+    };
+
+    for (auto& c : configs) {
+      c.pareto = std::none_of(configs.begin(), configs.end(), [&](const Config& other) {
+        bool noWorse = other.p50 <= c.p50 && quality(other) >= quality(c);
+        bool better = other.p50 < c.p50 || quality(other) > quality(c);
+        return &other != &c && noWorse && better;
+      });
+    }
+  }
+
+
+
+  const char* MetricName(Metric metric) {
+    switch (metric) {
+      case Metric::Psnr: return "psnr";
+      case Metric::Perceptual: return "perceptual";
+      default: return "ssim";
+    }
+  }
+
+
+
+  // Best quality among the Pareto configurations within a frame budget, null if none fits
+  const Config* BestWithin(const std::vector<Config>& configs, double budgetMs) {
+    const Config* best = nullptr;
+
+    for (const auto& c : configs) {
+      if (c.pareto && c.p50 <= budgetMs && (!best || c.p50 > best->p50)) {
+        best = &c; // on the front, slower means better
+      }
+    }
+
+    return best;
+  }
+}
+
+
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseArgs(argc, argv, options)) {
+    PrintUsage();
+    return 1;
+  }
+
+  auto contentPaths = ListImages(options.content);
+  auto stylePaths = ListImages(options.styles);
+
+  if (contentPaths.empty() || stylePaths.empty()) {
+    std::cout << "No content or style images" << std::endl;
+    return 1;
+  }
+
+  // content x style, along diagonals so a cap keeps variety on both sides
+  std::vector<Pair> pairs;
+  size_t combinations = contentPaths.size() * stylePaths.size();
+
+  for (size_t i = 0; i < combinations && pairs.size() < static_cast<size_t>(options.maxPairs); i++) {
+    size_t content = i % contentPaths.size();
+    size_t round = i / contentPaths.size();
+
+    Pair pair;
+    pair.content = contentPaths[content];
+    pair.style = stylePaths[(content + round) % stylePaths.size()];
+
+    auto image = cv::imread(pair.content, cv::IMREAD_COLOR);
+    if (image.empty() || !Tools::MakeStyleBlob(pair.style, pair.styleBlob)) {
+      continue;
+    }
+
+    cv::resize(image, pair.image, options.size, 0, 0, cv::INTER_AREA);
+    pairs.push_back(std::move(pair));
+  }
+
+  if (pairs.empty()) {
+    std::cout << "No readable content/style pairs" << std::endl;
+    return 1;
+  }
+
+  PerceptualMetric perceptual;
+  if (!options.perceptual.empty() && !perceptual.load(options.perceptual)) {
+    return 1;
+  }
+
+  Inference inf(nullptr);
+
+  if (options.provider == Inference::GPU && !inf.isGPUReady()) {
+    std::cout << "GPU provider unavailable, evaluating on the CPU" << std::endl;
+  }
+  else if (options.provider >= 0) {
+    inf.setProvider(static_cast<Inference::Provider>(options.provider));
+  }
+
+  auto qualityRange = inf.getQualityPerfRange();
+  int tiers = inf.getModelTierCount();
+
+  // reference first: heaviest model, maximum quality
+  std::vector<Config> configs;
+
+  for (int tier = tiers - 1; tier >= 0; tier--) {
+    for (int q = qualityRange.second; q >= qualityRange.first; q--) {
+      Config config;
+      config.tier = tier;
+      config.quality = q;
+      config.name = inf.getModelTierName(tier) + "/q" + std::to_string(q);
+      config.reference = configs.empty();
+      configs.push_back(std::move(config));
+    }
+  }
+
+  std::cout << pairs.size() << " pairs at " << options.size.width << "x" << options.size.height << ", "
+    << configs.size() << " configurations, " << (inf.getProvider() == Inference::GPU ? "GPU" : "CPU") << std::endl;
+
+  cv::Mat output;
+
+  for (auto& config : configs) {
+    if (!inf.setModelTier(config.tier, true)) {
+      std::cout << "Model tier " << config.tier << " unavailable" << (config.reference ? "" : ", skipped") << std::endl;
+
+      if (config.reference) {
+        return 1;
+      }
+      continue;
+    }
+
+    inf.setQualityPerfFactor(config.quality);
+
+    // the first run of a configuration pays for allocations at the new size
+    inf.stylize(pairs.front().image, output, pairs.front().styleBlob, Tools::StyleSize);
+
+    for (auto& pair : pairs) {
+      for (int run = 0; run < options.runs; run++) {
+        auto begin = Clock::now();
+        inf.stylize(pair.image, output, pair.styleBlob, Tools::StyleSize);
+        config.latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - begin).count());
+      }
+
+      if (config.reference) {
+        pair.reference = output.clone();
+      }
+
+      config.psnr += std::min(MaxPsnr, cv::PSNR(output, pair.reference));
+      config.ssim += Ssim(output, pair.reference);
+
+      if (!options.perceptual.empty()) {
+        config.perceptual += perceptual.distance(output, pair.reference);
+      }
+    }
+
+    config.psnr /= pairs.size();
+    config.ssim /= pairs.size();
+    config.perceptual /= pairs.size();
+
+    auto sorted = config.latencies;
+    std::sort(sorted.begin(), sorted.end());
+
+    config.p50 = sorted[sorted.size() / 2];
+
+    for (auto latency : sorted) {
+      config.mean += latency / sorted.size();
+    }
+
+    std::cout << "  " << config.name << " done" << std::endl;
+  }
+
+  // tiers that failed to load have no timings
+  configs.erase(std::remove_if(configs.begin(), configs.end(), [](const Config& c) { return c.latencies.empty(); }), configs.end());
+
+  if (configs.empty()) {
+    return 1;
+  }
+
+  MarkPareto(configs, options.metric);
+
+  std::sort(configs.begin(), configs.end(), [](const Config& a, const Config& b) { return a.p50 < b.p50; });
+
+  std::cout << "\n" << std::left << std::setw(20) << "config" << std::right << std::setw(10) << "p50(ms)" << std::setw(10) << "mean"
+    << std::setw(10) << "PSNR" << std::setw(8) << "SSIM";
+  if (!options.perceptual.empty()) {
+    std::cout << std::setw(12) << "perceptual";
+  }
+  std::cout << "  pareto (" << MetricName(options.metric) << ")\n";
+
+  for (const auto& c : configs) {
+    std::cout << std::left << std::setw(20) << (c.reference ? c.name + " (ref)" : c.name) << std::right << std::fixed
+      << std::setprecision(2) << std::setw(10) << c.p50 << std::setw(10) << c.mean
+      << std::setw(10) << c.psnr << std::setprecision(4) << std::setw(8) << c.ssim;
+    if (!options.perceptual.empty()) {
+      std::cout << std::setw(12) << c.perceptual;
+    }
+    std::cout << (c.pareto ? "  *" : "") << "\n";
+  }
+
+  std::cout << "\nBest within budget:\n";
+  for (auto budget : Budgets) {
+    const auto* best = BestWithin(configs, budget);
+    std::cout << "  " << std::setprecision(1) << std::setw(6) << budget << " ms  " << (best ? best->name : "none") << "\n";
+  }
+
+  if (!options.json.empty()) {
+    std::ofstream file(options.json);
+    if (!file) {
+      std::cout << "Failed to write " << options.json << std::endl;
+      return 1;
+    }
+
+    file << std::fixed << std::setprecision(4);
+    file << "{\n";
+    file << "  \"pairs\": " << pairs.size() << ",\n";
+    file << "  \"size\": \"" << options.size.width << "x" << options.size.height << "\",\n";
+    file << "  \"provider\": \"" << (inf.getProvider() == Inference::GPU ? "gpu" : "cpu") << "\",\n";
+    file << "  \"metric\": \"" << MetricName(options.metric) << "\",\n";
+    file << "  \"configs\": [\n";
+
+    for (size_t i = 0; i < configs.size(); i++) {
+      const auto& c = configs[i];
+
+      file << "    { \"name\": \"" << Tools::Escape(c.name) << "\", \"tier\": " << c.tier << ", \"quality\": " << c.quality
+        << ", \"p50_ms\": " << c.p50 << ", \"mean_ms\": " << c.mean << ", \"psnr\": " << c.psnr << ", \"ssim\": " << c.ssim;
+      if (!options.perceptual.empty()) {
+        file << ", \"perceptual\": " << c.perceptual;
+      }
+      file << ", \"reference\": " << (c.reference ? "true" : "false") << ", \"pareto\": " << (c.pareto ? "true" : "false")
+        << " }" << (i + 1 < configs.size() ? "," : "") << "\n";
+    }
+
+    file << "  ],\n";
+    file << "  \"budgets\": [\n";
+
+    for (size_t i = 0; i < std::size(Budgets); i++) {
+      const auto* best = BestWithin(configs, Budgets[i]);
+
+      file << "    { \"ms\": " << Budgets[i] << ", \"config\": " << (best ? "\"" + Tools::Escape(best->name) + "\"" : "null")
+        << " }" << (i + 1 < std::size(Budgets) ? "," : "") << "\n";
+    }
+
+    file << "  ]\n";
+    file << "}\n";
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,310 @@
+//
+// stylish-replay: drives the inference pipeline (Inference::run on BGRA frames, as the capture window
+// does) from a capture recording (.strec, recorded from the metrics panel) and reports per-stage
+// latency statistics.
+//
+// At recorded speed, frames arrive when they were captured and, as in the app, a frame that is
+// superseded by a newer one before the pipeline gets to it is dropped. At maximum speed every frame
+// is stylized back to back.
+//
+// Run from the directory holding models/, like the app.
+//
+
+#include "Common.h"
+
+#include "CaptureRecording.h"
+#include "Inference.h"
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  struct Options {
+    std::string recording;
+    std::string style;              // random style input if empty
+    bool maxSpeed = false;
+    int provider = -1;              // Inference::Provider, -1 - keep the default
+    int quality = -1;
+    int tier = -1;
+    int loops = 1;
+    std::string json;
+  };
+
+  enum Stage {
+    Decode = 0,
+    Pre,
+    Model,
+    Post,
+    Total,
+    StageCount
+  };
+
+  const char* StageNames[] = { "decode", "pre", "model", "post", "total" };
+
+
+  void PrintUsage() {
+    std::cout <<
+      "Usage: stylish-replay <recording.strec> [options]\n"
+      "  --style <image>     style image (default: random)\n"
+      "  --max-speed         stylize every frame back to back (default: recorded speed)\n"
+      "  --provider cpu|gpu\n"
+      "  --quality <n>       quality/performance factor\n"
+      "  --tier <n>          model tier\n"
+      "  --loops <n>         replay the recording n times\n"
+      "  --json <path>       also write the statistics as JSON\n";
+  }
+
+
+
+  bool ParseArgs(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      bool hasValue = i + 1 < argc;
+
+      if (arg == "--max-speed") {
+        options.maxSpeed = true;
+      }
+      else if (arg == "--style" && hasValue) {
+        options.style = argv[++i];
+      }
+      else if (arg == "--provider" && hasValue) {
+        std::string provider = argv[++i];
+        if (provider != "cpu" && provider != "gpu") {
+          return false;
+        }
+        options.provider = provider == "gpu" ? Inference::GPU : Inference::CPU;
+      }
+      else if (arg == "--quality" && hasValue) {
+        options.quality = std::atoi(argv[++i]);
+      }
+      else if (arg == "--tier" && hasValue) {
+        options.tier = std::atoi(argv[++i]);
+      }
+      else if (arg == "--loops" && hasValue) {
+        options.loops = std::max(1, std::atoi(argv[++i]));
+      }
+      else if (arg == "--json" && hasValue) {
+        options.json = argv[++i];
+      }
+      else if (arg[0] != '-' && options.recording.empty()) {
+        options.recording = arg;
+      }
+      else {
+        return false;
+      }
+    }
+
+    return !options.recording.empty();
+  }
+
+
+
+  float Ms(Clock::duration duration) {
+    return std::chrono::duration<float, std::milli>(duration).count();
+  }
+
+
+
+  void PrintStage(const char* name, const LatencyHistogram::Summary& s) {
+    float min = s.count ? LatencyHistogram::bucketLow(s.firstBucket) : 0.0f;
+
+    std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(2)
+      << std::setw(8) << s.count
+      << std::setw(10) << s.mean
+      << std::setw(10) << min
+      << std::setw(10) << s.p50
+      << std::setw(10) << s.p90
+      << std::setw(10) << s.p99
+      << std::setw(10) << s.max << "\n";
+  }
+
+
+
+  void WriteStageJson(std::ofstream& file, const char* name, const LatencyHistogram::Summary& s, bool last) {
+    float min = s.count ? LatencyHistogram::bucketLow(s.firstBucket) : 0.0f;
+
+    file << "    \"" << name << "\": { \"count\": " << s.count << ", \"mean\": " << s.mean << ", \"min\": " << min
+      << ", \"p50\": " << s.p50 << ", \"p90\": " << s.p90 << ", \"p99\": " << s.p99 << ", \"max\": " << s.max
+      << " }" << (last ? "" : ",") << "\n";
+  }
+}
+
+
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseArgs(argc, argv, options)) {
+    PrintUsage();
+    return 1;
+  }
+
+  CaptureReader reader;
+  if (!reader.open(options.recording)) {
+    return 1;
+  }
+
+  std::vector<float> styleBlob;
+  if (!Tools::MakeStyleBlob(options.style, styleBlob)) {
+    return 1;
+  }
+
+  Inference inf(nullptr);
+
+  if (options.provider == Inference::GPU && !inf.isGPUReady()) {
+    std::cout << "GPU provider unavailable, replaying on the CPU" << std::endl;
+  }
+  else if (options.provider >= 0) {
+    inf.setProvider(static_cast<Inference::Provider>(options.provider));
+  }
+
+  if (options.quality >= 0) {
+    inf.setQualityPerfFactor(options.quality);
+  }
+
+  if (options.tier >= 0 && !inf.setModelTier(options.tier, true)) {
+    std::cout << "Model tier " << options.tier << " unavailable" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Replaying " << options.recording << " at " << (options.maxSpeed ? "maximum" : "recorded") << " speed, "
+    << (inf.getProvider() == Inference::GPU ? "GPU" : "CPU") << ", quality " << inf.getQualityPerfFactor()
+    << ", model " << inf.getModelTierName(inf.getModelTier()) << std::endl;
+
+  LatencyHistogram stages[StageCount];
+
+  uint64_t frames = 0;
+  uint64_t processed = 0;
+  uint64_t dropped = 0;
+  uint64_t keyframes = 0;
+
+  auto start = Clock::now();
+  uint64_t loopOffsetUs = 0;  // recorded time of the loops before
+
+  CaptureRecording::Frame current;
+  CaptureRecording::Frame next;
+  cv::Mat frame;
+
+  for (int loop = 0; loop < options.loops; loop++) {
+    if (loop > 0 && !reader.rewind()) {
+      break;
+    }
+
+    auto decodeBegin = Clock::now();
+    bool hasNext = reader.next(next);
+    if (hasNext) {
+      stages[Decode].record(Ms(Clock::now() - decodeBegin));
+    }
+
+    uint64_t lastUs = 0;
+
+    while (hasNext) {
+      std::swap(current, next);
+      frames++;
+      keyframes += current.keyframe ? 1 : 0;
+      lastUs = current.timeUs;
+
+      // the one after, so we know whether this one is already superseded
+      decodeBegin = Clock::now();
+      hasNext = reader.next(next);
+      if (hasNext) {
+        stages[Decode].record(Ms(Clock::now() - decodeBegin));
+      }
+
+      if (!options.maxSpeed) {
+        auto due = start + std::chrono::microseconds(loopOffsetUs + current.timeUs);
+        auto nextDue = start + std::chrono::microseconds(loopOffsetUs + next.timeUs);
+
+        if (hasNext && Clock::now() >= nextDue) {
+          dropped++;
+          continue;
+        }
+
+        std::this_thread::sleep_until(due);
+      }
+
+      // BGRA like the capture buffer, stylized in place as the capture window does (not timed)
+      cv::cvtColor(current.image, frame, cv::COLOR_BGR2BGRA);
+      FrameView view{ frame.data, frame.cols, frame.rows, frame.step, PixelFormat::BGRA8 };
+
+      Inference::Timings timings;
+
+      auto runBegin = Clock::now();
+      inf.run(view, view, styleBlob, Tools::StyleSize, &timings);
+      auto runEnd = Clock::now();
+
+      stages[Pre].record(timings.pre);
+      stages[Model].record(timings.model);
+      stages[Post].record(timings.post);
+      stages[Total].record(Ms(runEnd - runBegin));
+
+      processed++;
+    }
+
+    loopOffsetUs += lastUs;
+  }
+
+  float seconds = std::chrono::duration<float>(Clock::now() - start).count();
+
+  if (frames == 0) {
+    std::cout << "No frames in " << options.recording << std::endl;
+    return 1;
+  }
+
+  LatencyHistogram::Summary summaries[StageCount];
+  for (int i = 0; i < StageCount; i++) {
+    summaries[i] = stages[i].lifetime();
+  }
+
+  std::cout << "\n" << frames << " frames (" << keyframes << " keyframes), " << processed << " stylized, "
+    << dropped << " dropped, " << std::fixed << std::setprecision(2) << seconds << " s, "
+    << (seconds > 0.0f ? processed / seconds : 0.0f) << " fps\n\n";
+
+  std::cout << "stage      count  mean(ms)       min       p50       p90       p99       max\n";
+  for (int i = 0; i < StageCount; i++) {
+    PrintStage(StageNames[i], summaries[i]);
+  }
+
+  if (!options.json.empty()) {
+    std::ofstream file(options.json);
+    if (!file) {
+      std::cout << "Failed to write " << options.json << std::endl;
+      return 1;
+    }
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\n";
+    file << "  \"recording\": \"" << Tools::Escape(options.recording) << "\",\n";
+    file << "  \"speed\": \"" << (options.maxSpeed ? "max" : "recorded") << "\",\n";
+    file << "  \"provider\": \"" << (inf.getProvider() == Inference::GPU ? "gpu" : "cpu") << "\",\n";
+    file << "  \"quality\": " << inf.getQualityPerfFactor() << ",\n";
+    file << "  \"model\": \"" << Tools::Escape(inf.getModelTierName(inf.getModelTier())) << "\",\n";
+    file << "  \"frames\": " << frames << ",\n";
+    file << "  \"stylized\": " << processed << ",\n";
+    file << "  \"dropped\": " << dropped << ",\n";
+    file << "  \"seconds\": " << seconds << ",\n";
+    file << "  \"stages\": {\n";
+
+    for (int i = 0; i < StageCount; i++) {
+      WriteStageJson(file, StageNames[i], summaries[i], i + 1 == StageCount);
+    }
+
+    file << "  }\n";
+    file << "}\n";
+  }
+
+  return 0;
+}
\ No newline at end of file
@@ -1,12 +1,21 @@
 #include "UiControls.h"
 
+#include "AutoTuner.h"
+#include "CaptureRecording.h"
+#include "D3D11ThumbnailTextures.h"
 #include "Inference.h"
+#include "MemoryAccounting.h"
+#include "MetricsExporter.h"
+#include "ProcessMemory.h"
+#include "SpanRecorder.h"
 #include "StyleImageCache.h"
 
 #include "imgui/imgui_impl_win32.h"
 #include "imgui/imgui_impl_dx11.h"
 #include "imgui/imgui_internal.h"
 
+#include <algorithm>
+#include <filesystem>
 #include <stdexcept>
 
 
@@ -88,10 +97,14 @@ namespace {
 
 
 
-UiControls::UiControls(HMODULE hInstance, HWND hwndParent, int nCmdShow, Inference* inf, StyleImageCache* styleImgCache, PerfMetrics* metrics)
-  : m_Inf{ inf }
+UiControls::UiControls(HMODULE hInstance, HWND hwndParent, int nCmdShow, Inference* inf, StyleImageCache* styleImgCache, PerfMetrics* metrics, CaptureRecorder* recorder)
+  : m_HwndParent{ hwndParent }
+  , m_Inf{ inf }
   , m_StyleImageCache{ styleImgCache }
-  , m_Metrics{ metrics } {
+  , m_Metrics{ metrics }
+  , m_Recorder{ recorder }
+  , m_AutoTuner{ std::make_unique<AutoTuner>(inf) }
+  , m_Exporter{ std::make_unique<MetricsExporter>(metrics) } {
 
   const TCHAR WindowClassName[] = TEXT("UI");
 
@@ -148,7 +161,8 @@ UiControls::UiControls(HMODULE hInstance, HWND hwndParent, int nCmdShow, Inferen
   // load style images
   // TODO weird that this happens in the "UI" .. move out
   std::string styleFolder = "styles";
-  m_StyleImageCache->load(styleFolder, m_D3DDevice, m_D3DDeviceContext);
+  m_ThumbnailTextures = std::make_unique<D3D11ThumbnailTextures>(m_D3DDevice, m_D3DDeviceContext);
+  m_StyleImageCache->load(styleFolder, m_ThumbnailTextures.get());
 
   // Setup Dear ImGui context
 
@@ -181,12 +195,22 @@ UiControls::~UiControls() {
   ImGui::DestroyContext();
 
   m_StyleImageCache->clear();
+  m_ThumbnailTextures.reset();
 
   CleanupDeviceD3D();
 }
 
 
 
+void UiControls::startAutoTune() {
+  RECT rect;
+  GetClientRect(m_HwndParent, &rect);
+
+  m_AutoTuner->start(rect.right - rect.left, rect.bottom - rect.top, m_AutoTuneQualityFloor);
+}
+
+
+
 void UiControls::onWindowSizeChanged(UINT width, UINT height) {
   if (m_D3DDevice != NULL) {
     CleanupRenderTarget();
@@ -273,6 +297,8 @@ void UiControls::CleanupRenderTarget()
 
 void UiControls::render(float fps)
 {
+  SpanRecorder::Scope span("UiControls::render");
+
   // Start ImGui frame
   
   ImGui::GetIO().FontGlobalScale = m_DpiScaleFactor;
@@ -281,6 +307,35 @@ void UiControls::render(float fps)
   ImGui_ImplWin32_NewFrame();
   ImGui::NewFrame();
 
+  // Styles loaded in the background since the last frame
+  m_StyleImageCache->update();
+
+  m_Exporter->update(fps, *m_Inf, *m_StyleImageCache);
+
+  // Settings are loaded by now
+
+  // rebuilding the sessions takes a while, it happens in the background
+  if (m_RestoredIntraOpThreads > 0 || m_RestoredInterOpThreads > 0) {
+    m_Inf->requestThreadCount(
+      m_RestoredIntraOpThreads > 0 ? m_RestoredIntraOpThreads : m_Inf->getIntraOpThreads(),
+      m_RestoredInterOpThreads > 0 ? m_RestoredInterOpThreads : m_Inf->getInterOpThreads());
+
+    m_RestoredIntraOpThreads = 0;
+    m_RestoredInterOpThreads = 0;
+  }
+
+  // Autotune on first launch
+
+  if (!m_AutoTuned && m_AutoTuner->getState() == AutoTuner::State::Idle) {
+    startAutoTune();
+  }
+
+  // runs in the background, the result is applied once it's done
+  if (!m_AutoTuned && m_AutoTuner->getState() == AutoTuner::State::Done) {
+    m_AutoTuned = true;
+    ImGui::MarkIniSettingsDirty();
+  }
+
   // Setup UI Controls
 
   RECT rect;
@@ -316,7 +371,7 @@ void UiControls::render(float fps)
 
   ImGui::SameLine(0, 8 * ImGui::GetFontSize());
 
-  static int provider = m_Inf->getProvider();
+  int provider = m_Inf->getProvider();
 
   if (ImGui::RadioButton("CPU", &provider, 0)) {
     m_Inf->setProvider(static_cast<Inference::Provider>(provider));
@@ -362,6 +417,45 @@ void UiControls::render(float fps)
 
   ImGui::Text("FPS: %d", static_cast<int>(round(fps)));
 
+  ImGui::SameLine(0, 2 * ImGui::GetFontSize());
+  ImGui::SetCursorPosY(ImGui::GetCursorPosY() - verticalOffset);
+
+  bool metrics = Instrumentation::isEnabled();
+  if (ImGui::Checkbox("Metrics", &metrics)) {
+    Instrumentation::setEnabled(metrics);
+    ImGui::MarkIniSettingsDirty();
+  }
+
+  ImGui::Spacing();
+  ImGui::Spacing();
+
+  if (m_AutoTuner->isRunning()) {
+    if (ImGui::Button("Cancel Autotune")) {
+      m_AutoTuner->cancel();
+      m_AutoTuned = true;
+      ImGui::MarkIniSettingsDirty();
+    }
+
+    ImGui::SameLine();
+    ImGui::ProgressBar(m_AutoTuner->getProgress(), ImVec2(-1.0f, 0.0f));
+  }
+  else {
+    if (ImGui::Button("Autotune")) {
+      startAutoTune();
+    }
+
+    ImGui::SameLine();
+    ImGui::Text("Min. quality");
+    ImGui::SameLine();
+    ImGui::SetCursorPosY(ImGui::GetCursorPosY() - verticalOffset);
+    ImGui::PushItemWidth(4 * ImGui::GetFontSize());
+    auto floorRange = m_Inf->getQualityPerfRange();
+    if (ImGui::SliderInt("##sliderAutoTuneFloor", &m_AutoTuneQualityFloor, floorRange.first, floorRange.second)) {
+      ImGui::MarkIniSettingsDirty();
+    }
+    ImGui::PopItemWidth();
+  }
+
 
   ImGui::Dummy(sectionSpacing);
 
@@ -378,15 +472,22 @@ void UiControls::render(float fps)
   ImGui::PushStyleColor(ImGuiCol_Button, colorReload);
 
   float windowWidth = ImGui::GetWindowSize().x;
-  const char* buttonLabel = "Reload";
+  const char* buttonLabel = m_StyleImageCache->isLoading() ? "Loading" : "Reload";
   float buttonWidth = ImGui::CalcTextSize(buttonLabel).x + ImGui::GetStyle().FramePadding.x * 2; // Consider padding
   float newCursorPosX = windowWidth - buttonWidth - ImGui::GetStyle().WindowPadding.x;
   newCursorPosX = std::max(0.0f, newCursorPosX);
 
+  const char* similarLabel = "Similar";
+  float similarWidth = ImGui::GetFrameHeight() + ImGui::GetStyle().ItemInnerSpacing.x + ImGui::CalcTextSize(similarLabel).x;
+
+  ImGui::SetCursorPosX(std::max(0.0f, newCursorPosX - similarWidth - ImGui::GetStyle().ItemSpacing.x));
+  ImGui::Checkbox(similarLabel, &m_ShowSimilar);
+  ImGui::SameLine();
+
   ImGui::SetCursorPosX(newCursorPosX);
 
   if (ImGui::Button(buttonLabel)) {
-    m_StyleImageCache->load(m_StyleImageCache->getPathToStyleFolder(), m_D3DDevice, m_D3DDeviceContext);
+    m_StyleImageCache->reload();
   }
 
   ImGui::PopStyleColor();
@@ -404,19 +505,93 @@ void UiControls::render(float fps)
     activeImg = img->path;
   }
 
-  for (const auto& [path, img] : m_StyleImageCache->getImages()) {
-    if (path == activeImg) {
-      ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.84f, 0.0f, 0.43f, 1.0f));
+  std::string blendImg = m_StyleImageCache->getBlendImage();
+
+  // rows -> list indices, when showing similar styles
+  if (m_ShowSimilar && (activeImg != m_SimilarTo || m_StyleImageCache->getListVersion() != m_SimilarListVersion)) {
+    m_SimilarTo = activeImg;
+    m_SimilarListVersion = m_StyleImageCache->getListVersion();
+    m_SimilarRows.clear();
+
+    // a near-duplicate isn't listed, the style it collapsed into stands in for it
+    const auto& duplicates = m_StyleImageCache->getDuplicates();
+    auto kept = duplicates.find(activeImg);
+    const auto& listed = kept != duplicates.end() ? kept->second : activeImg;
+
+    if (!listed.empty()) {
+      m_SimilarRows = m_StyleImageCache->findSimilar(listed, m_SimilarCount);
+
+      for (size_t i = 0; i < m_StyleImageCache->getImageCount(); i++) {
+        if (m_StyleImageCache->getImage(i).path == listed) {
+          m_SimilarRows.insert(m_SimilarRows.begin(), i);
+          break;
+        }
+      }
     }
+  }
+
+  const auto& rows = m_SimilarRows;
+
+  int rowCount = m_ShowSimilar ? static_cast<int>(rows.size()) : static_cast<int>(m_StyleImageCache->getImageCount());
 
-    if (ImGui::ImageButton(img.m_Thumbnail, imageSize)) {
-      m_StyleImageCache->setActiveImage(path);
+  // only the visible rows are submitted
+  ImGuiListClipper clipper;
+  clipper.Begin(rowCount);
+
+  while (clipper.Step()) {
+    if (m_ShowSimilar) {
+      for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+        m_StyleImageCache->requestThumbnails(rows[row], rows[row] + 1);
+      }
+    }
+    else {
+      m_StyleImageCache->requestThumbnails(clipper.DisplayStart, clipper.DisplayEnd);
     }
 
-    ImGui::Spacing();
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+      const auto& img = m_StyleImageCache->getImage(m_ShowSimilar ? rows[row] : row);
+      const auto& path = img.path;
+
+      bool highlighted = path == activeImg || path == blendImg;
+
+      if (path == activeImg) {
+        ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.84f, 0.0f, 0.43f, 1.0f));
+      }
+      else if (path == blendImg) {
+        ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.0f, 0.55f, 0.6f, 1.0f));
+      }
+
+      const auto& slot = img.m_ThumbnailSlot;
+      bool clicked = false;
+
+      // consecutive thumbnails on the same atlas page batch into one draw
+      if (img.m_Thumbnail) {
+        clicked = ImGui::ImageButton(path.c_str(), img.m_Thumbnail, imageSize, ImVec2(slot.u0, slot.v0), ImVec2(slot.u1, slot.v1));
+      }
+      else {
+        // placeholder, same size, until the thumbnail is uploaded
+        auto padding = ImGui::GetStyle().FramePadding;
+        clicked = ImGui::Button(("##" + path).c_str(), ImVec2(imageSize.x + 2 * padding.x, imageSize.y + 2 * padding.y));
+      }
+
+      if (clicked) {
+        m_StyleImageCache->setActiveImage(path);
+      }
+
+      if (ImGui::IsItemHovered()) {
+        m_StyleImageCache->hintHovered(path);
+      }
+
+      // right-click picks (or drops) the style to blend in
+      if (ImGui::IsItemClicked(ImGuiMouseButton_Right)) {
+        m_StyleImageCache->setBlendImage(path == blendImg ? "" : path);
+      }
 
-    if (path == activeImg) {
-      ImGui::PopStyleColor();
+      ImGui::Spacing();
+
+      if (highlighted) {
+        ImGui::PopStyleColor();
+      }
     }
   }
 
@@ -424,7 +599,7 @@ void UiControls::render(float fps)
 
 
   // Performance metrics section
-  if (m_Metrics) {
+  if (m_Metrics && Instrumentation::isEnabled()) {
     ImGui::SameLine(0.0f, 30.0f);
 
     ImGui::BeginChild("PerformanceMetrics", ImVec2(1.15f * imageSize.x, 2.5f * imageSize.y), ImGuiChildFlags_Border);
@@ -433,44 +608,311 @@ void UiControls::render(float fps)
     ImGui::Text("Performance");
     ImGui::PopStyleColor();
     ImGui::Text("Inference");
+    ImGui::SameLine();
+    ImGui::Checkbox("Lifetime", &m_LifetimeLatency);
+
+    auto latency = [this](PerfMetrics::Stage stage) {
+      const auto& histogram = m_Metrics->infRun(stage);
+      return m_LifetimeLatency ? histogram.lifetime() : histogram.window();
+    };
+
+    auto total = latency(PerfMetrics::Stage::Total);
+    auto pre = latency(PerfMetrics::Stage::Pre);
+    auto model = latency(PerfMetrics::Stage::Model);
+    auto post = latency(PerfMetrics::Stage::Post);
+
     ImGui::Text("++startup %f ms", m_Metrics->infStart());
-    ImGui::Text("++run %f ms", m_Metrics->infRunTotal());
-    ImGui::Text("++++pre-processing %f ms", m_Metrics->infRunPre());
-    ImGui::Text("++++run the model %f ms", m_Metrics->infRunModel());
-    ImGui::Text("++++post-processing %f ms", m_Metrics->infRunPost());
+    ImGui::Text("++run p50 %.2f p90 %.2f p99 %.2f max %.2f ms", total.p50, total.p90, total.p99, total.max);
+    ImGui::Text("++++pre-processing p50 %.2f p99 %.2f ms", pre.p50, pre.p99);
+    ImGui::Text("++++run the model p50 %.2f p99 %.2f ms", model.p50, model.p99);
+    ImGui::Text("++++post-processing p50 %.2f p99 %.2f ms", post.p50, post.p99);
+    ImGui::Text("++%llu runs", static_cast<unsigned long long>(total.count));
+
+    if (total.count > 0) {
+      // buckets are log-spaced, so this is the distribution on a log scale
+      std::vector<float> distribution(total.buckets.begin() + total.firstBucket, total.buckets.begin() + total.lastBucket + 1);
+      char range[64];
+      sprintf_s(range, sizeof(range), "%.2f - %.2f ms", LatencyHistogram::bucketLow(total.firstBucket), LatencyHistogram::bucketHigh(total.lastBucket));
+
+      ImGui::PlotHistogram("##latency", distribution.data(), static_cast<int>(distribution.size()), 0, range, 0.0f, FLT_MAX, ImVec2(0.0f, 60.0f));
+    }
+
+    auto p99 = m_Metrics->infRun(PerfMetrics::Stage::Total).windowP99();
+    ImGui::PlotLines("##p99", p99.data(), static_cast<int>(p99.size()), 0, "p99 per second", 0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+
+    const auto& frameHistogram = m_Metrics->frameLatency();
+    auto frameLatency = m_LifetimeLatency ? frameHistogram.lifetime() : frameHistogram.window();
+    auto frames = m_Metrics->frameCounts();
+
+    ImGui::Spacing();
+    ImGui::Text("Frames");
+    ImGui::Text("++capture to present p50 %.2f p90 %.2f p99 %.2f max %.2f ms", frameLatency.p50, frameLatency.p90, frameLatency.p99, frameLatency.max);
+    ImGui::Text("++presented %llu dropped %llu", static_cast<unsigned long long>(frames.presented), static_cast<unsigned long long>(frames.dropped));
+    ImGui::Text("++skipped %llu reused %llu", static_cast<unsigned long long>(frames.skipped), static_cast<unsigned long long>(frames.reused));
+
+    auto capture = m_LifetimeLatency ? m_Metrics->captureTime().lifetime() : m_Metrics->captureTime().window();
+    ImGui::Text("++capture copy p50 %.2f p99 %.2f ms", capture.p50, capture.p99);
+
+    const float MB = 1024.0f * 1024.0f;
+
+    auto processMem = QueryProcessMemory();
+    auto sessionMem = m_Metrics->sessionMemory();
+    auto sharedCost = sessionMem.bytes + sessionMem.sharedInitializers;
+    auto saved = sessionMem.unsharedEstimate > sharedCost ? sessionMem.unsharedEstimate - sharedCost : 0;
+
+    ImGui::Spacing();
+    ImGui::Text("Memory");
+    ImGui::Text("++process %.1f MB (private %.1f MB)", processMem.resident / MB, processMem.privateBytes / MB);
+    ImGui::Text("++%d sessions %.1f MB", sessionMem.sessions, sharedCost / MB);
+    ImGui::Text("++++shared weights %.1f MB (%.0f%% copied, private to the process)", sessionMem.sharedInitializers / MB,
+      sessionMem.sharedInitializers ? 100.0 * sessionMem.copiedInitializers / sessionMem.sharedInitializers : 0.0);
+    ImGui::Text("++++saved by sharing ~%.1f MB", saved / MB);
+
+    const auto& residency = m_StyleImageCache->getResidency();
+    ImGui::Text("++styles %.1f / %.1f MB", residency.bytes / MB, residency.budget / MB);
+    ImGui::Text("++++%d resident, %d pinned", residency.resident, residency.pinned);
+    ImGui::Text("++++hits %llu misses %llu", static_cast<unsigned long long>(residency.hits), static_cast<unsigned long long>(residency.misses));
+    ImGui::Text("++++prefetched %llu", static_cast<unsigned long long>(residency.prefetched));
+
+    // collapsed near-duplicates stay reachable from here, they aren't in the style list
+    const auto& duplicates = m_StyleImageCache->getDuplicates();
+
+    if (ImGui::TreeNode("Duplicates", "%zu near-duplicates collapsed", duplicates.size())) {
+      std::vector<std::pair<std::string, std::string>> sorted(duplicates.begin(), duplicates.end());
+      std::sort(sorted.begin(), sorted.end());
+
+      for (const auto& [path, kept] : sorted) {
+        auto label = std::filesystem::u8path(path).filename().u8string() + " (of " + std::filesystem::u8path(kept).filename().u8string() + ")";
+
+        if (ImGui::Selectable(label.c_str(), path == activeImg)) {
+          m_StyleImageCache->setActiveImage(path);
+        }
+      }
+
+      ImGui::TreePop();
+    }
+
+    m_Inf->collectAllocatorStats();
+
+    const auto& accounting = MemoryAccounting::instance();
+
+    for (int i = 0; i < static_cast<int>(MemoryAccounting::Subsystem::Count); i++) {
+      auto subsystem = static_cast<MemoryAccounting::Subsystem>(i);
+      const auto& account = accounting.get(subsystem);
+
+      // never used (e.g. no allocator stats from this runtime)
+      if (account.peak() == 0) {
+        continue;
+      }
+
+      ImGui::Text("++%s %.1f MB (peak %.1f MB)", MemoryAccounting::getName(subsystem), account.bytes() / MB, account.peak() / MB);
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Operators");
+
+    auto opProfile = m_Inf->getOpProfile();
+
+    if (m_Inf->isProfiling()) {
+      ImGui::Text("++profiling ...");
+    }
+    else {
+      if (ImGui::Button("Profile")) {
+        m_Inf->startProfiling(m_ProfileFrames);
+      }
+
+      if (opProfile) {
+        ImGui::SameLine();
+        if (ImGui::Button("Export")) {
+          opProfile->exportCsv("op_profile.csv");
+        }
+      }
+    }
+
+    if (opProfile && !opProfile->getOps().empty()) {
+      ImGui::Text("++%.2f ms/frame over %d frames", opProfile->getTotalMs() / opProfile->getFrames(), opProfile->getFrames());
+
+      auto tableFlags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingFixedFit;
+      auto tableHeight = ImGui::GetTextLineHeightWithSpacing() * 11;
+
+      if (ImGui::BeginTable("##ops", 4, tableFlags, ImVec2(0.0f, tableHeight))) {
+        ImGui::TableSetupScrollFreeze(1, 1);
+        ImGui::TableSetupColumn("Op");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("%");
+        ImGui::TableSetupColumn("Shapes");
+        ImGui::TableHeadersRow();
+
+        const auto& ops = opProfile->getOps();
+
+        for (size_t i = 0; i < ops.size() && i < 10; i++) {
+          ImGui::TableNextRow();
+          ImGui::TableNextColumn();
+          ImGui::Text("%s", ops[i].type.c_str());
+          ImGui::TableNextColumn();
+          ImGui::Text("%.2f", ops[i].totalMs / opProfile->getFrames());
+          ImGui::TableNextColumn();
+          ImGui::Text("%.1f", 100.0f * ops[i].totalMs / opProfile->getTotalMs());
+          ImGui::TableNextColumn();
+          ImGui::Text("%s", ops[i].shapes.c_str());
+        }
+
+        ImGui::EndTable();
+      }
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Export");
+    ImGui::SameLine();
+    ImGui::PushItemWidth(10 * ImGui::GetFontSize());
+
+    if (ImGui::BeginCombo("##export", MetricsExporter::getModeName(m_Exporter->getMode()))) {
+      for (int i = 0; i < static_cast<int>(MetricsExporter::Mode::Count); i++) {
+        auto mode = static_cast<MetricsExporter::Mode>(i);
+
+        if (ImGui::Selectable(MetricsExporter::getModeName(mode), mode == m_Exporter->getMode())) {
+          m_Exporter->setMode(mode);
+          ImGui::MarkIniSettingsDirty();
+        }
+      }
+
+      ImGui::EndCombo();
+    }
+
+    ImGui::PopItemWidth();
+
+    if (m_Exporter->getMode() != MetricsExporter::Mode::Off) {
+      ImGui::Text("++%llu exported, %llu dropped", static_cast<unsigned long long>(m_Exporter->getExported()), static_cast<unsigned long long>(m_Exporter->getDropped()));
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Trace");
+
+    if (ImGui::Button("Dump")) {
+      dumpTrace();
+    }
+
+    ImGui::SameLine();
+    ImGui::Text("last %d s to %s (Ctrl+Shift+F9)", m_TraceSeconds, m_TracePath);
+
+    if (m_Recorder) {
+      ImGui::Spacing();
+      ImGui::Text("Recording");
+
+      if (ImGui::Button(m_Recorder->isRecording() ? "Stop##recording" : "Record##recording")) {
+        if (m_Recorder->isRecording()) {
+          m_Recorder->stop();
+        }
+        else {
+          m_Recorder->start(m_RecordingPath);
+        }
+      }
+
+      ImGui::SameLine();
+      ImGui::Text("captured frames to %s", m_RecordingPath);
+
+      if (m_Recorder->isRecording() || m_Recorder->getRecorded() > 0) {
+        ImGui::Text("++%llu frames, %llu dropped, %.1f MB", static_cast<unsigned long long>(m_Recorder->getRecorded()),
+          static_cast<unsigned long long>(m_Recorder->getDropped()), m_Recorder->getBytes() / (1024.0 * 1024.0));
+      }
+    }
+
+    ImGui::Spacing();
+    ImGui::Text("Autotune");
+
+    switch (m_AutoTuner->getState()) {
+      case AutoTuner::State::Idle: ImGui::Text("++not run"); break;
+      case AutoTuner::State::Running: ImGui::Text("++running %d%%", static_cast<int>(100 * m_AutoTuner->getProgress())); break;
+      case AutoTuner::State::Done:
+        if (m_AutoTuner->isApplied()) {
+          ImGui::Text("++done, applied the best configuration");
+        }
+        else {
+          ImGui::Text(m_AutoTuner->isTimedOut() ? "++timed out, kept the current configuration" : "++done, kept the current configuration");
+        }
+        break;
+      case AutoTuner::State::Cancelled: ImGui::Text("++cancelled"); break;
+    }
+
+    int best = m_AutoTuner->getBest();
+    auto results = m_AutoTuner->getResults();
+
+    for (int i = 0; i < static_cast<int>(results.size()); i++) {
+      const auto& result = results[i];
+      auto label = m_AutoTuner->describe(result.config) + (result.baseline ? " (current)" : "");
+
+      if (i == best) {
+        ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 117, 24, 255));
+      }
+
+      if (result.ms < 0.0f) {
+        ImGui::Text("++++%s failed", label.c_str());
+      }
+      else {
+        ImGui::Text("++++%s %.1f ms", label.c_str(), result.ms);
+      }
+
+      if (i == best) {
+        ImGui::PopStyleColor();
+      }
+    }
 
     ImGui::EndChild();
   }
 
   ImGui::Dummy(sectionSpacing);
 
-  // Stylization TODO
-
-  // Calculate vertical alignment offsets for sliders and text to each side
-  //float textHeight = ImGui::GetTextLineHeight();
-  //float frameHeight = ImGui::GetFrameHeight();
-  //float verticalOffset = (frameHeight - textHeight) * 0.5f;
+  // Image mixing: both sliders mix pixels of the images fed to the model as its style input, they
+  // don't scale or interpolate the style itself
 
-  /*
-  ImGui::SeparatorText("Stylization");
+  ImGui::SeparatorText("Style Input Mixing");
 
-  static int stylization = 0;
+  int stylization = static_cast<int>(std::round(m_Inf->getStyleImageWeight() * m_StylizationSteps));
 
   ImGui::Text("Content Img");
   ImGui::SameLine();
   ImGui::SetCursorPosY(ImGui::GetCursorPosY() - verticalOffset);
   ImGui::PushItemWidth(8 * ImGui::GetFontSize());
-  ImGui::SliderInt("##sliderStylization", &stylization, 0, 7, "");
+  if (ImGui::SliderInt("##sliderStylization", &stylization, 0, m_StylizationSteps, "")) {
+    m_Inf->setStyleImageWeight(static_cast<float>(stylization) / m_StylizationSteps);
+  }
+
+  if (ImGui::IsItemHovered()) {
+    ImGui::SetTooltip("Mixes a snapshot of the content image, taken when this changes, into the style image");
+  }
 
   ImGui::SameLine();
   ImGui::SetCursorPosY(ImGui::GetCursorPosY() - verticalOffset);
   ImGui::Text("Style Img");
-  */
+
+  if (!blendImg.empty()) {
+    int blend = static_cast<int>(std::round(m_StyleImageCache->getBlendWeight() * m_StylizationSteps));
+
+    ImGui::Text("Style Img  ");
+    ImGui::SameLine();
+    ImGui::SetCursorPosY(ImGui::GetCursorPosY() - verticalOffset);
+    if (ImGui::SliderInt("##sliderBlend", &blend, 0, m_StylizationSteps, "")) {
+      m_StyleImageCache->setBlendWeight(static_cast<float>(blend) / m_StylizationSteps);
+    }
+
+    if (ImGui::IsItemHovered()) {
+      ImGui::SetTooltip("Mixes the blend image into the style image");
+    }
+
+    ImGui::SameLine();
+    ImGui::SetCursorPosY(ImGui::GetCursorPosY() - verticalOffset);
+    ImGui::Text("Blend Img");
+  }
+  else {
+    ImGui::TextDisabled("Right-click a style to mix it in");
+  }
+
+  ImGui::Dummy(sectionSpacing);
 
 
   ImGui::SeparatorText("Quality");
 
-  static int quality = m_Inf->getQualityPerfFactor();
+  int quality = m_Inf->getQualityPerfFactor();
   auto qualityRange = m_Inf->getQualityPerfRange();
 
   ImGui::Text("Performance");
@@ -485,6 +927,24 @@ void UiControls::render(float fps)
   ImGui::SetCursorPosY(ImGui::GetCursorPosY() - verticalOffset);
   ImGui::Text("Quality");
 
+  // Model ladder
+
+  if (m_Inf->getModelTierCount() > 1) {
+    int modelTier = m_Inf->getRequestedModelTier();
+    auto modelTierName = m_Inf->getModelTierName(modelTier);
+
+    if (modelTier != m_Inf->getModelTier()) {
+      modelTierName += " (loading)";
+    }
+
+    ImGui::Text("Model");
+    ImGui::SameLine();
+    ImGui::SetCursorPosY(ImGui::GetCursorPosY() - verticalOffset);
+    if (ImGui::SliderInt("##sliderModel", &modelTier, 0, m_Inf->getModelTierCount() - 1, modelTierName.c_str())) {
+      m_Inf->setModelTier(modelTier);
+    }
+  }
+
   // End ImGui frame
 
   ImGui::End();
@@ -504,6 +964,12 @@ void UiControls::render(float fps)
 
 
 
+void UiControls::dumpTrace() {
+  SpanRecorder::instance().dump(m_TracePath, static_cast<float>(m_TraceSeconds));
+}
+
+
+
 void UiControls::saveState(ImGuiTextBuffer* buf) {
   buf->appendf("Enabled=%d\n", m_Inf->isEnabled());
   buf->appendf("Provider=%d\n", m_Inf->getProvider());
@@ -515,6 +981,22 @@ void UiControls::saveState(ImGuiTextBuffer* buf) {
   }
 
   buf->appendf("Quality=%d\n", m_Inf->getQualityPerfFactor());
+  buf->appendf("ModelTier=%d\n", m_Inf->getRequestedModelTier());
+  buf->appendf("IntraOpThreads=%d\n", m_Inf->getIntraOpThreads());
+  buf->appendf("InterOpThreads=%d\n", m_Inf->getInterOpThreads());
+  buf->appendf("AutoTuned=%d\n", m_AutoTuned);
+  buf->appendf("AutoTuneQualityFloor=%d\n", m_AutoTuneQualityFloor);
+  buf->appendf("StyleMemoryMB=%zu\n", m_StyleImageCache->getResidency().budget / (1024 * 1024));
+  buf->appendf("Stylization=%d\n", static_cast<int>(std::round(m_Inf->getStyleImageWeight() * m_StylizationSteps)));
+
+  if (!m_StyleImageCache->getBlendImage().empty()) {
+    std::hash<std::string> hash_fn;
+    buf->appendf("BlendImage=%zu\n", hash_fn(m_StyleImageCache->getBlendImage()));
+  }
+
+  buf->appendf("BlendWeight=%d\n", static_cast<int>(std::round(m_StyleImageCache->getBlendWeight() * m_StylizationSteps)));
+  buf->appendf("Metrics=%d\n", Instrumentation::isEnabled());
+  buf->appendf("MetricsExport=%d\n", static_cast<int>(m_Exporter->getMode()));
 }
 
 
@@ -544,6 +1026,35 @@ void UiControls::restoreState(const char* line) {
     }
   }
   else if (sscanf_s(line, "Quality=%d", &val) == 1) { m_Inf->setQualityPerfFactor(val); }
+  else if (sscanf_s(line, "ModelTier=%d", &val) == 1) { m_Inf->setModelTier(val); }
+  else if (sscanf_s(line, "IntraOpThreads=%d", &val) == 1) { m_RestoredIntraOpThreads = val; }
+  else if (sscanf_s(line, "InterOpThreads=%d", &val) == 1) { m_RestoredInterOpThreads = val; }
+  else if (sscanf_s(line, "AutoTuned=%d", &val) == 1) { m_AutoTuned = val != 0; }
+  else if (sscanf_s(line, "AutoTuneQualityFloor=%d", &val) == 1) { m_AutoTuneQualityFloor = val; }
+  else if (sscanf_s(line, "BlendImage=%zu", &h) == 1) {
+    std::hash<std::string> hash_fn;
+
+    for (const auto& [path, _] : m_StyleImageCache->getImages()) {
+      if (h == hash_fn(path)) {
+        m_StyleImageCache->setBlendImage(path);
+        break;
+      }
+    }
+  }
+  else if (sscanf_s(line, "Stylization=%d", &val) == 1) { m_Inf->setStyleImageWeight(static_cast<float>(val) / m_StylizationSteps); }
+  else if (sscanf_s(line, "BlendWeight=%d", &val) == 1) { m_StyleImageCache->setBlendWeight(static_cast<float>(val) / m_StylizationSteps); }
+  else if (sscanf_s(line, "Metrics=%d", &val) == 1) {
+    // the environment variable wins, it's how a misbehaving install gets diagnosed
+    if (!Instrumentation::isSetByEnvironment()) {
+      Instrumentation::setEnabled(val != 0);
+    }
+  }
+  else if (sscanf_s(line, "MetricsExport=%d", &val) == 1) {
+    if (val >= 0 && val < static_cast<int>(MetricsExporter::Mode::Count)) {
+      m_Exporter->setMode(static_cast<MetricsExporter::Mode>(val));
+    }
+  }
+  else if (sscanf_s(line, "StyleMemoryMB=%d", &val) == 1) { m_StyleImageCache->setMemoryBudget(static_cast<size_t>(std::max(0, val)) * 1024 * 1024); }
 }
 
 
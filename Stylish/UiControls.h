@@ -8,13 +8,22 @@
 
 #include "imgui/imgui.h"
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 
+
+class AutoTuner;
+class CaptureRecorder;
+class D3D11ThumbnailTextures;
+class MetricsExporter;
 class Inference;
 class StyleImageCache;
 
 class UiControls {
 public:
-  UiControls(HMODULE hInstance, HWND hwndParent, int nCmdShow, Inference* inf, StyleImageCache* styleImgCache, PerfMetrics* metrics);
+  UiControls(HMODULE hInstance, HWND hwndParent, int nCmdShow, Inference* inf, StyleImageCache* styleImgCache, PerfMetrics* metrics, CaptureRecorder* recorder);
 
   virtual ~UiControls();
 
@@ -34,6 +43,9 @@ public:
 
   bool isBindingInvisibleModeKey() const { return m_IsBinding; }
 
+  // Writes the last few seconds of pipeline spans as Chrome trace JSON (also on Ctrl+Shift+F9)
+  void dumpTrace();
+
   void onWindowSizeChanged(UINT width, UINT height);
 
   void render(float fps);
@@ -43,6 +55,7 @@ public:
 
 private:
   HWND m_HwndUI = nullptr;
+  HWND m_HwndParent = nullptr;
 
   float m_DpiScaleFactor = 1.0f;
 
@@ -51,13 +64,55 @@ private:
   IDXGISwapChain* m_SwapChain = nullptr;
   ID3D11RenderTargetView* m_MainRenderTargetView = nullptr;
 
+  std::unique_ptr<D3D11ThumbnailTextures> m_ThumbnailTextures;
+
   Inference* m_Inf;
   StyleImageCache* m_StyleImageCache;
   PerfMetrics* m_Metrics;
+  CaptureRecorder* m_Recorder;
 
   bool m_IsBinding = false;
   DWORD m_InvisibleModeKey = 'U';
 
+  // Autotune runs once on first launch, then on demand
+  std::unique_ptr<AutoTuner> m_AutoTuner;
+  bool m_AutoTuned = false;
+  int m_AutoTuneQualityFloor = 2;
+
+  // Metrics for monitoring (file/socket), off by default
+  std::unique_ptr<MetricsExporter> m_Exporter;
+
+  // Threading restored from .ini, applied in one go since it recreates the sessions
+  int m_RestoredIntraOpThreads = 0;
+  int m_RestoredInterOpThreads = 0;
+
+  // Operator profiling
+  const int m_ProfileFrames = 20;
+
+  // Span trace dumps
+  const int m_TraceSeconds = 10;
+  const char* const m_TracePath = "trace.json";
+
+  // Capture recordings, for replaying a session offline (stylish-replay)
+  const char* const m_RecordingPath = "capture.strec";
+
+  // Content <-> style and style <-> blend image mixing sliders
+  const int m_StylizationSteps = 10;
+
+  // Style list shows only the active style and the ones most similar to it
+  bool m_ShowSimilar = false;
+  const int m_SimilarCount = 16;
+
+  // Those rows (list indices), queried again only when the active style or the list changes
+  std::vector<size_t> m_SimilarRows;
+  std::string m_SimilarTo;
+  uint64_t m_SimilarListVersion = 0;
+
+  // Latency percentiles over the last few seconds, or since launch
+  bool m_LifetimeLatency = false;
+
+  void startAutoTune();
+
 
   void CreateRenderTarget();
   void CleanupRenderTarget();